@@ -7,6 +7,7 @@
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -14,14 +15,113 @@
 
 namespace leveldb {
 
+// Add the range tombstones of *range_del_iter to *builder, widening the
+// key range of *meta to span them.
+static void AddRangeTombstones(const Comparator* icmp, Iterator* iter,
+                               TableBuilder* builder, FileMetaData* meta) {
+  for (; iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      continue;
+    }
+    // The table holds nothing for "end" itself, so bound it by the
+    // internal key that sorts before every entry for "end".
+    InternalKey begin, end;
+    begin.DecodeFrom(iter->key());
+    end.SetFrom(ParsedInternalKey(iter->value(), kMaxSequenceNumber,
+                                  kTypeRangeDeletion));
+    if (builder->NumEntries() == 0 && !meta->has_range_deletions) {
+      meta->smallest = begin;
+      meta->largest = end;
+    } else {
+      if (icmp->Compare(begin.Encode(), meta->smallest.Encode()) < 0) {
+        meta->smallest = begin;
+      }
+      if (icmp->Compare(end.Encode(), meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+    }
+    builder->AddRangeTombstone(iter->key(), iter->value());
+    meta->has_range_deletions = true;
+  }
+}
+
+Status AddToTable(const Options& options, TableCache* table_cache,
+                  uint64_t relocate_before, const Slice& key,
+                  const Slice& value, ValueLogBuilder* value_log,
+                  TableBuilder* builder, uint64_t* oldest_value_log,
+                  uint64_t* value_log_bytes) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(key, &ikey) ||
+      (ikey.type != kTypeValue && ikey.type != kTypeValueHandle)) {
+    builder->Add(key, value);
+    return Status::OK();
+  }
+
+  Status s;
+  Slice v = value;
+  ValueHandle handle;
+  if (ikey.type == kTypeValueHandle) {
+    Slice input = value;
+    s = handle.DecodeFrom(&input);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  bool separate;
+  if (ikey.type == kTypeValue) {
+    separate = options.value_log_threshold > 0 &&
+               value.size() >= options.value_log_threshold;
+  } else {
+    separate = handle.file_number() < relocate_before;
+  }
+  if (value_log == nullptr || !separate) {
+    builder->Add(key, value);
+  } else {
+    std::string relocated;
+    if (ikey.type == kTypeValueHandle) {
+      s = table_cache->ReadValue(ReadOptions(), value, &relocated);
+      if (!s.ok()) {
+        return s;
+      }
+      v = relocated;
+    }
+    s = value_log->Add(ikey.user_key, v, &handle);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string handle_encoding;
+    handle.EncodeTo(&handle_encoding);
+    InternalKey new_key(ikey.user_key, ikey.sequence, kTypeValueHandle);
+    builder->Add(new_key.Encode(), handle_encoding);
+  }
+
+  if (handle.file_number() != 0) {
+    if (*oldest_value_log == 0 || handle.file_number() < *oldest_value_log) {
+      *oldest_value_log = handle.file_number();
+    }
+    *value_log_bytes += handle.size();
+  }
+  return s;
+}
+
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, ValueLogBuilder* value_log,
+                  FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
+  meta->oldest_value_log = 0;
+  meta->value_log_bytes = 0;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -29,18 +129,33 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     Slice key;
-    for (; iter->Valid(); iter->Next()) {
+    for (; s.ok() && iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      s = AddToTable(options, table_cache, 0, key, iter->value(), value_log,
+                     builder, &meta->oldest_value_log, &meta->value_log_bytes);
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
+    if (s.ok() && range_del_iter != nullptr) {
+      AddRangeTombstones(options.comparator, range_del_iter, builder, meta);
+    }
+
+    // The values must be durable before the table that refers to them
+    if (s.ok() && value_log != nullptr) {
+      s = value_log->Finish();
+    }
 
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
@@ -75,6 +190,9 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     // Keep it
   } else {
     env->RemoveFile(fname);
+    if (value_log != nullptr) {
+      value_log->Abandon();
+    }
   }
   return s;
 }
@@ -5,6 +5,8 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include <cstdint>
+
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -14,16 +16,38 @@ struct FileMetaData;
 
 class Env;
 class Iterator;
+class Slice;
+class TableBuilder;
 class TableCache;
+class ValueLogBuilder;
 class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
+// Build a Table file from the contents of *iter and the range tombstones
+// yielded by *range_del_iter (which may be nullptr).  The generated file
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// If no data is present in either iterator, meta->file_size will be set
+// to zero, and no Table file will be produced.
+//
+// If "value_log" is non-null, large values are moved to it as described
+// for AddToTable(), and it is finished (or abandoned on failure) before
+// this returns.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, ValueLogBuilder* value_log,
+                  FileMetaData* meta);
+
+// Add the entry "key" => "value" to *builder.  If "value_log" is non-null,
+// a value of at least options.value_log_threshold bytes is moved to it
+// first, and so is a value kept in a value log numbered below
+// "relocate_before" (which is read through "table_cache").  The value log
+// records the entry then refers to are accounted in *oldest_value_log and
+// *value_log_bytes, as in FileMetaData.
+Status AddToTable(const Options& options, TableCache* table_cache,
+                  uint64_t relocate_before, const Slice& key,
+                  const Slice& value, ValueLogBuilder* value_log,
+                  TableBuilder* builder, uint64_t* oldest_value_log,
+                  uint64_t* value_log_bytes);
 
 }  // namespace leveldb
 
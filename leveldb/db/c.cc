@@ -20,6 +20,7 @@
 #include "leveldb/write_batch.h"
 
 using leveldb::Cache;
+using leveldb::CompactionStyle;
 using leveldb::Comparator;
 using leveldb::CompressionType;
 using leveldb::DB;
@@ -193,6 +194,15 @@ void leveldb_delete(leveldb_t* db, const leveldb_writeoptions_t* options,
   SaveError(errptr, db->rep->Delete(options->rep, Slice(key, keylen)));
 }
 
+void leveldb_delete_range(leveldb_t* db, const leveldb_writeoptions_t* options,
+                          const char* begin_key, size_t begin_keylen,
+                          const char* end_key, size_t end_keylen,
+                          char** errptr) {
+  SaveError(errptr,
+            db->rep->DeleteRange(options->rep, Slice(begin_key, begin_keylen),
+                                 Slice(end_key, end_keylen)));
+}
+
 void leveldb_write(leveldb_t* db, const leveldb_writeoptions_t* options,
                    leveldb_writebatch_t* batch, char** errptr) {
   SaveError(errptr, db->rep->Write(options->rep, &batch->rep));
@@ -339,6 +349,12 @@ void leveldb_writebatch_delete(leveldb_writebatch_t* b, const char* key,
   b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_delete_range(leveldb_writebatch_t* b,
+                                     const char* begin_key, size_t begin_klen,
+                                     const char* end_key, size_t end_klen) {
+  b->rep.DeleteRange(Slice(begin_key, begin_klen), Slice(end_key, end_klen));
+}
+
 void leveldb_writebatch_iterate(const leveldb_writebatch_t* b, void* state,
                                 void (*put)(void*, const char* k, size_t klen,
                                             const char* v, size_t vlen),
@@ -426,10 +442,33 @@ void leveldb_options_set_max_file_size(leveldb_options_t* opt, size_t s) {
   opt->rep.max_file_size = s;
 }
 
+void leveldb_options_set_max_subcompactions(leveldb_options_t* opt, int n) {
+  opt->rep.max_subcompactions = n;
+}
+
+void leveldb_options_set_max_background_compactions(leveldb_options_t* opt,
+                                                    int n) {
+  opt->rep.max_background_compactions = n;
+}
+
+void leveldb_options_set_allow_concurrent_memtable_write(
+    leveldb_options_t* opt, uint8_t v) {
+  opt->rep.allow_concurrent_memtable_write = v;
+}
+
+void leveldb_options_set_enable_pipelined_write(leveldb_options_t* opt,
+                                                uint8_t v) {
+  opt->rep.enable_pipelined_write = v;
+}
+
 void leveldb_options_set_compression(leveldb_options_t* opt, int t) {
   opt->rep.compression = static_cast<CompressionType>(t);
 }
 
+void leveldb_options_set_compaction_style(leveldb_options_t* opt, int t) {
+  opt->rep.compaction_style = static_cast<CompactionStyle>(t);
+}
+
 leveldb_comparator_t* leveldb_comparator_create(
     void* state, void (*destructor)(void*),
     int (*compare)(void*, const char* a, size_t alen, const char* b,
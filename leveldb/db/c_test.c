@@ -312,6 +312,21 @@ int main(int argc, char** argv) {
     leveldb_release_snapshot(db, snap);
   }
 
+  StartPhase("delete_range");
+  {
+    leveldb_writebatch_t* wb = leveldb_writebatch_create();
+    leveldb_writebatch_delete_range(wb, "k", 1, "k00000000000000000010", 21);
+    leveldb_write(db, woptions, wb, &err);
+    CheckNoError(err);
+    leveldb_writebatch_destroy(wb);
+    CheckGet(db, roptions, "k00000000000000000000", NULL);
+    CheckGet(db, roptions, "k00000000000000000010", "v00000000000000000010");
+
+    leveldb_delete_range(db, woptions, "k", 1, "l", 1, &err);
+    CheckNoError(err);
+    CheckGet(db, roptions, "k00000000000000000010", NULL);
+  }
+
   StartPhase("repair");
   {
     leveldb_close(db);
@@ -251,6 +251,37 @@ TEST_F(CorruptionTest, TableFileRepair) {
   Check(95, 99);
 }
 
+TEST_F(CorruptionTest, TableFileReverseIteration) {
+  options_.block_size = 2 * kValueSize;  // Limit scope of corruption
+  Reopen();
+  Build(100);
+  DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+  dbi->TEST_CompactMemTable();
+  dbi->TEST_CompactRange(0, nullptr, nullptr);
+  dbi->TEST_CompactRange(1, nullptr, nullptr);
+
+  // Stepping back over a corrupt block must keep the value of the entry
+  // after it.
+  Corrupt(kTableFile, 50 * kValueSize, 1);
+  ReadOptions options;
+  options.verify_checksums = true;
+  options.fill_cache = false;  // Blocks go away with their iterators
+  Iterator* iter = db_->NewIterator(options);
+  int correct = 0;
+  std::string value_space;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    uint64_t key;
+    Slice in(iter->key());
+    ASSERT_TRUE(ConsumeDecimalNumber(&in, &key));
+    ASSERT_EQ(Value(key, &value_space), iter->value());
+    correct++;
+  }
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+  ASSERT_LE(90, correct);
+  ASSERT_GE(99, correct);
+}
+
 TEST_F(CorruptionTest, TableFileIndexData) {
   Build(10000);  // Enough to build multiple Tables
   DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -19,11 +20,18 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/statistics.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -34,6 +42,8 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_timer.h"
+#include "util/stop_watch.h"
 #include "port/port_stdcxx.h"
 
 namespace leveldb {
@@ -43,49 +53,183 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        insert_into_memtable(false),
+        unbatched(false),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool insert_into_memtable;  // Set by the group leader once batch is logged
+  bool unbatched;             // Does its own work once at the front
   port::CondVar cv;
 };
 
+struct DBImpl::IngestedFile {
+  std::string fname;
+  uint64_t file_size;
+  InternalKey smallest, largest;  // With sequence number 0
+  uint64_t temp_number;           // Of the copy awaiting its final number
+  uint64_t number;
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
+    uint64_t oldest_value_log;
+    uint64_t value_log_bytes;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        has_start_key(false),
+        has_end_key(false),
         smallest_snapshot(0),
+        range_tombstones(nullptr),
+        has_output_lower_bound(false),
         outfile(nullptr),
         builder(nullptr),
+        value_log(nullptr),
         total_bytes(0) {}
 
+  ~CompactionState() { delete range_tombstones; }
+
   Compaction* const compaction;
 
+  // A compaction may be split into subcompactions over disjoint user key
+  // ranges, each with its own CompactionState.  This state covers the
+  // user keys in (start_key, end_key]; a missing bound means the range is
+  // unbounded on that side.
+  bool has_start_key;
+  bool has_end_key;
+  std::string start_key;
+  std::string end_key;
+
+  // Progress of this state's pass over the compaction input
+  Compaction::Cursor cursor;
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Range tombstones of the inputs, or nullptr if there are none.  Entries
+  // they hide from every snapshot are dropped.
+  RangeTombstoneList* range_tombstones;
+
+  // Range tombstones to keep, sorted by begin key.  Each output holds
+  // their part between the first key of that output (or the lower bound
+  // left by the previous output) and the first key of the next one.
+  std::vector<RangeTombstone> output_tombstones;
+  bool has_output_lower_bound;
+  std::string output_lower_bound;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
+  // Value log that large values are moved to, shared by all the outputs
+  ValueLogBuilder* value_log;
+
+  // Value logs produced, by number, with their sizes
+  std::map<uint64_t, uint64_t> value_logs;
+
   uint64_t total_bytes;
 };
 
+// One of the subcompactions of a compaction, scheduled by
+// DoCompactionWork() in the Env::kLow thread pool.  Whichever of the
+// pool thread and DoCompactionWork() gets to it first runs it, so that a
+// compaction never waits for a pool thread that other compactions hold.
+struct DBImpl::SubcompactionWork {
+  DBImpl* db;
+  CompactionState* compact;
+  Iterator* input;
+  Status status;
+  // Guarded by db->mutex_
+  bool started;
+  bool finished;
+  int refs;  // Held by DoCompactionWork() and by the scheduled call
+};
+
+namespace {
+
+// A file whose writes are metered by a RateLimiter.
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* file, RateLimiter* limiter,
+                          RateLimiter::Priority priority)
+      : file_(file), limiter_(limiter), priority_(priority) {}
+
+  ~RateLimitedWritableFile() override { delete file_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(data.size(), priority_);
+    return file_->Append(data);
+  }
+  Status Close() override { return file_->Close(); }
+  Status Flush() override { return file_->Flush(); }
+  Status Sync() override { return file_->Sync(); }
+
+ private:
+  WritableFile* const file_;
+  RateLimiter* const limiter_;
+  const RateLimiter::Priority priority_;
+};
+
+// An Env for the files written by flushes or compactions, which may be
+// written with direct I/O, and metered by a RateLimiter.
+class BackgroundWriteEnv : public EnvWrapper {
+ public:
+  BackgroundWriteEnv(Env* target, bool use_direct_io, RateLimiter* limiter,
+                     RateLimiter::Priority priority)
+      : EnvWrapper(target),
+        use_direct_io_(use_direct_io),
+        limiter_(limiter),
+        priority_(priority) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    Status s = use_direct_io_ ? target()->NewDirectWritableFile(fname, result)
+                              : target()->NewWritableFile(fname, result);
+    if (s.ok() && limiter_ != nullptr) {
+      *result = new RateLimitedWritableFile(*result, limiter_, priority_);
+    }
+    return s;
+  }
+
+ private:
+  const bool use_direct_io_;
+  RateLimiter* const limiter_;
+  const RateLimiter::Priority priority_;
+};
+
+}  // namespace
+
+static Env* BackgroundEnv(const Options& options,
+                          RateLimiter::Priority priority) {
+  if (options.rate_limiter == nullptr &&
+      !options.use_direct_io_for_flush_and_compaction) {
+    return options.env;
+  }
+  return new BackgroundWriteEnv(options.env,
+                                options.use_direct_io_for_flush_and_compaction,
+                                options.rate_limiter, priority);
+}
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -103,6 +247,8 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -126,8 +272,12 @@ static int TableCacheSize(const Options& sanitized_options) {
 
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
+      flush_env_(BackgroundEnv(raw_options, RateLimiter::kHigh)),
+      compaction_env_(BackgroundEnv(raw_options, RateLimiter::kLow)),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor,
+                              raw_options.whole_key_filtering),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -139,22 +289,29 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
-      has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      logged_writers_(0),
+      last_logged_sequence_(0),
+      pending_memtable_inserts_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_compactions_scheduled_(0),
+      background_subcompactions_scheduled_(0),
+      background_flush_scheduled_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      stall_condition_(kWriteStallNone) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_subcompactions_scheduled_ > 0 ||
+         background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -177,6 +334,10 @@ DBImpl::~DBImpl() {
   if (owns_cache_) {
     delete options_.block_cache;
   }
+  if (flush_env_ != env_) {
+    delete flush_env_;
+    delete compaction_env_;
+  }
 }
 
 Status DBImpl::NewDB() {
@@ -255,6 +416,7 @@ void DBImpl::RemoveObsoleteFiles() {
           keep = (number >= versions_->ManifestFileNumber());
           break;
         case kTableFile:
+        case kValueLogFile:
           keep = (live.find(number) != live.end());
           break;
         case kTempFile:
@@ -271,7 +433,7 @@ void DBImpl::RemoveObsoleteFiles() {
 
       if (!keep) {
         files_to_delete.push_back(std::move(filename));
-        if (type == kTableFile) {
+        if (type == kTableFile || type == kValueLogFile) {
           table_cache_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
@@ -456,7 +618,11 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      std::vector<uint64_t> file_numbers;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_numbers);
+      for (uint64_t file_number : file_numbers) {
+        pending_outputs_.erase(file_number);
+      }
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -495,7 +661,11 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      std::vector<uint64_t> file_numbers;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_numbers);
+      for (uint64_t file_number : file_numbers) {
+        pending_outputs_.erase(file_number);
+      }
     }
     mem->Unref();
   }
@@ -504,28 +674,40 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base,
+                                std::vector<uint64_t>* file_numbers,
+                                FlushJobInfo* info) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  file_numbers->push_back(meta.number);
+  ValueLogBuilder* value_log = nullptr;
+  if (options_.value_log_threshold > 0) {
+    const uint64_t value_log_number = versions_->NewFileNumber();
+    pending_outputs_.insert(value_log_number);
+    file_numbers->push_back(value_log_number);
+    value_log = new ValueLogBuilder(flush_env_, dbname_, value_log_number);
+  }
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, flush_env_, options_, table_cache_, iter,
+                   range_del_iter, value_log, &meta);
     mutex_.Lock();
   }
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
+  delete range_del_iter;
   delete iter;
-  pending_outputs_.erase(meta.number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -537,13 +719,30 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_deletions, meta.oldest_value_log,
+                  meta.value_log_bytes);
+    if (value_log != nullptr && !value_log->empty()) {
+      edit->AddValueLog(value_log->file_number(), value_log->FileSize());
+    }
   }
+  delete value_log;
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
+  if (options_.statistics != nullptr) {
+    options_.statistics->MeasureTime(kFlushMicros, stats.micros);
+    options_.statistics->RecordTick(kFlushBytesWritten, stats.bytes_written);
+    options_.statistics->RecordLevelTick(kLevelBytesWritten, level,
+                                         stats.bytes_written);
+  }
+  if (info != nullptr) {
+    info->file_number = meta.number;
+    info->file_size = meta.file_size;
+    info->level = level;
+    info->micros = stats.micros;
+  }
   return s;
 }
 
@@ -555,7 +754,9 @@ void DBImpl::CompactMemTable() {
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  std::vector<uint64_t> file_numbers;
+  FlushJobInfo info;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_numbers, &info);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -568,16 +769,28 @@ void DBImpl::CompactMemTable() {
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
+  // The new files are live or abandoned by now.  Until LogAndApply() has
+  // returned, a concurrent compaction could have deleted them as obsolete.
+  for (uint64_t file_number : file_numbers) {
+    pending_outputs_.erase(file_number);
+  }
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
+
+  if (options_.listener != nullptr) {
+    info.db_name = dbname_;
+    info.status = s;
+    mutex_.Unlock();
+    options_.listener->OnFlushCompleted(info);
+    mutex_.Lock();
+  }
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -591,8 +804,14 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
       }
     }
   }
+  int levels_to_compact = max_level_with_files;
+  if (options_.compaction_filter != nullptr) {
+    // Also rewrite the deepest level, so the filter sees all of the range.
+    // The last level is compacted into itself.
+    levels_to_compact = std::min(max_level_with_files + 1, config::kNumLevels);
+  }
   TEST_CompactMemTable();  // TODO(sanjay): Skip if memtable does not overlap
-  for (int level = 0; level < max_level_with_files; level++) {
+  for (int level = 0; level < levels_to_compact; level++) {
     TEST_CompactRange(level, begin, end);
   }
 }
@@ -600,7 +819,7 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
+  assert(level < config::kNumLevels);
 
   InternalKey begin_storage, end_storage;
 
@@ -662,18 +881,37 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+    return;
+  }
+
+  if (imm_ == nullptr || background_flush_scheduled_) {
+    // No flush needed, or already scheduled
+  } else {
+    background_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGFlushWork, this, Env::kHigh);
+  }
+
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled
+  } else if (manual_compaction_ != nullptr) {
+    // A manual compaction runs on its own, once all others have finished
+    // and no file is being ingested
+    if (background_compactions_scheduled_ == 0 &&
+        !versions_->HasIngestedRanges()) {
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this, Env::kLow);
+    }
+  } else if (!versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    background_compactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::kLow);
   }
 }
 
@@ -681,50 +919,89 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool compacted = true;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
+  } else if (manual_compaction_ != nullptr &&
+             (background_compactions_scheduled_ > 1 ||
+              versions_->HasIngestedRanges())) {
+    // Wait for the other compactions and ingestions to finish before the
+    // manual one.
+    compacted = false;
   } else {
-    BackgroundCompaction();
+    compacted = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  If there was nothing
+  // to do, the compactions still running will reschedule when done.
+  if (compacted || background_compactions_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
-  }
-
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
+  // Whether the manual compaction covers the rest of its range
+  bool manual_last = false;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
     if (c != nullptr) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
+      // A compaction of the last level into itself takes all of the range
+      // at once, since its outputs land back in the range.  m->done is
+      // only set once it has finished, since the caller may return then.
+      manual_last = (c->level() == c->output_level());
     }
     Log(options_.info_log,
         "Manual compaction at level-%d from %s .. %s; will stop at %s\n",
         m->level, (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
         (m->end ? m->end->DebugString().c_str() : "(end)"),
-        (m->done ? "(end)" : manual_end.DebugString().c_str()));
+        (m->done || manual_last ? "(end)"
+                                : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
+    // Another thread may find a compaction to run alongside this one.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -735,15 +1012,16 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size, f->smallest,
+                       f->largest, f->has_range_deletions, f->oldest_value_log,
+                       f->value_log_bytes, f->global_sequence);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
@@ -768,7 +1046,7 @@ void DBImpl::BackgroundCompaction() {
 
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
-    if (!status.ok()) {
+    if (!status.ok() || manual_last) {
       m->done = true;
     }
     if (!m->done) {
@@ -779,6 +1057,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -791,10 +1070,17 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     assert(compact->outfile == nullptr);
   }
   delete compact->outfile;
+  if (compact->value_log != nullptr) {
+    compact->value_log->Abandon();
+    delete compact->value_log;
+  }
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
   }
+  for (const auto& value_log_kvp : compact->value_logs) {
+    pending_outputs_.erase(value_log_kvp.first);
+  }
   delete compact;
 }
 
@@ -810,21 +1096,123 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
+    out.oldest_value_log = 0;
+    out.value_log_bytes = 0;
     compact->outputs.push_back(out);
+    if (compact->value_log == nullptr &&
+        (options_.value_log_threshold > 0 ||
+         compact->compaction->ValueLogGCCutoff() > 0)) {
+      const uint64_t value_log_number = versions_->NewFileNumber();
+      pending_outputs_.insert(value_log_number);
+      compact->value_logs[value_log_number] = 0;
+      compact->value_log =
+          new ValueLogBuilder(compaction_env_, dbname_, value_log_number);
+    }
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = compaction_env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
 }
 
+Status DBImpl::CollectRangeTombstones(CompactionState* compact) {
+  Compaction* const c = compact->compaction;
+  RangeTombstoneList* list = new RangeTombstoneList(user_comparator());
+  compact->range_tombstones = list;
+  Status s;
+  for (int which = 0; which < c->num_input_levels() && s.ok(); which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      FileMetaData* f = c->input(which, i);
+      if (f->has_range_deletions) {
+        s = table_cache_->AddRangeTombstones(f->number, f->file_size, list);
+        if (!s.ok()) break;
+      }
+    }
+  }
+  list->Finish();
+
+  const Comparator* ucmp = user_comparator();
+  for (const RangeTombstone& t : list->tombstones()) {
+    if (t.seq <= compact->smallest_snapshot &&
+        c->IsBaseLevelForRange(t.begin, t.end)) {
+      // Every entry this tombstone hides is an input of this compaction,
+      // and will be dropped, so the tombstone is obsolete.
+      continue;
+    }
+    compact->output_tombstones.push_back(t);
+  }
+  std::sort(compact->output_tombstones.begin(),
+            compact->output_tombstones.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              return ucmp->Compare(a.begin, b.begin) < 0;
+            });
+  return s;
+}
+
+void DBImpl::AddRangeTombstonesToOutput(CompactionState* compact,
+                                        const Slice* next_user_key) {
+  const Comparator* ucmp = user_comparator();
+  std::vector<RangeTombstone> tombstones;
+  for (const RangeTombstone& t : compact->output_tombstones) {
+    if (next_user_key != nullptr &&
+        ucmp->Compare(t.begin, *next_user_key) >= 0) {
+      break;  // This and all later tombstones belong to later outputs
+    }
+    if (compact->has_output_lower_bound &&
+        ucmp->Compare(t.end, compact->output_lower_bound) <= 0) {
+      continue;  // Held by earlier outputs
+    }
+    tombstones.push_back(t);
+    RangeTombstone* clipped = &tombstones.back();
+    if (compact->has_output_lower_bound &&
+        ucmp->Compare(clipped->begin, compact->output_lower_bound) < 0) {
+      clipped->begin = compact->output_lower_bound;
+    }
+    if (next_user_key != nullptr &&
+        ucmp->Compare(clipped->end, *next_user_key) > 0) {
+      clipped->end = next_user_key->ToString();
+    }
+  }
+  if (next_user_key != nullptr) {
+    compact->has_output_lower_bound = true;
+    compact->output_lower_bound = next_user_key->ToString();
+  }
+
+  // Tables store range tombstones in internal key order.
+  std::sort(tombstones.begin(), tombstones.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              const int r = ucmp->Compare(a.begin, b.begin);
+              return r < 0 || (r == 0 && a.seq > b.seq);
+            });
+  CompactionState::Output* out = compact->current_output();
+  for (const RangeTombstone& t : tombstones) {
+    InternalKey begin(t.begin, t.seq, kTypeRangeDeletion);
+    InternalKey end(t.end, kMaxSequenceNumber, kTypeRangeDeletion);
+    if (compact->builder->NumEntries() == 0 && !out->has_range_deletions) {
+      out->smallest = begin;
+      out->largest = end;
+    } else {
+      if (internal_comparator_.Compare(begin, out->smallest) < 0) {
+        out->smallest = begin;
+      }
+      if (internal_comparator_.Compare(end, out->largest) > 0) {
+        out->largest = end;
+      }
+    }
+    compact->builder->AddRangeTombstone(begin.Encode(), t.end);
+    out->has_range_deletions = true;
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
@@ -834,7 +1222,12 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   // Check for iterator errors
   Status s = input->status();
+  if (s.ok()) {
+    AddRangeTombstonesToOutput(compact, next_user_key);
+  }
   const uint64_t current_entries = compact->builder->NumEntries();
+  const bool has_range_deletions =
+      compact->current_output()->has_range_deletions;
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -856,7 +1249,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || has_range_deletions)) {
     // Verify that the table is usable
     Iterator* iter =
         table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
@@ -876,28 +1269,37 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(
+          compact->compaction->num_input_levels() - 1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(
+        level, out.number, out.file_size, out.smallest, out.largest,
+        out.has_range_deletions, out.oldest_value_log, out.value_log_bytes);
+  }
+  for (const auto& value_log_kvp : compact->value_logs) {
+    if (value_log_kvp.second > 0) {
+      compact->compaction->edit()->AddValueLog(value_log_kvp.first,
+                                               value_log_kvp.second);
+    }
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->num_input_files(
+          compact->compaction->num_input_levels() - 1),
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -908,38 +1310,222 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
+  // Split the key space into subcompactions.  The first one is run by
+  // this thread; every other one is scheduled in the Env::kLow pool.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  std::vector<CompactionState*> subcompactions;
+  subcompactions.push_back(compact);
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    sub->has_start_key = true;
+    sub->start_key = boundaries[i];
+    subcompactions.back()->has_end_key = true;
+    subcompactions.back()->end_key = boundaries[i];
+    subcompactions.push_back(sub);
+  }
+  if (subcompactions.size() > 1) {
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(subcompactions.size()));
+  }
+
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  std::vector<SubcompactionWork*> work(subcompactions.size() - 1);
+  for (size_t i = 0; i < work.size(); i++) {
+    work[i] = new SubcompactionWork;
+    work[i]->db = this;
+    work[i]->compact = subcompactions[i + 1];
+    work[i]->input = versions_->MakeInputIterator(compact->compaction);
+    work[i]->started = false;
+    work[i]->finished = false;
+    work[i]->refs = 2;
+  }
+
+  CompactionJobInfo info;
+  if (options_.listener != nullptr) {
+    info.db_name = dbname_;
+    info.level = compact->compaction->level();
+    info.output_level = compact->compaction->output_level();
+    for (int which = 0; which < compact->compaction->num_input_levels();
+         which++) {
+      for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+        const FileMetaData* f = compact->compaction->input(which, i);
+        info.input_files.push_back(f->number);
+        info.bytes_read += f->file_size;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < work.size(); i++) {
+    background_subcompactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGSubcompactionWork, work[i], Env::kLow);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  if (options_.listener != nullptr) {
+    options_.listener->OnCompactionBegin(info);
+  }
+
+  Status status;
+  if (compact->compaction->HasRangeDeletions()) {
+    // Such compactions are never split into subcompactions.
+    assert(work.empty());
+    status = CollectRangeTombstones(compact);
+  }
+  if (status.ok()) {
+    status = ProcessCompactionRange(compact, input);
+  }
+  delete input;
+  input = nullptr;
+
+  // Run the subcompactions no pool thread has started yet, then wait for
+  // the others.
+  mutex_.Lock();
+  for (size_t i = 0; i < work.size(); i++) {
+    RunSubcompaction(work[i]);
+  }
+  for (size_t i = 0; i < work.size(); i++) {
+    while (!work[i]->finished) {
+      background_work_finished_signal_.Wait();
+    }
+  }
+
+  // Gather the outputs of all subcompactions, in key order, into compact.
+  for (size_t i = 0; i < work.size(); i++) {
+    CompactionState* sub = work[i]->compact;
+    if (status.ok()) {
+      status = work[i]->status;
+    }
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->value_logs.insert(sub->value_logs.begin(),
+                               sub->value_logs.end());
+    compact->total_bytes += sub->total_bytes;
+    sub->outputs.clear();
+    sub->value_logs.clear();
+    CleanupCompaction(sub);
+    if (--work[i]->refs == 0) {
+      delete work[i];
+    }
+  }
+
+  Statistics* const statistics = options_.statistics;
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  for (int which = 0; which < compact->compaction->num_input_levels();
+       which++) {
+    uint64_t level_bytes_read = 0;
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      level_bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+    stats.bytes_read += level_bytes_read;
+    if (statistics != nullptr) {
+      statistics->RecordLevelTick(kLevelBytesRead,
+                                  compact->compaction->level() + which,
+                                  level_bytes_read);
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->output_level()].Add(stats);
+  if (statistics != nullptr) {
+    statistics->MeasureTime(kCompactionMicros, stats.micros);
+    statistics->RecordTick(kCompactionBytesRead, stats.bytes_read);
+    statistics->RecordTick(kCompactionBytesWritten, stats.bytes_written);
+    statistics->RecordLevelTick(kLevelBytesWritten,
+                                compact->compaction->output_level(),
+                                stats.bytes_written);
+  }
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+
+  if (options_.listener != nullptr) {
+    for (size_t i = 0; i < compact->outputs.size(); i++) {
+      info.output_files.push_back(compact->outputs[i].number);
+    }
+    info.bytes_written = stats.bytes_written;
+    info.micros = stats.micros;
+    info.status = status;
+    mutex_.Unlock();
+    options_.listener->OnCompactionCompleted(info);
+    mutex_.Lock();
+  }
+  return status;
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  SubcompactionWork* work = reinterpret_cast<SubcompactionWork*>(arg);
+  DBImpl* db = work->db;
+  MutexLock l(&db->mutex_);
+  db->RunSubcompaction(work);
+  if (--work->refs == 0) {
+    delete work;
+  }
+  db->background_subcompactions_scheduled_--;
+  db->background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::RunSubcompaction(SubcompactionWork* work) {
+  mutex_.AssertHeld();
+  if (work->started) {
+    return;
+  }
+  work->started = true;
+  mutex_.Unlock();
+  work->status = ProcessCompactionRange(work->compact, work->input);
+  delete work->input;
+  work->input = nullptr;
+  mutex_.Lock();
+  work->finished = true;
+  background_work_finished_signal_.SignalAll();
+}
+
+Status DBImpl::ProcessCompactionRange(CompactionState* compact,
+                                      Iterator* input) {
+  const Comparator* ucmp = user_comparator();
   Status status;
   ParsedInternalKey ikey;
+  if (compact->has_start_key) {
+    // Every entry for start_key belongs to the preceding range.
+    InternalKey start(compact->start_key, kMaxSequenceNumber,
+                      kValueTypeForSeek);
+    input->Seek(start.Encode());
+    while (input->Valid() && ParseInternalKey(input->key(), &ikey) &&
+           ucmp->Compare(ikey.user_key, compact->start_key) <= 0) {
+      input->Next();
+    }
+  } else {
+    input->SeekToFirst();
+  }
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // Whether the current output should be finished before the next key
+  // that goes to the output
+  bool finish_output = false;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != nullptr) {
-        CompactMemTable();
-        // Wake up MakeRoomForWrite() if necessary.
-        background_work_finished_signal_.SignalAll();
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
-
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end_key && ParseInternalKey(key, &ikey) &&
+        ucmp->Compare(ikey.user_key, compact->end_key) > 0) {
+      // Reached the range of the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
-      }
+      finish_output = true;
     }
 
     // Handle key/value, add to state, etc.
@@ -951,8 +1537,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -962,9 +1547,16 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (compact->range_tombstones != nullptr &&
+                 compact->range_tombstones->ShouldDelete(
+                     ikey.user_key, ikey.sequence,
+                     compact->smallest_snapshot)) {
+        // Hidden by a range tombstone from every snapshot
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -976,6 +1568,31 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
 
       last_sequence_for_key = ikey.sequence;
+      if (!drop && ikey.type == kTypeMerge) {
+        if (options_.merge_operator != nullptr &&
+            ikey.sequence <= compact->smallest_snapshot) {
+          std::vector<std::pair<std::string, std::string>> entries;
+          bool resolved;
+          status = MergeCompactionOperands(compact, input, ikey, &entries,
+                                           &resolved);
+          for (size_t i = 0; status.ok() && i < entries.size(); i++) {
+            const Slice user_key(current_user_key);
+            status = AddCompactionEntry(compact, input, &user_key,
+                                        entries[i].first, entries[i].second,
+                                        &finish_output);
+          }
+          if (!status.ok()) {
+            break;
+          }
+          if (!resolved) {
+            last_sequence_for_key = kMaxSequenceNumber;
+          }
+          // "input" is already past the operands
+          continue;
+        }
+        // The operand does not hide the entries it applies to
+        last_sequence_for_key = kMaxSequenceNumber;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -983,31 +1600,31 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+    std::string new_key, new_value;
+    bool replaced = false;
+    if (!drop && has_current_user_key &&
+        options_.compaction_filter != nullptr &&
+        (ikey.type == kTypeValue || ikey.type == kTypeValueHandle) &&
+        ikey.sequence <= compact->smallest_snapshot) {
+      status = FilterCompactionEntry(compact, ikey, input->value(), &drop,
+                                     &replaced, &new_key, &new_value);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+    }
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+    if (!drop) {
+      status = AddCompactionEntry(
+          compact, input, has_current_user_key ? &ikey.user_key : nullptr,
+          replaced ? Slice(new_key) : key,
+          replaced ? Slice(new_value) : input->value(), &finish_output);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1017,51 +1634,218 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr) {
+    // Range tombstones past the last output still need an output.
+    for (const RangeTombstone& t : compact->output_tombstones) {
+      if (!compact->has_output_lower_bound ||
+          ucmp->Compare(t.end, compact->output_lower_bound) > 0) {
+        status = OpenCompactionOutputFile(compact);
+        break;
+      }
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, nullptr);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
+  if (status.ok() && compact->value_log != nullptr) {
+    // The values must be durable before the outputs are installed
+    status = compact->value_log->Finish();
+    compact->value_logs[compact->value_log->file_number()] =
+        compact->value_log->FileSize();
+    delete compact->value_log;
+    compact->value_log = nullptr;
+  }
+  return status;
+}
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+Status DBImpl::AddCompactionEntry(CompactionState* compact, Iterator* input,
+                                  const Slice* user_key, const Slice& key,
+                                  const Slice& value, bool* finish_output) {
+  Status status;
+  // Finish the current output if it is big enough.  All entries for
+  // a user key go to the same output, so that the range tombstones
+  // split between two outputs never hide entries in the other one.
+  if (compact->builder != nullptr &&
+      (*finish_output || compact->builder->FileSize() >=
+                             compact->compaction->MaxOutputFileSize()) &&
+      user_key != nullptr &&
+      user_comparator()->Compare(
+          *user_key, compact->current_output()->largest.user_key()) != 0) {
+    status = FinishCompactionOutputFile(compact, input, user_key);
+    if (!status.ok()) {
+      return status;
     }
   }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
 
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    *finish_output = false;
+    status = OpenCompactionOutputFile(compact);
+    if (!status.ok()) {
+      return status;
+    }
   }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
+  CompactionState::Output* out = compact->current_output();
+  if (compact->builder->NumEntries() == 0) {
+    out->smallest.DecodeFrom(key);
   }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
+  out->largest.DecodeFrom(key);
+  return AddToTable(options_, table_cache_,
+                    compact->compaction->ValueLogGCCutoff(), key, value,
+                    compact->value_log, compact->builder,
+                    &out->oldest_value_log, &out->value_log_bytes);
 }
 
-namespace {
-
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+Status DBImpl::FilterCompactionEntry(CompactionState* compact,
+                                     const ParsedInternalKey& ikey,
+                                     const Slice& value, bool* drop,
+                                     bool* replaced, std::string* new_key,
+                                     std::string* new_value) {
+  Status status;
+  Slice existing_value = value;
+  std::string stored_value;
+  if (ikey.type == kTypeValueHandle) {
+    status = table_cache_->ReadValue(ReadOptions(), value, &stored_value);
+    if (!status.ok()) {
+      return status;
+    }
+    existing_value = stored_value;
+  }
+
+  const bool is_bottommost =
+      compact->compaction->IsBaseLevelForKey(ikey.user_key, &compact->cursor);
+  bool value_changed = false;
+  new_value->clear();
+  if (options_.compaction_filter->Filter(
+          compact->compaction->output_level(), is_bottommost, ikey.user_key,
+          existing_value, new_value, &value_changed)) {
+    if (is_bottommost) {
+      *drop = true;
+    } else {
+      // Hide the older entries for the key in the deeper levels
+      InternalKey deletion(ikey.user_key, ikey.sequence, kTypeDeletion);
+      *new_key = deletion.Encode().ToString();
+      new_value->clear();
+      *replaced = true;
+    }
+  } else if (value_changed) {
+    InternalKey changed(ikey.user_key, ikey.sequence, kTypeValue);
+    *new_key = changed.Encode().ToString();
+    *replaced = true;
+  }
+  return status;
+}
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
-};
+Status DBImpl::MergeCompactionOperands(
+    CompactionState* compact, Iterator* input, const ParsedInternalKey& ikey,
+    std::vector<std::pair<std::string, std::string>>* entries,
+    bool* resolved) {
+  const Comparator* ucmp = user_comparator();
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+  // The operands, newest first, with their internal keys
+  std::vector<std::pair<std::string, std::string>> operands;
+  operands.emplace_back(input->key().ToString(), input->value().ToString());
+
+  Status status;
+  bool has_base = false;    // Whether a value or deletion was found
+  std::string base_value;   // The value found, if any
+  bool has_base_value = false;
+  for (input->Next(); input->Valid(); input->Next()) {
+    ParsedInternalKey older;
+    if (!ParseInternalKey(input->key(), &older) ||
+        ucmp->Compare(older.user_key, user_key) != 0) {
+      break;
+    }
+    if (compact->range_tombstones != nullptr &&
+        compact->range_tombstones->ShouldDelete(older.user_key,
+                                                older.sequence,
+                                                compact->smallest_snapshot)) {
+      // Deleted, as is everything older
+      has_base = true;
+      break;
+    }
+    if (older.type == kTypeMerge) {
+      operands.emplace_back(input->key().ToString(),
+                            input->value().ToString());
+      continue;
+    }
+    has_base = true;
+    if (older.type == kTypeValue) {
+      base_value = input->value().ToString();
+      has_base_value = true;
+    } else if (older.type == kTypeValueHandle) {
+      status = table_cache_->ReadValue(ReadOptions(), input->value(),
+                                       &base_value);
+      has_base_value = true;
+    }
+    break;
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  if (!has_base &&
+      compact->compaction->IsBaseLevelForKey(user_key, &compact->cursor)) {
+    // No older entry for the key anywhere: the operands apply to no value
+    has_base = true;
+  }
+
+  entries->clear();
+  *resolved = has_base;
+  std::string merged;
+  if (has_base) {
+    std::vector<Slice> oldest_first;
+    for (size_t i = operands.size(); i > 0; i--) {
+      oldest_first.push_back(operands[i - 1].second);
+    }
+    const Slice existing_value(base_value);
+    status = FullMerge(user_key, has_base_value ? &existing_value : nullptr,
+                       oldest_first, &merged);
+    if (status.ok()) {
+      InternalKey key(user_key, sequence, kTypeValue);
+      entries->emplace_back(key.Encode().ToString(), merged);
+    }
+    return status;
+  }
+
+  // The value lives in a deeper level: combine the operands into one if
+  // the operator can.
+  merged = operands.back().second;
+  for (size_t i = operands.size() - 1; i > 0; i--) {
+    std::string combined;
+    if (!options_.merge_operator->PartialMerge(user_key, merged,
+                                               operands[i - 1].second,
+                                               &combined, options_.info_log)) {
+      entries->swap(operands);
+      return status;
+    }
+    merged.swap(combined);
+  }
+  InternalKey key(user_key, sequence, kTypeMerge);
+  entries->emplace_back(key.Encode().ToString(), merged);
+  return status;
+}
+
+namespace {
+
+struct IterState {
+  port::Mutex* const mu;
+  Version* const version GUARDED_BY(mu);
+  MemTable* const mem GUARDED_BY(mu);
+  MemTable* const imm GUARDED_BY(mu);
+  // The ReadOptions bounds as internal keys, which the table iterators
+  // point to.
+  std::string lower_bound;
+  std::string upper_bound;
+  Slice lower_bound_key;
+  Slice upper_bound_key;
+
+  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
+      : mu(mutex), version(version), mem(mem), imm(imm) {}
+};
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
@@ -1077,9 +1861,32 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneList** range_tombstones) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+
+  // The tables order internal keys, so they get the bounds as the first
+  // internal keys of the bound user keys.
+  ReadOptions table_options = options;
+  if (options.iterate_lower_bound != nullptr) {
+    AppendInternalKey(&cleanup->lower_bound,
+                      ParsedInternalKey(*options.iterate_lower_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+    cleanup->lower_bound_key = cleanup->lower_bound;
+    table_options.iterate_lower_bound = &cleanup->lower_bound_key;
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    AppendInternalKey(&cleanup->upper_bound,
+                      ParsedInternalKey(*options.iterate_upper_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+    cleanup->upper_bound_key = cleanup->upper_bound;
+    table_options.iterate_upper_bound = &cleanup->upper_bound_key;
+  }
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
@@ -1089,23 +1896,52 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
     list.push_back(imm_->NewIterator());
     imm_->Ref();
   }
-  versions_->current()->AddIterators(options, &list);
+  versions_->current()->AddIterators(table_options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_tombstones != nullptr) {
+    // The iterator holds references to mem, imm and current, so they
+    // can be read without the mutex.
+    RangeTombstoneList* list = new RangeTombstoneList(user_comparator());
+    Iterator* iter = mem->NewRangeTombstoneIterator();
+    Status s = list->AddAll(iter);
+    delete iter;
+    if (s.ok() && imm != nullptr) {
+      iter = imm->NewRangeTombstoneIterator();
+      s = list->AddAll(iter);
+      delete iter;
+    }
+    if (s.ok()) {
+      s = current->AddRangeTombstones(list);
+    }
+    if (!s.ok()) {
+      delete list;
+      delete internal_iter;
+      *range_tombstones = nullptr;
+      return NewErrorIterator(s);
+    }
+    if (list->empty()) {
+      delete list;
+      list = nullptr;
+    } else {
+      list->Finish();
+    }
+    *range_tombstones = list;
+  }
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed, nullptr);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1115,8 +1951,12 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  Statistics* const statistics = options_.statistics;
+  StopWatch sw(env_, statistics, kDBGetMicros);
   Status s;
+  PerfTimer lock_timer(&PerfContext::db_mutex_lock_nanos);
   MutexLock l(&mutex_);
+  lock_timer.Stop();
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1140,15 +1980,32 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    std::vector<std::string> operands;
+    PerfTimer memtable_timer(&PerfContext::get_from_memtable_nanos);
+    PerfCount(&PerfContext::get_from_memtable_count);
+    bool done = mem->Get(lkey, value, &s, &operands);
+    if (!done && imm != nullptr) {
+      PerfCount(&PerfContext::get_from_memtable_count);
+      done = imm->Get(lkey, value, &s, &operands);
+    }
+    memtable_timer.Stop();
+    if (!done) {
+      PerfTimer files_timer(&PerfContext::get_from_output_files_nanos);
+      s = current->Get(options, lkey, value, &operands, &stats);
       have_stat_update = true;
     }
+    ApplyMergeOperands(key, operands, value, &s);
+    if (statistics != nullptr) {
+      statistics->RecordTick(kNumberKeysRead, 1);
+      statistics->RecordTick(have_stat_update ? kMemtableMiss : kMemtableHit,
+                             1);
+      if (s.ok()) {
+        statistics->RecordTick(kBytesRead, value->size());
+      }
+    }
+    lock_timer.Restart();
     mutex_.Lock();
+    lock_timer.Stop();
   }
 
   if (have_stat_update && current->UpdateStats(stats)) {
@@ -1160,16 +2017,152 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+namespace {
+// Orders indices into a key array by the user keys they refer to.
+struct KeyIndexLess {
+  const Comparator* ucmp;
+  const std::vector<Slice>* keys;
+
+  bool operator()(int a, int b) const {
+    return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  Statistics* const statistics = options_.statistics;
+  StopWatch sw(env_, statistics, kDBMultiGetMicros);
+  const int n = static_cast<int>(keys.size());
+  values->assign(n, std::string());
+  statuses->assign(n, Status());
+  if (n == 0) {
+    return;
+  }
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+
+    // Visit the keys in sorted order so that keys which live in the same
+    // table file (or the same block of it) are looked up together.
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    KeyIndexLess less;
+    less.ucmp = user_comparator();
+    less.keys = &keys;
+    std::stable_sort(order.begin(), order.end(), less);
+
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<std::vector<std::string>> operands(n);
+    std::vector<int> pending;
+    std::vector<const LookupKey*> pending_keys;
+    std::vector<std::string*> pending_values;
+    std::vector<std::vector<std::string>*> pending_operands;
+    for (int j = 0; j < n; j++) {
+      const int i = order[j];
+      lkeys[j] = new LookupKey(keys[i], snapshot);
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      // First look in the memtable, then in the immutable memtable (if any).
+      if (mem->Get(*lkeys[j], value, s, &operands[i])) {
+        // Done
+      } else if (imm != nullptr &&
+                 imm->Get(*lkeys[j], value, s, &operands[i])) {
+        // Done
+      } else {
+        pending.push_back(i);
+        pending_keys.push_back(lkeys[j]);
+        pending_values.push_back(value);
+        pending_operands.push_back(&operands[i]);
+      }
+    }
+
+    if (!pending.empty()) {
+      const int m = static_cast<int>(pending.size());
+      std::vector<Status> pending_statuses(m);
+      stats.resize(m);
+      current->MultiGet(options, m, &pending_keys[0], &pending_values[0],
+                        &pending_operands[0], &pending_statuses[0],
+                        &stats[0]);
+      for (int k = 0; k < m; k++) {
+        (*statuses)[pending[k]] = pending_statuses[k];
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      ApplyMergeOperands(keys[i], operands[i], &(*values)[i],
+                         &(*statuses)[i]);
+    }
+
+    for (int j = 0; j < n; j++) {
+      delete lkeys[j];
+    }
+    if (statistics != nullptr) {
+      uint64_t bytes_read = 0;
+      for (int i = 0; i < n; i++) {
+        if ((*statuses)[i].ok()) {
+          bytes_read += (*values)[i].size();
+        }
+      }
+      statistics->RecordTick(kNumberKeysRead, n);
+      statistics->RecordTick(kMemtableHit, n - pending.size());
+      statistics->RecordTick(kMemtableMiss, pending.size());
+      statistics->RecordTick(kBytesRead, bytes_read);
+    }
+    mutex_.Lock();
+  }
+
+  bool schedule = false;
+  for (size_t k = 0; k < stats.size(); k++) {
+    if (current->UpdateStats(stats[k])) {
+      schedule = true;
+    }
+  }
+  if (schedule) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeTombstoneList* range_tombstones;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_tombstones);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, range_tombstones,
+                       (options.prefix_same_as_start ? options_.prefix_extractor
+                                                     : nullptr),
+                       options);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1179,6 +2172,40 @@ void DBImpl::RecordReadSample(Slice key) {
   }
 }
 
+Status DBImpl::ReadValue(const ReadOptions& options, const Slice& handle,
+                         std::string* value) {
+  return table_cache_->ReadValue(options, handle, value);
+}
+
+Status DBImpl::FullMerge(const Slice& user_key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* value) {
+  const MergeOperator* merge_operator = options_.merge_operator;
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("no merge operator for merge operands of ",
+                                user_key);
+  }
+  std::string result;
+  if (!merge_operator->FullMerge(user_key, existing_value, operands, &result,
+                                 options_.info_log)) {
+    return Status::Corruption("merge failed for ", user_key);
+  }
+  value->swap(result);
+  return Status::OK();
+}
+
+void DBImpl::ApplyMergeOperands(const Slice& key,
+                                const std::vector<std::string>& operands,
+                                std::string* value, Status* s) {
+  if (operands.empty() || !(s->ok() || s->IsNotFound())) {
+    return;
+  }
+  const Slice existing_value(*value);
+  std::vector<Slice> oldest_first(operands.rbegin(), operands.rend());
+  *s = FullMerge(key, s->ok() ? &existing_value : nullptr, oldest_first,
+                 value);
+}
+
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
   return snapshots_.New(versions_->LastSequence());
@@ -1198,7 +2225,23 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& operand) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("Merge() requires Options::merge_operator");
+  }
+  return DB::Merge(options, key, operand);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  Statistics* const statistics = options_.statistics;
+  StopWatch sw(env_, statistics, kDBWriteMicros);
+  if (updates != nullptr) {
+    RecordTick(statistics, kNumberKeysWritten,
+               WriteBatchInternal::Count(updates));
+    RecordTick(statistics, kBytesWritten,
+               WriteBatchInternal::ByteSize(updates));
+  }
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1206,21 +2249,59 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  while (!w.done && !w.insert_into_memtable &&
+         (logged_writers_ >= writers_.size() ||
+          &w != writers_[logged_writers_])) {
     w.cv.Wait();
   }
+  if (w.insert_into_memtable) {
+    // The leader of our group has logged our batch and left it to us to
+    // insert it into the memtable.
+    MemTable* mem = mem_;
+    mutex_.Unlock();
+    w.status = WriteBatchInternal::InsertConcurrentlyInto(w.batch, mem);
+    mutex_.Lock();
+    w.insert_into_memtable = false;
+    if (--pending_memtable_inserts_ == 0) {
+      writers_.front()->cv.Signal();
+    }
+    while (!w.done) {
+      w.cv.Wait();
+    }
+  }
   if (w.done) {
     return w.status;
   }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  const bool pipelined = options_.enable_pipelined_write;
+  // While earlier groups are still being inserted into mem_, their
+  // sequence numbers have not been published yet.
+  uint64_t last_sequence = (logged_writers_ == 0) ? versions_->LastSequence()
+                                                  : last_logged_sequence_;
   Writer* last_writer = &w;
+  bool logged = false;
+  bool concurrent_insert = false;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    concurrent_insert =
+        options_.allow_concurrent_memtable_write && write_batch == tmp_batch_;
+    if (concurrent_insert || pipelined) {
+      // Every batch is inserted on its own, numbered as part of the group.
+      SequenceNumber sequence = last_sequence + 1;
+      for (size_t i = logged_writers_;; i++) {
+        Writer* writer = writers_[i];
+        if (writer->batch != nullptr) {
+          WriteBatchInternal::SetSequence(writer->batch, sequence);
+          sequence += WriteBatchInternal::Count(writer->batch);
+        }
+        if (writer == last_writer) break;
+      }
+    }
     last_sequence += WriteBatchInternal::Count(write_batch);
+    logged = true;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1229,14 +2310,18 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      RecordTick(statistics, kWalBytes,
+                 WriteBatchInternal::ByteSize(write_batch));
       bool sync_error = false;
       if (status.ok() && options.sync) {
+        StopWatch sync_sw(env_, statistics, kWalSyncMicros);
+        RecordTick(statistics, kWalSyncs);
         status = logfile_->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !concurrent_insert && !pipelined) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1248,13 +2333,40 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
       }
     }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
+  }
 
+  if (pipelined) {
+    // Let the next group append to the log while this one is inserted
+    // into mem_.  Groups are inserted, and their sequence numbers
+    // published, in the order in which they were logged.
+    last_logged_sequence_ = last_sequence;
+    while (writers_[logged_writers_++] != last_writer) {
+    }
+    if (logged_writers_ < writers_.size()) {
+      writers_[logged_writers_]->cv.Signal();
+    }
+    while (&w != writers_.front()) {
+      w.cv.Wait();
+    }
+  }
+
+  if (logged) {
+    if (!status.ok()) {
+      // Not inserted into mem_
+    } else if (concurrent_insert) {
+      status = InsertBatchGroupConcurrently(last_writer);
+    } else if (pipelined) {
+      status = InsertBatchGroup(last_writer);
+    }
     versions_->SetLastSequence(last_sequence);
   }
 
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
+    if (pipelined) {
+      logged_writers_--;
+    }
     if (ready != &w) {
       ready->status = status;
       ready->done = true;
@@ -1263,20 +2375,24 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     if (ready == last_writer) break;
   }
 
-  // Notify new head of write queue
+  // Notify new head of write queue, and the writer now responsible for
+  // logging, which may be waiting for mem_ to be free of inserts.
   if (!writers_.empty()) {
     writers_.front()->cv.Signal();
+    if (logged_writers_ > 0 && logged_writers_ < writers_.size()) {
+      writers_[logged_writers_]->cv.Signal();
+    }
   }
 
   return status;
 }
 
-// REQUIRES: Writer list must be non-empty
-// REQUIRES: First writer must have a non-null batch
+// REQUIRES: Writer list must have a writer that has not been logged yet
+// REQUIRES: First such writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   mutex_.AssertHeld();
-  assert(!writers_.empty());
-  Writer* first = writers_.front();
+  assert(logged_writers_ < writers_.size());
+  Writer* first = writers_[logged_writers_];
   WriteBatch* result = first->batch;
   assert(result != nullptr);
 
@@ -1291,10 +2407,14 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   }
 
   *last_writer = first;
-  std::deque<Writer*>::iterator iter = writers_.begin();
+  std::deque<Writer*>::iterator iter = writers_.begin() + logged_writers_;
   ++iter;  // Advance past "first"
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
+    if (w->unbatched) {
+      break;
+    }
+
     if (w->sync && !first->sync) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
@@ -1321,8 +2441,97 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
-// REQUIRES: mutex_ is held
+// Has every writer of the group from the front of the writer queue
+// through last_writer insert its own batch into mem_, at the same time.
 // REQUIRES: this thread is currently at the front of the writer queue
+// REQUIRES: the batches of the group have been logged
+Status DBImpl::InsertBatchGroupConcurrently(Writer* last_writer) {
+  mutex_.AssertHeld();
+  Writer* leader = writers_.front();
+  for (Writer* w : writers_) {
+    if (w != leader && w->batch != nullptr) {
+      w->insert_into_memtable = true;
+      pending_memtable_inserts_++;
+      w->cv.Signal();
+    }
+    if (w == last_writer) break;
+  }
+
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertConcurrentlyInto(leader->batch, mem);
+  mutex_.Lock();
+  while (pending_memtable_inserts_ > 0) {
+    leader->cv.Wait();
+  }
+
+  // Report the first error of any writer to the whole group.
+  for (Writer* w : writers_) {
+    if (w != leader && status.ok()) {
+      status = w->status;
+    }
+    if (w == last_writer) break;
+  }
+  return status;
+}
+
+// Insert the batches of the group from the front of the writer queue
+// through last_writer into mem_, one after another.
+// REQUIRES: this thread is currently at the front of the writer queue
+// REQUIRES: the batches of the group have been logged
+Status DBImpl::InsertBatchGroup(Writer* last_writer) {
+  mutex_.AssertHeld();
+  std::vector<WriteBatch*> batches;
+  for (Writer* w : writers_) {
+    if (w->batch != nullptr) {
+      batches.push_back(w->batch);
+    }
+    if (w == last_writer) break;
+  }
+
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+  Status status;
+  for (size_t i = 0; i < batches.size() && status.ok(); i++) {
+    status = WriteBatchInternal::InsertInto(batches[i], mem);
+  }
+  mutex_.Lock();
+  return status;
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: this thread is the first writer that has not been logged
+void DBImpl::WaitForBackgroundWorkWhileStalled() {
+  mutex_.AssertHeld();
+  Statistics* const statistics = options_.statistics;
+  const uint64_t start_micros =
+      (statistics != nullptr) ? env_->NowMicros() : 0;
+  background_work_finished_signal_.Wait();
+  if (statistics != nullptr) {
+    statistics->RecordTick(kStallMicros, env_->NowMicros() - start_micros);
+  }
+}
+
+bool DBImpl::SetStallCondition(WriteStallCondition condition) {
+  mutex_.AssertHeld();
+  if (condition == stall_condition_) {
+    return false;
+  }
+  WriteStallInfo info;
+  info.db_name = dbname_;
+  info.previous = stall_condition_;
+  info.condition = condition;
+  stall_condition_ = condition;
+  if (options_.listener != nullptr) {
+    mutex_.Unlock();
+    options_.listener->OnStallConditionChanged(info);
+    mutex_.Lock();
+    return true;
+  }
+  return false;
+}
+
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
@@ -1341,23 +2550,40 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // individual write by 1ms to reduce latency variance.  Also,
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
+      SetStallCondition(kWriteStallDelayed);
       mutex_.Unlock();
       env_->SleepForMicroseconds(1000);
+      RecordTick(options_.statistics, kStallMicros, 1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
-      break;
+      const WriteStallCondition condition =
+          versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger
+              ? kWriteStallDelayed
+              : kWriteStallNone;
+      if (!SetStallCondition(condition)) {
+        break;
+      }
+      // The mutex was released; check again.
     } else if (imm_ != nullptr) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
+      if (!SetStallCondition(kWriteStallStopped)) {
+        WaitForBackgroundWorkWhileStalled();
+      }
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
-      background_work_finished_signal_.Wait();
+      if (!SetStallCondition(kWriteStallStopped)) {
+        WaitForBackgroundWorkWhileStalled();
+      }
+    } else if (logged_writers_ > 0) {
+      // Earlier write groups are still being inserted into mem_; wait
+      // for them before switching to a new memtable.
+      writers_[logged_writers_]->cv.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1389,7 +2615,6 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
       imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
@@ -1399,6 +2624,360 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+// Returns true iff "mem" holds an entry or a range tombstone for some user
+// key in [smallest_user_key,largest_user_key].
+static bool MemTableOverlapsRange(MemTable* mem, const Comparator* user_cmp,
+                                  const Slice& smallest_user_key,
+                                  const Slice& largest_user_key) {
+  bool overlap = false;
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(InternalKey(smallest_user_key, kMaxSequenceNumber,
+                         kValueTypeForSeek)
+                 .Encode());
+  if (iter->Valid() &&
+      user_cmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0) {
+    overlap = true;
+  }
+  delete iter;
+
+  iter = mem->NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); !overlap && iter->Valid(); iter->Next()) {
+    // A tombstone covers [begin,end).
+    overlap =
+        user_cmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0 &&
+        user_cmp->Compare(iter->value(), smallest_user_key) > 0;
+  }
+  delete iter;
+  return overlap;
+}
+
+// Returns "key" with its sequence number replaced by "seq".
+static InternalKey WithSequence(const InternalKey& key, SequenceNumber seq) {
+  ParsedInternalKey ikey;
+  const bool parsed = ParseInternalKey(key.Encode(), &ikey);
+  assert(parsed);
+  (void)parsed;
+  return InternalKey(ikey.user_key, seq, ikey.type);
+}
+
+Status DBImpl::ReadExternalFile(IngestedFile* file) {
+  Status s = env_->GetFileSize(file->fname, &file->file_size);
+  RandomAccessFile* raf = nullptr;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(file->fname, &raf);
+  }
+  Table* table = nullptr;
+  if (s.ok()) {
+    s = Table::Open(options_, raf, file->file_size, &table);
+  }
+  if (s.ok()) {
+    Iterator* range_iter = table->NewRangeTombstoneIterator();
+    if (range_iter != nullptr) {
+      s = Status::InvalidArgument(file->fname, "holds range tombstones");
+      delete range_iter;
+    }
+  }
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    // Check the bounds of the file, which is as much as can be checked
+    // without reading all of it.
+    for (int i = 0; i < 2 && s.ok(); i++) {
+      if (i == 0) {
+        iter->SeekToFirst();
+      } else {
+        iter->SeekToLast();
+      }
+      ParsedInternalKey ikey;
+      if (!iter->Valid()) {
+        s = iter->status();
+        if (s.ok()) {
+          s = Status::InvalidArgument(file->fname, "is empty");
+        }
+      } else if (!ParseInternalKey(iter->key(), &ikey) ||
+                 ikey.sequence != 0 ||
+                 (ikey.type != kTypeValue && ikey.type != kTypeDeletion)) {
+        s = Status::InvalidArgument(file->fname,
+                                    "was not written by SstFileWriter");
+      } else if (i == 0) {
+        file->smallest.DecodeFrom(iter->key());
+      } else {
+        file->largest.DecodeFrom(iter->key());
+      }
+    }
+    delete iter;
+  }
+  delete table;
+  delete raf;
+  return s;
+}
+
+// Have every entry of mem_ and imm_ that overlaps one of "files" written
+// to a table, so that the files may be given a newer sequence number.
+// Also waits for imm_ to be flushed in any case, since the level of its
+// table is picked without the ingested files in view.
+// REQUIRES: this thread is at the front of the writer queue
+Status DBImpl::FlushIfOverlapping(const std::vector<IngestedFile>& files) {
+  mutex_.AssertHeld();
+  bool overlap = false;
+  for (size_t i = 0; i < files.size() && !overlap; i++) {
+    const Slice smallest = files[i].smallest.user_key();
+    const Slice largest = files[i].largest.user_key();
+    overlap =
+        MemTableOverlapsRange(mem_, user_comparator(), smallest, largest) ||
+        (imm_ != nullptr && MemTableOverlapsRange(imm_, user_comparator(),
+                                                  smallest, largest));
+  }
+
+  Status s;
+  if (overlap) {
+    s = MakeRoomForWrite(true);
+  }
+  while (s.ok() && imm_ != nullptr && bg_error_.ok()) {
+    background_work_finished_signal_.Wait();
+  }
+  if (s.ok() && imm_ != nullptr) {
+    s = bg_error_;
+  }
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::vector<std::string>& files) {
+  if (files.empty()) {
+    return Status::InvalidArgument("no files to ingest");
+  }
+  std::vector<IngestedFile> ingested(files.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    ingested[i].fname = files[i];
+    s = ReadExternalFile(&ingested[i]);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  std::sort(ingested.begin(), ingested.end(),
+            [this](const IngestedFile& a, const IngestedFile& b) {
+              return internal_comparator_.Compare(a.smallest, b.smallest) < 0;
+            });
+  for (size_t i = 1; i < ingested.size(); i++) {
+    if (user_comparator()->Compare(ingested[i - 1].largest.user_key(),
+                                   ingested[i].smallest.user_key()) >= 0) {
+      return Status::InvalidArgument(ingested[i - 1].fname,
+                                     "overlaps " + ingested[i].fname);
+    }
+  }
+
+  // Bring the files into the database under temporary names while writes
+  // go on.  They get their table numbers only once their entries are
+  // newer than everything in the database, since level-0 tables are
+  // searched in the order of their numbers.
+  mutex_.Lock();
+  for (IngestedFile& f : ingested) {
+    f.temp_number = versions_->NewFileNumber();
+    f.number = 0;
+    pending_outputs_.insert(f.temp_number);
+  }
+  mutex_.Unlock();
+  size_t copied = 0;
+  for (; copied < ingested.size() && s.ok(); copied++) {
+    const IngestedFile& f = ingested[copied];
+    const std::string temp = TempFileName(dbname_, f.temp_number);
+    s = Status::NotSupported("copy");
+    if (options.move_files) {
+      s = env_->LinkFile(f.fname, temp);
+    }
+    if (!s.ok()) {
+      s = CopyFile(env_, f.fname, temp);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  Writer w(&mutex_);
+  w.unbatched = true;
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  if (s.ok()) {
+    s = bg_error_;
+  }
+  if (s.ok()) {
+    s = FlushIfOverlapping(ingested);
+  }
+  VersionEdit edit;
+  if (s.ok()) {
+    // Without an overlap or a snapshot that must not see the files, their
+    // entries can keep sequence number 0.
+    Version* current = versions_->current();
+    bool overlap = false;
+    for (const IngestedFile& f : ingested) {
+      const Slice smallest = f.smallest.user_key();
+      const Slice largest = f.largest.user_key();
+      for (int level = 0; level < config::kNumLevels && !overlap; level++) {
+        overlap = current->OverlapInLevel(level, &smallest, &largest);
+      }
+    }
+    SequenceNumber global_sequence = 0;
+    if (overlap || !snapshots_.empty()) {
+      global_sequence = versions_->LastSequence() + 1;
+      versions_->SetLastSequence(global_sequence);
+    }
+
+    for (IngestedFile& f : ingested) {
+      f.number = versions_->NewFileNumber();
+      pending_outputs_.insert(f.number);
+      const int level = versions_->PickLevelForIngestedFile(
+          f.smallest.user_key(), f.largest.user_key());
+      // Compactions picked while the mutex is released below must not
+      // write around the file.
+      versions_->ReserveIngestedRange(level, f.smallest, f.largest);
+      edit.AddFile(level, f.number, f.file_size,
+                   WithSequence(f.smallest, global_sequence),
+                   WithSequence(f.largest, global_sequence), false, 0, 0,
+                   global_sequence);
+      Log(options_.info_log, "Ingesting %s as table #%llu at level-%d",
+          f.fname.c_str(), static_cast<unsigned long long>(f.number), level);
+    }
+
+    mutex_.Unlock();
+    for (const IngestedFile& f : ingested) {
+      if (s.ok()) {
+        s = env_->RenameFile(TempFileName(dbname_, f.temp_number),
+                             TableFileName(dbname_, f.number));
+      }
+    }
+    mutex_.Lock();
+  }
+  if (s.ok()) {
+    s = versions_->LogAndApply(&edit, &mutex_);
+  }
+  versions_->ReleaseIngestedRanges();
+
+  for (size_t i = 0; i < ingested.size(); i++) {
+    const IngestedFile& f = ingested[i];
+    if (!s.ok()) {
+      if (i < copied) {
+        env_->RemoveFile(TempFileName(dbname_, f.temp_number));
+      }
+      if (f.number != 0) {
+        env_->RemoveFile(TableFileName(dbname_, f.number));
+      }
+    } else if (options.move_files) {
+      env_->RemoveFile(f.fname);
+    }
+    pending_outputs_.erase(f.temp_number);
+    pending_outputs_.erase(f.number);
+  }
+  // A manual compaction may have been held back by the reserved ranges.
+  MaybeScheduleCompaction();
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+// Hard link the file named "src" as "target", or copy it if that fails.
+static Status LinkOrCopyFile(Env* env, const std::string& src,
+                             const std::string& target) {
+  Status s = env->LinkFile(src, target);
+  if (!s.ok()) {
+    s = CopyFile(env, src, target);
+  }
+  return s;
+}
+
+Status DBImpl::CreateCheckpoint(const std::string& checkpoint_dir) {
+  // The checkpoint is built under a temporary name, so that it appears
+  // whole or not at all.  Whatever is there already is not ours to remove.
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  if (env_->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+  if (env_->FileExists(tmp_dir)) {
+    return Status::InvalidArgument(tmp_dir, "exists");
+  }
+
+  // Write the memtable out, so that the checkpoint needs no log.
+  Status s = TEST_CompactMemTable();
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Keep the files of the current version from being deleted while they
+  // are linked.
+  mutex_.Lock();
+  Version* base = versions_->current();
+  base->Ref();
+  VersionEdit edit;
+  versions_->SaveCurrentVersion(&edit);
+  const uint64_t manifest_number = versions_->NewFileNumber();
+  edit.SetLogNumber(versions_->LogNumber());
+  edit.SetPrevLogNumber(0);
+  edit.SetNextFile(manifest_number + 1);
+  edit.SetLastSequence(versions_->LastSequence());
+  std::vector<uint64_t> tables, value_logs;
+  base->AddFileNumbers(&tables, &value_logs);
+  mutex_.Unlock();
+
+  s = env_->CreateDir(tmp_dir);
+  const bool created_tmp = s.ok();
+  for (size_t i = 0; i < tables.size() && s.ok(); i++) {
+    if (env_->FileExists(TableFileName(dbname_, tables[i]))) {
+      s = LinkOrCopyFile(env_, TableFileName(dbname_, tables[i]),
+                         TableFileName(tmp_dir, tables[i]));
+    } else {
+      s = LinkOrCopyFile(env_, SSTTableFileName(dbname_, tables[i]),
+                         SSTTableFileName(tmp_dir, tables[i]));
+    }
+  }
+  for (size_t i = 0; i < value_logs.size() && s.ok(); i++) {
+    s = LinkOrCopyFile(env_, ValueLogFileName(dbname_, value_logs[i]),
+                       ValueLogFileName(tmp_dir, value_logs[i]));
+  }
+  if (s.ok()) {
+    const std::string manifest = DescriptorFileName(tmp_dir, manifest_number);
+    WritableFile* file;
+    s = env_->NewWritableFile(manifest, &file);
+    if (s.ok()) {
+      log::Writer log(file);
+      std::string record;
+      edit.EncodeTo(&record);
+      s = log.AddRecord(record);
+      if (s.ok()) {
+        s = file->Sync();
+      }
+      if (s.ok()) {
+        s = file->Close();
+      }
+      delete file;
+    }
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env_, tmp_dir, manifest_number);
+  }
+  if (s.ok()) {
+    s = env_->RenameFile(tmp_dir, checkpoint_dir);
+  }
+  if (!s.ok() && created_tmp) {
+    std::vector<std::string> filenames;
+    env_->GetChildren(tmp_dir, &filenames);  // Ignoring errors on purpose
+    for (const std::string& filename : filenames) {
+      env_->RemoveFile(tmp_dir + "/" + filename);
+    }
+    env_->RemoveDir(tmp_dir);
+  }
+
+  mutex_.Lock();
+  base->Unref();
+  mutex_.Unlock();
+  return s;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1456,6 +3035,18 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "statistics") {
+    if (options_.statistics == nullptr) {
+      return false;
+    }
+    *value = options_.statistics->ToString();
+    return true;
+  } else if (in == "statistics-values") {
+    if (options_.statistics == nullptr) {
+      return false;
+    }
+    *value = options_.statistics->ToValues();
+    return true;
   }
 
   return false;
@@ -1493,6 +3084,47 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& operand) {
+  WriteBatch batch;
+  batch.Merge(key, operand);
+  return Write(opt, &batch);
+}
+
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->assign(keys.size(), std::string());
+  statuses->assign(keys.size(), Status());
+  ReadOptions snapshot_options = options;
+  if (options.snapshot == nullptr) {
+    // Keep writes between the lookups from being seen by the later ones
+    snapshot_options.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(snapshot_options, keys[i], &(*values)[i]);
+  }
+  if (options.snapshot == nullptr) {
+    ReleaseSnapshot(snapshot_options.snapshot);
+  }
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions& /*options*/,
+                              const std::vector<std::string>& /*files*/) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+Status DB::CreateCheckpoint(const std::string& /*checkpoint_dir*/) {
+  return Status::NotSupported("CreateCheckpoint");
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1546,6 +3178,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
 
 Snapshot::~Snapshot() = default;
 
+EventListener::~EventListener() = default;
+
 Status DestroyDB(const std::string& dbname, const Options& options) {
   Env* env = options.env;
   std::vector<std::string> filenames;
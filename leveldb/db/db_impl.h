@@ -9,12 +9,14 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "port/port_stdcxx.h"
@@ -22,6 +24,7 @@
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneList;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -40,15 +43,23 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& operand) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::vector<std::string>& files) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -72,9 +83,23 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Read into *value the value that "handle", the value of a
+  // kTypeValueHandle entry, locates in a value log file.
+  Status ReadValue(const ReadOptions& options, const Slice& handle,
+                   std::string* value);
+
+  // Store in *value the value of "user_key" after applying "operands",
+  // its merge operands from oldest to newest, to "existing_value" (null
+  // if the key has no value) with options.merge_operator.
+  // "existing_value" and the operands may point into *value.
+  Status FullMerge(const Slice& user_key, const Slice* existing_value,
+                   const std::vector<Slice>& operands, std::string* value);
+
  private:
   friend class DB;
   struct CompactionState;
+  struct IngestedFile;
+  struct SubcompactionWork;
   struct Writer;
 
   // Information for a manual compaction
@@ -102,9 +127,13 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // If range_tombstones is non-null, also stores in *range_tombstones the
+  // range tombstones of the data read by the iterator, or nullptr if it
+  // has none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneList** range_tombstones);
 
   Status NewDB();
 
@@ -116,6 +145,13 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
+  // Apply "operands", the merge operands found by a lookup of "key",
+  // newest first, to the value found by the lookup, or to no value if
+  // *s is NotFound, and update *value and *s to the result.
+  void ApplyMergeOperands(const Slice& key,
+                          const std::vector<std::string>& operands,
+                          std::string* value, Status* s);
+
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -128,27 +164,91 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write the contents of *mem to a new table, and its large values to a
+  // new value log, and record them in *edit.  The new files' numbers are
+  // appended to *file_numbers and stay in pending_outputs_ until the
+  // caller has applied *edit.  If info is non-null, describes the new
+  // table in *info.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          std::vector<uint64_t>* file_numbers,
+                          FlushJobInfo* info = nullptr)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status ReadExternalFile(IngestedFile* file) LOCKS_EXCLUDED(mutex_);
+  Status FlushIfOverlapping(const std::vector<IngestedFile>& files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Waits for background work to finish while writes are stalled, counting
+  // the time waited in the statistics.
+  void WaitForBackgroundWorkWhileStalled() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Records the write stall condition and, if it changed, tells the
+  // listener with mutex_ released.  Returns true if mutex_ was released,
+  // in which case the caller must check the state it depends on again.
+  bool SetStallCondition(WriteStallCondition condition)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status InsertBatchGroupConcurrently(Writer* last_writer)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status InsertBatchGroup(Writer* last_writer) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
+  // Run one compaction.  Returns false if there was nothing to compact
+  // that could run alongside the compactions in progress.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-
+  static void BGSubcompactionWork(void* arg);
+  // Run "work" unless some thread has started it already.
+  void RunSubcompaction(SubcompactionWork* work)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status ProcessCompactionRange(CompactionState* compact, Iterator* input)
+      LOCKS_EXCLUDED(mutex_);
+  // Add "key" => "value" to the current output of "compact", first
+  // finishing the output if it is big enough, or if *finish_output is
+  // set, and "user_key" (the user key of "key", or nullptr if "key"
+  // cannot be parsed) differs from the last user key of the output.
+  Status AddCompactionEntry(CompactionState* compact, Iterator* input,
+                            const Slice* user_key, const Slice& key,
+                            const Slice& value, bool* finish_output);
+  // Called with "input" at the merge operand "ikey", which every snapshot
+  // sees.  Reads from "input" the older entries for the user key, up to
+  // the first value or deletion, and stores in *entries the internal
+  // keys and values that replace the operands.  Sets *resolved if the
+  // entries also make the value or deletion, and any entry after it,
+  // obsolete.  Leaves "input" at the first entry it did not read.
+  Status MergeCompactionOperands(
+      CompactionState* compact, Iterator* input, const ParsedInternalKey& ikey,
+      std::vector<std::pair<std::string, std::string>>* entries,
+      bool* resolved) LOCKS_EXCLUDED(mutex_);
+  // Pass "ikey" => "value", a value of "compact" that every snapshot
+  // sees, to options_.compaction_filter.  Sets *drop if the entry is to
+  // be dropped, and *replaced, with the entry that replaces it in
+  // *new_key and *new_value, if it is to be replaced.
+  Status FilterCompactionEntry(CompactionState* compact,
+                               const ParsedInternalKey& ikey,
+                               const Slice& value, bool* drop,
+                               bool* replaced, std::string* new_key,
+                               std::string* new_value) LOCKS_EXCLUDED(mutex_);
+
+  Status CollectRangeTombstones(CompactionState* compact)
+      LOCKS_EXCLUDED(mutex_);
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // "next_user_key" is the first user key of the next output, or nullptr
+  // if there is none.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
+  void AddRangeTombstonesToOutput(CompactionState* compact,
+                                  const Slice* next_user_key);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -158,6 +258,11 @@ class DBImpl : public DB {
 
   // Constant after construction
   Env* const env_;
+  // Envs for the files written by flushes and by compactions.  Equal to
+  // env_ unless options_.rate_limiter or
+  // options_.use_direct_io_for_flush_and_compaction is set.
+  Env* const flush_env_;
+  Env* const compaction_env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
   const Options options_;  // options_.comparator == &internal_comparator_
@@ -177,7 +282,6 @@ class DBImpl : public DB {
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
@@ -185,6 +289,13 @@ class DBImpl : public DB {
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // Number of writers at the front of writers_ whose batches have been
+  // logged but not yet inserted into mem_ (pipelined writes only)
+  size_t logged_writers_ GUARDED_BY(mutex_);
+  // Sequence number of the last logged write
+  SequenceNumber last_logged_sequence_ GUARDED_BY(mutex_);
+  // Writers of the current group still inserting into mem_ concurrently
+  int pending_memtable_inserts_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
@@ -193,8 +304,16 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of subcompactions scheduled in the Env::kLow thread pool whose
+  // calls have not returned yet.
+  int background_subcompactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a flush of imm_ been scheduled (in the Env::kHigh thread pool, so
+  // that it need not wait for compactions) or is it running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -204,6 +323,9 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Last write stall condition reported to the listener.
+  WriteStallCondition stall_condition_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -4,14 +4,20 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_timer.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -40,34 +46,69 @@ class DBIter : public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), or, if
+  //     that entry is the result of merge operands, just after the
+  //     operands.
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeTombstoneList* range_tombstones,
+         const SliceTransform* prefix_extractor, const ReadOptions& options)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        range_tombstones_(range_tombstones),
+        prefix_extractor_(prefix_extractor),
+        options_(options),
+        lower_bound_(options.iterate_lower_bound),
+        upper_bound_(options.iterate_upper_bound),
         sequence_(s),
+        value_pinned_(false),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        value_is_handle_(false),
+        value_loaded_(false),
+        has_prefix_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_tombstones_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    Slice raw_value;
+    if (direction_ == kForward) {
+      raw_value = merged_ ? Slice(saved_value_) : iter_->value();
+    } else {
+      raw_value = value_pinned_ ? pinned_value_ : Slice(saved_value_);
+    }
+    if (!value_is_handle_) {
+      return raw_value;
+    }
+    if (!value_loaded_) {
+      // Read the value from its value log the first time it is asked for
+      Status s = db_->ReadValue(options_, raw_value, &loaded_value_);
+      if (!s.ok()) {
+        status_ = s;
+        loaded_value_.clear();
+      }
+      value_loaded_ = true;
+    }
+    return loaded_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -86,13 +127,47 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeForward(const Slice& user_key);
+  bool MergeSavedValue(ValueType base_type);
   bool ParseKey(ParsedInternalKey* key);
 
+  // Return true if "user_key" is outside the prefix of the last Seek().
+  bool OutsidePrefix(const Slice& user_key) const {
+    return has_prefix_ && (!prefix_extractor_->InDomain(user_key) ||
+                           prefix_extractor_->Transform(user_key) != prefix_);
+  }
+
+  // Return true if "user_key" is at or after the upper bound.
+  bool AfterUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // Return true if "user_key" is before the lower bound.
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+
+  // Return the type of "ikey" as seen by this iterator: values and merge
+  // operands hidden by a range tombstone read as deletions.
+  ValueType EffectiveType(const ParsedInternalKey& ikey) const {
+    if ((ikey.type == kTypeValue || ikey.type == kTypeValueHandle ||
+         ikey.type == kTypeMerge) &&
+        range_tombstones_ != nullptr &&
+        range_tombstones_->ShouldDelete(ikey.user_key, ikey.sequence,
+                                        sequence_)) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
 
   inline void ClearSavedValue() {
+    value_pinned_ = false;
     if (saved_value_.capacity() > 1048576) {
       std::string empty;
       swap(empty, saved_value_);
@@ -101,6 +176,23 @@ class DBIter : public Iterator {
     }
   }
 
+  // Copy pinned_value_ into saved_value_, before iter_ moves too far for
+  // it to stay valid.
+  inline void UnpinValue() {
+    if (saved_value_.capacity() > pinned_value_.size() + 1048576) {
+      std::string empty;
+      swap(empty, saved_value_);
+    }
+    saved_value_.assign(pinned_value_.data(), pinned_value_.size());
+    value_pinned_ = false;
+  }
+
+  // Record that the iterator moved to an entry of type "type".
+  inline void SetValueType(ValueType type) {
+    value_is_handle_ = (type == kTypeValueHandle);
+    value_loaded_ = false;
+  }
+
   // Picks the number of bytes that can be read until a compaction is scheduled.
   size_t RandomCompactionPeriod() {
     return rnd_.Uniform(2 * config::kReadBytesPeriod);
@@ -109,12 +201,30 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  RangeTombstoneList* const range_tombstones_;  // May be nullptr
+  const SliceTransform* const prefix_extractor_;  // May be nullptr
+  const ReadOptions options_;
+  const Slice* const lower_bound_;                // May be nullptr
+  const Slice* const upper_bound_;                // May be nullptr
   SequenceNumber const sequence_;
-  Status status_;
+  mutable Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
+  // Moving backwards, the current raw value if value_pinned_, still held by
+  // iter_, which has moved at most once since it was read.  The internal
+  // iterators keep their values valid that long.
+  Slice pinned_value_;
+  bool value_pinned_;
+  // Merge operands for saved_key_, in the order they were read
+  std::vector<std::string> merge_operands_;
   Direction direction_;
   bool valid_;
+  bool merged_;  // Moving forward, saved_key_ and saved_value_ are current
+  bool value_is_handle_;              // The current raw value is a ValueHandle
+  mutable bool value_loaded_;         // loaded_value_ holds the current value
+  mutable std::string loaded_value_;  // Value read from a value log
+  bool has_prefix_;     // Whether iteration is limited to prefix_
+  std::string prefix_;  // Prefix of the last Seek() target
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -143,6 +253,7 @@ void DBIter::Next() {
 
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
+    value_pinned_ = false;
     // iter_ is pointing just before the entries for this->key(),
     // so advance into the range of entries for this->key() and then
     // use the normal skipping code below.
@@ -157,6 +268,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is already past the merge operands of saved_key_, which the
+    // code below skips the older entries of.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -178,26 +297,48 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  merged_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      if (OutsidePrefix(ikey.user_key) || AfterUpperBound(ikey.user_key)) {
+        // Entries are sorted, so no later one is in range either
+        break;
+      }
+      switch (EffectiveType(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
           skipping = true;
+          PerfCount(&PerfContext::internal_delete_skipped_count);
           break;
         case kTypeValue:
+        case kTypeValueHandle:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+            PerfCount(&PerfContext::internal_key_skipped_count);
           } else {
             valid_ = true;
             saved_key_.clear();
+            SetValueType(ikey.type);
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+            PerfCount(&PerfContext::internal_key_skipped_count);
+          } else {
+            MergeForward(ikey.user_key);
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not part of the internal iterator
+          break;
       }
     }
     iter_->Next();
@@ -206,26 +347,106 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Combine the merge operand at iter_ with the older entries for its user
+// key into saved_key_ and saved_value_, leaving iter_ past the operands.
+void DBIter::MergeForward(const Slice& user_key) {
+  SaveKey(user_key, &saved_key_);
+  merge_operands_.clear();
+  merge_operands_.push_back(iter_->value().ToString());
+  ValueType base_type = kTypeDeletion;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) || ikey.sequence > sequence_) {
+      continue;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    base_type = EffectiveType(ikey);
+    if (base_type != kTypeMerge) {
+      if (base_type != kTypeDeletion) {
+        Slice raw_value = iter_->value();
+        saved_value_.assign(raw_value.data(), raw_value.size());
+      }
+      break;
+    }
+    merge_operands_.push_back(iter_->value().ToString());
+  }
+  if (base_type == kTypeMerge) {
+    base_type = kTypeDeletion;  // The operands apply to no value
+  }
+  // The operands were read newest first
+  std::reverse(merge_operands_.begin(), merge_operands_.end());
+  valid_ = MergeSavedValue(base_type);
+  merged_ = valid_;
+  if (!valid_) {
+    saved_key_.clear();
+  }
+}
+
+// Replace saved_value_, the raw value of an entry of type "base_type" for
+// saved_key_ (none if kTypeDeletion), with the result of applying
+// merge_operands_, oldest first, to it.  Returns false on error.
+bool DBIter::MergeSavedValue(ValueType base_type) {
+  if (value_pinned_) {
+    UnpinValue();
+  }
+  Status s;
+  if (base_type == kTypeValueHandle) {
+    s = db_->ReadValue(options_, saved_value_, &saved_value_);
+  }
+  if (s.ok()) {
+    const Slice existing_value(saved_value_);
+    std::vector<Slice> operands(merge_operands_.begin(),
+                                merge_operands_.end());
+    s = db_->FullMerge(saved_key_,
+                       base_type == kTypeDeletion ? nullptr : &existing_value,
+                       operands, &saved_value_);
+  }
+  if (!s.ok()) {
+    status_ = s;
+    ClearSavedValue();
+    return false;
+  }
+  SetValueType(kTypeValue);
+  return true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
+  if (has_prefix_) {
+    // The prefix filters may have dropped the entries before the target
+    valid_ = false;
+    saved_key_.clear();
+    status_ = Status::NotSupported("Prev() after a prefix Seek()");
+    return;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-    while (true) {
-      iter_->Prev();
+    // iter_ is pointing at the current entry, or just after the merge
+    // operands it results from.  Scan backwards until the key changes so
+    // we can use the normal reverse scanning code.
+    if (merged_) {
+      // saved_key_ already contains the current key
+      merged_ = false;
       if (!iter_->Valid()) {
-        valid_ = false;
-        saved_key_.clear();
-        ClearSavedValue();
-        return;
-      }
-      if (user_comparator_->Compare(ExtractUserKey(iter_->key()), saved_key_) <
-          0) {
-        break;
+        iter_->SeekToLast();
       }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
+    while (iter_->Valid() &&
+           user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                     saved_key_) >= 0) {
+      iter_->Prev();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
     }
     direction_ = kReverse;
   }
@@ -236,34 +457,59 @@ void DBIter::Prev() {
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
-  ValueType value_type = kTypeDeletion;
+  ValueType value_type = kTypeDeletion;  // Of the newest entry seen
+  ValueType base_type = kTypeDeletion;   // Of the newest non-merge one
   if (iter_->Valid()) {
     do {
+      bool pinned_now = false;
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+        if (BeforeLowerBound(ikey.user_key)) {
+          // No earlier entry is in range either
+          break;
+        }
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
+        const ValueType type = EffectiveType(ikey);
+        if (type == kTypeMerge) {
+          if (value_type == kTypeDeletion) {
+            // The first operand of a key without a value
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            ClearSavedValue();
+            merge_operands_.clear();
+            base_type = kTypeDeletion;
+          }
+          merge_operands_.push_back(iter_->value().ToString());
+        } else if (type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          merge_operands_.clear();
+          base_type = kTypeDeletion;
         } else {
-          Slice raw_value = iter_->value();
-          if (saved_value_.capacity() > raw_value.size() + 1048576) {
-            std::string empty;
-            swap(empty, saved_value_);
-          }
+          merge_operands_.clear();
+          base_type = type;
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-          saved_value_.assign(raw_value.data(), raw_value.size());
+          // Refer to the value instead of copying it, since it is likely
+          // to be the one yielded.
+          pinned_value_ = iter_->value();
+          value_pinned_ = true;
+          pinned_now = true;
         }
+        value_type = type;
+      }
+      if (value_pinned_ && !pinned_now) {
+        UnpinValue();  // iter_ is about to move a second time
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge && !MergeSavedValue(base_type)) {
+    value_type = kTypeDeletion;
+  }
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -272,16 +518,32 @@ void DBIter::FindPrevUserEntry() {
     direction_ = kForward;
   } else {
     valid_ = true;
+    if (value_type != kTypeMerge) {
+      SetValueType(value_type);
+    }
   }
 }
 
 void DBIter::Seek(const Slice& target) {
+  if (BeforeLowerBound(target)) {
+    Seek(*lower_bound_);
+    return;
+  }
   direction_ = kForward;
   ClearSavedValue();
+  has_prefix_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  {
+    PerfTimer seek_timer(&PerfContext::seek_internal_nanos);
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -292,7 +554,18 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  has_prefix_ = false;
+  {
+    PerfTimer seek_timer(&PerfContext::seek_internal_nanos);
+    if (lower_bound_ != nullptr) {
+      saved_key_.clear();
+      AppendInternalKey(&saved_key_, ParsedInternalKey(*lower_bound_, sequence_,
+                                                       kValueTypeForSeek));
+      iter_->Seek(saved_key_);
+    } else {
+      iter_->SeekToFirst();
+    }
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -302,8 +575,27 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  has_prefix_ = false;
+  {
+    PerfTimer seek_timer(&PerfContext::seek_internal_nanos);
+    if (upper_bound_ != nullptr) {
+      // Position iter_ at the last entry before the upper bound
+      saved_key_.clear();
+      AppendInternalKey(&saved_key_,
+                        ParsedInternalKey(*upper_bound_, kMaxSequenceNumber,
+                                          kValueTypeForSeek));
+      iter_->Seek(saved_key_);
+      if (iter_->Valid()) {
+        iter_->Prev();
+      } else {
+        iter_->SeekToLast();
+      }
+    } else {
+      iter_->SeekToLast();
+    }
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +603,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, RangeTombstoneList* range_tombstones,
+                        const SliceTransform* prefix_extractor,
+                        const ReadOptions& options) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    range_tombstones, prefix_extractor, options);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,27 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeTombstoneList;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Values covered by "*range_tombstones", if
+// non-null, are hidden.  The iterator takes ownership of "internal_iter"
+// and "range_tombstones".
+//
+// If "prefix_extractor" is non-null, Seek() only yields the keys that
+// have the same prefix as its target (see
+// ReadOptions::prefix_same_as_start).
+//
+// "options" are the options the iterator was created with.  Values kept
+// in value logs are read with them, and options.iterate_lower_bound and
+// iterate_upper_bound limit the user keys that are yielded.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, RangeTombstoneList* range_tombstones,
+                        const SliceTransform* prefix_extractor,
+                        const ReadOptions& options);
 
 }  // namespace leveldb
 
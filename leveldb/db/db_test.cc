@@ -6,6 +6,7 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <map>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -14,11 +15,19 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/sst_file_writer.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -138,8 +147,15 @@ class SpecialEnv : public EnvWrapper {
   // Force log file close to fail while this bool is true.
   std::atomic<bool> log_file_close_;
 
+  // Renames to sstable names are blocked while this is true.
+  std::atomic<bool> delay_table_rename_;
+
+  // Set once a rename has been blocked by delay_table_rename_.
+  std::atomic<bool> table_rename_delayed_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
+  AtomicCounter multi_read_counter_;  // Batches, counted once per call
 
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
@@ -150,8 +166,20 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
+        delay_table_rename_(false),
+        table_rename_delayed_(false),
         count_random_reads_(false) {}
 
+  Status RenameFile(const std::string& src, const std::string& dst) {
+    if (IsLdbFile(dst)) {
+      while (delay_table_rename_.load(std::memory_order_acquire)) {
+        table_rename_delayed_.store(true, std::memory_order_release);
+        DelayMilliseconds(10);
+      }
+    }
+    return target()->RenameFile(src, dst);
+  }
+
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
      private:
@@ -237,21 +265,32 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      AtomicCounter* multi_read_counter_;
 
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {}
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter,
+                   AtomicCounter* multi_read_counter)
+          : target_(target),
+            counter_(counter),
+            multi_read_counter_(multi_read_counter) {}
       ~CountingFile() override { delete target_; }
       Status Read(uint64_t offset, size_t n, Slice* result,
                   char* scratch) const override {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      void MultiRead(ReadRequest* requests, int n) const override {
+        multi_read_counter_->Increment();
+        for (int i = 0; i < n; i++) {
+          counter_->Increment();
+        }
+        target_->MultiRead(requests, n);
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, &multi_read_counter_);
     }
     return s;
   }
@@ -303,9 +342,27 @@ class DBTest : public testing::Test {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kPartitionedFilter:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 256;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kValueLog:
+        options.value_log_threshold = 10;
+        break;
+      case kConcurrentMemtableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kPipelinedConcurrentWrite:
+        options.enable_pipelined_write = true;
+        options.allow_concurrent_memtable_write = true;
+        break;
       default:
         break;
     }
@@ -351,6 +408,10 @@ class DBTest : public testing::Test {
 
   Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
 
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -364,6 +425,42 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Look up "keys" (separated by spaces) with a single MultiGet() call and
+  // return the results formatted like Get(), separated by spaces.
+  std::string MultiGet(const std::string& keys,
+                       const Snapshot* snapshot = nullptr) {
+    std::vector<std::string> key_strings;
+    size_t start = 0;
+    while (start <= keys.size()) {
+      size_t end = keys.find(' ', start);
+      if (end == std::string::npos) end = keys.size();
+      key_strings.push_back(keys.substr(start, end - start));
+      start = end + 1;
+    }
+    std::vector<Slice> key_slices(key_strings.begin(), key_strings.end());
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    EXPECT_EQ(key_slices.size(), values.size());
+    EXPECT_EQ(key_slices.size(), statuses.size());
+
+    std::string result;
+    for (size_t i = 0; i < statuses.size(); i++) {
+      if (i > 0) result.push_back(' ');
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -417,9 +514,21 @@ class DBTest : public testing::Test {
             case kTypeValue:
               result += iter->value().ToString();
               break;
+            case kTypeValueHandle: {
+              std::string value;
+              Status s = dbfull()->ReadValue(ReadOptions(), iter->value(), &value);
+              result += s.ok() ? value : s.ToString();
+              break;
+            }
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeRangeDeletion:
+              result += "DELRANGE(" + iter->value().ToString() + ")";
+              break;
           }
         }
         iter->Next();
@@ -448,6 +557,18 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Return the number of sorted runs: every level-0 file, and every other
+  // non-empty level.
+  int NumSortedRuns() {
+    int result = NumTableFilesAtLevel(0);
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (NumTableFilesAtLevel(level) > 0) {
+        result++;
+      }
+    }
+    return result;
+  }
+
   // Return spread of files per level
   std::string FilesPerLevel() {
     std::string result;
@@ -471,6 +592,23 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  // Return the combined size of the value log files.
+  uint64_t ValueLogBytes() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    uint64_t result = 0;
+    uint64_t number;
+    FileType type;
+    for (const std::string& file : files) {
+      uint64_t file_size;
+      if (ParseFileName(file, &number, &type) && type == kValueLogFile &&
+          env_->GetFileSize(dbname_ + "/" + file, &file_size).ok()) {
+        result += file_size;
+      }
+    }
+    return result;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -562,7 +700,18 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kPartitionedFilter,
+    kUncompressed,
+    kValueLog,
+    kConcurrentMemtableWrite,
+    kPipelinedWrite,
+    kPipelinedConcurrentWrite,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -803,6 +952,45 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    ASSERT_EQ("NOT_FOUND NOT_FOUND", MultiGet("foo bar"));
+
+    // Spread the keys over several levels, level-0 files, the immutable
+    // memtable and the memtable.
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("e", "ve1"));
+    ASSERT_LEVELDB_OK(Put("g", "vg1"));
+    Compact("a", "z");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("g", "vg2"));
+    ASSERT_LEVELDB_OK(Put("b", "vb1"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_LEVELDB_OK(Delete("b"));
+
+    ASSERT_EQ("va2 NOT_FOUND vc2 NOT_FOUND NOT_FOUND NOT_FOUND vg2 NOT_FOUND",
+              MultiGet("a b c d e f g h"));
+    ASSERT_EQ("vg2 va2 vg2 vc2", MultiGet("g a g c"));
+    ASSERT_EQ("va1 vb1 vc2 NOT_FOUND vg2", MultiGet("a b c e g", snapshot));
+
+    // Results must agree with Get() for every key.
+    const char* keys[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+    std::string expected;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+      if (i > 0) expected.push_back(' ');
+      expected += Get(keys[i]);
+    }
+    ASSERT_EQ(expected, MultiGet("a b c d e f g h"));
+
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -1079,6 +1267,72 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST_F(DBTest, MultiGetManyFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 200; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  Compact(Key(0), Key(199));
+  for (int i = 0; i < 200; i += 3) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  std::string keys;
+  std::string expected;
+  for (int i = 199; i >= 0; i -= 2) {
+    if (!keys.empty()) {
+      keys.push_back(' ');
+      expected.push_back(' ');
+    }
+    keys += Key(i);
+    expected += values[i];
+  }
+  ASSERT_EQ(expected, MultiGet(keys));
+}
+
+TEST_F(DBTest, MultiGetBatchesBlockReads) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 100; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  Compact(Key(0), Key(99));
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // Keys 10 apart lie in different data blocks, which are all read with a
+  // single batch.
+  std::string keys;
+  std::string expected;
+  for (int i = 0; i < 100; i += 10) {
+    if (!keys.empty()) {
+      keys.push_back(' ');
+      expected.push_back(' ');
+    }
+    keys += Key(i);
+    expected += values[i];
+  }
+  env_->random_read_counter_.Reset();
+  env_->multi_read_counter_.Reset();
+  ASSERT_EQ(expected, MultiGet(keys));
+  ASSERT_EQ(1, env_->multi_read_counter_.Read());
+  ASSERT_EQ(10, env_->random_read_counter_.Read());
+}
+
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1154,6 +1408,83 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 300; i++) {
+    values.push_back(RandomString(&rnd, 10000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  for (int i = 0; i < 300; i += 7) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+    values[i] = "NOT_FOUND";
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 1; i < 300; i += 5) {
+    values[i] = RandomString(&rnd, 10000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  // Once the snapshot is gone, overwritten values and deletion markers
+  // can be dropped by every subcompaction.
+  db_->ReleaseSnapshot(snapshot);
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 1);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+    if (values[i] == "NOT_FOUND") {
+      ASSERT_EQ("[ ]", AllEntriesFor(Key(i)));
+    }
+  }
+}
+
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  env_->SetBackgroundThreads(4, Env::kLow);
+  Reopen(&options);
+
+  // Overwrite keys in separate ranges so that compactions of different
+  // ranges, and of different levels, can be picked at the same time.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 4000; i++) {
+    const std::string key = Key((i % 4) * 1000 + rnd.Uniform(1000));
+    const std::string value = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(key, value));
+    model[key] = value;
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (const auto& kv : model) {
+    ASSERT_EQ(kv.second, Get(kv.first));
+  }
+
+  // Files written by concurrent compactions must still form a valid
+  // version after recovery.
+  Reopen(&options);
+  for (const auto& kv : model) {
+    ASSERT_EQ(kv.second, Get(kv.first));
+  }
+  Close();
+  env_->SetBackgroundThreads(1, Env::kLow);
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1228,6 +1559,7 @@ TEST_F(DBTest, ApproximateSizes) {
     Options options = CurrentOptions();
     options.write_buffer_size = 100000000;  // Large write buffer
     options.compression = kNoCompression;
+    options.value_log_threshold = 0;  // Sizes of inline values are exact
     DestroyAndReopen();
 
     ASSERT_TRUE(Between(Size("", "xyz"), 0, 0));
@@ -1286,6 +1618,7 @@ TEST_F(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   do {
     Options options = CurrentOptions();
     options.compression = kNoCompression;
+    options.value_log_threshold = 0;  // Sizes of inline values are exact
     Reopen();
 
     Random rnd(301);
@@ -1348,6 +1681,47 @@ TEST_F(DBTest, IteratorPinsRef) {
   delete iter;
 }
 
+TEST_F(DBTest, IterReverseAcrossBlocks) {
+  Options options = CurrentOptions();
+  options.block_size = 256;
+  Reopen(&options);
+
+  // Overwrite some keys, in the memtable and in a newer table, and keep
+  // a snapshot of the older values.
+  const int kNumKeys = 500;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "old" + std::string(i % 50, 'x')));
+  }
+  Compact("a", "z");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < kNumKeys; i += 3) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "new" + std::string(i % 70, 'y')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < kNumKeys; i += 7) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "newest"));
+  }
+
+  for (const Snapshot* s : {static_cast<const Snapshot*>(nullptr), snapshot}) {
+    ReadOptions read_options;
+    read_options.snapshot = s;
+    Iterator* iter = db_->NewIterator(read_options);
+    std::vector<std::string> forward, backward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.push_back(IterStatus(iter));
+    }
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      backward.push_back(IterStatus(iter));
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(kNumKeys, forward.size());
+    ASSERT_EQ(forward, std::vector<std::string>(backward.rbegin(),
+                                                backward.rend()));
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
 TEST_F(DBTest, Snapshot) {
   do {
     Put("foo", "v1");
@@ -1463,110 +1837,447 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
-TEST_F(DBTest, OverlapInLevel0) {
+TEST_F(DBTest, DeleteRange) {
   do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
-
-    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
-    // 0.
-    ASSERT_LEVELDB_OK(Put("100", "v100"));
-    ASSERT_LEVELDB_OK(Put("999", "v999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_LEVELDB_OK(Delete("100"));
-    ASSERT_LEVELDB_OK(Delete("999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("0,1,1", FilesPerLevel());
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(DeleteRange("b", "d"));
+    ASSERT_LEVELDB_OK(DeleteRange("d", "a"));  // Empty range: no-op
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("va NOT_FOUND NOT_FOUND vd", MultiGet("a b c d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
 
-    // Make files spanning the following ranges in level-0:
-    //  files[0]  200 .. 900
-    //  files[1]  300 .. 500
-    // Note that files are sorted by smallest key.
-    ASSERT_LEVELDB_OK(Put("300", "v300"));
-    ASSERT_LEVELDB_OK(Put("500", "v500"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_LEVELDB_OK(Put("200", "v200"));
-    ASSERT_LEVELDB_OK(Put("600", "v600"));
-    ASSERT_LEVELDB_OK(Put("900", "v900"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("2,1,1", FilesPerLevel());
+    // Newer writes are not hidden
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
 
-    // Compact away the placeholder files we created initially
-    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
-    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
-    ASSERT_EQ("2", FilesPerLevel());
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
 
-    // Do a memtable compaction.  Before bug-fix, the compaction would
-    // not detect the overlap with level-0 files and would incorrectly place
-    // the deletion in a deeper level.
-    ASSERT_LEVELDB_OK(Delete("600"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("3", FilesPerLevel());
-    ASSERT_EQ("NOT_FOUND", Get("600"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
   } while (ChangeOptions());
 }
 
-TEST_F(DBTest, L0_CompactionBug_Issue44_a) {
-  Reopen();
-  ASSERT_LEVELDB_OK(Put("b", "v"));
-  Reopen();
-  ASSERT_LEVELDB_OK(Delete("b"));
-  ASSERT_LEVELDB_OK(Delete("a"));
-  Reopen();
-  ASSERT_LEVELDB_OK(Delete("a"));
-  Reopen();
-  ASSERT_LEVELDB_OK(Put("a", "v"));
-  Reopen();
-  Reopen();
-  ASSERT_EQ("(a->v)", Contents());
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  ASSERT_EQ("(a->v)", Contents());
-}
+TEST_F(DBTest, DeleteRangeSnapshot) {
+  do {
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(DeleteRange("a", "z"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vb", Get("b", snapshot));
 
-TEST_F(DBTest, L0_CompactionBug_Issue44_b) {
-  Reopen();
-  Put("", "");
-  Reopen();
-  Delete("e");
-  Put("", "");
-  Reopen();
-  Put("c", "cv");
-  Reopen();
-  Put("", "");
-  Reopen();
-  Put("", "");
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  Reopen();
-  Put("d", "dv");
-  Reopen();
-  Put("", "");
-  Reopen();
-  Delete("d");
-  Delete("b");
-  Reopen();
-  ASSERT_EQ("(->)(c->cv)", Contents());
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  ASSERT_EQ("(->)(c->cv)", Contents());
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vc", Get("c", snapshot));
+    ASSERT_EQ("[ vc ]", AllEntriesFor("c"));
+
+    db_->ReleaseSnapshot(snapshot);
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("[ ]", AllEntriesFor("c"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("", Contents());
+  } while (ChangeOptions());
 }
 
-TEST_F(DBTest, Fflush_Issue474) {
-  static const int kNum = 100000;
-  Random rnd(test::RandomSeed());
-  for (int i = 0; i < kNum; i++) {
-    std::fflush(nullptr);
-    ASSERT_LEVELDB_OK(Put(RandomKey(&rnd), RandomString(&rnd, 100)));
+TEST_F(DBTest, DeleteRangeManyInMemtable) {
+  // Enough tombstones that the memtable looks them up in its fragmented
+  // list as well as in the ones not yet added to it.
+  const int kNumKeys = 100;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v" + Key(i)));
   }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_LEVELDB_OK(DeleteRange(Key(i), Key(i + 1)));
+  }
+  ASSERT_LEVELDB_OK(DeleteRange(Key(10), Key(20)));
+  for (int i = 0; i < kNumKeys; i++) {
+    const bool deleted = (i % 2 == 0) || (i >= 10 && i < 20);
+    ASSERT_EQ(deleted ? "NOT_FOUND" : "v" + Key(i), Get(Key(i))) << i;
+    ASSERT_EQ("v" + Key(i), Get(Key(i), snapshot)) << i;
+  }
+  db_->ReleaseSnapshot(snapshot);
 }
 
-TEST_F(DBTest, ComparatorCheck) {
-  class NewComparator : public Comparator {
-   public:
-    const char* Name() const override { return "leveldb.NewComparator"; }
-    int Compare(const Slice& a, const Slice& b) const override {
-      return BytewiseComparator()->Compare(a, b);
-    }
-    void FindShortestSeparator(std::string* s, const Slice& l) const override {
-      BytewiseComparator()->FindShortestSeparator(s, l);
-    }
+TEST_F(DBTest, DeleteRangeAcrossLevels) {
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("e", "ve"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+
+  // The tombstone extends the range of its file beyond its point keys,
+  // so the file lands above the one it overlaps.
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(DeleteRange("b", "f"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  ASSERT_EQ("(a->va)", Contents());
+  ASSERT_EQ("[ vb ]", AllEntriesFor("b"));
+
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("e"));
+  ASSERT_EQ("(a->va)", Contents());
+
+  Reopen();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+}
+
+namespace {
+
+// Appends the operands to the value, separated by commas.  Fails on the
+// operand "bad".
+class AppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "test.AppendOperator"; }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands, std::string* new_value,
+                 Logger* /*logger*/) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (operand == "bad") {
+        return false;
+      }
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+
+  bool PartialMerge(const Slice& /*key*/, const Slice& left_operand,
+                    const Slice& right_operand, std::string* new_value,
+                    Logger* /*logger*/) const override {
+    *new_value = left_operand.ToString() + "," + right_operand.ToString();
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, Merge) {
+  AppendOperator merge_operator;
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &merge_operator;
+    DestroyAndReopen(&options);
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "1"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "2"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "1"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "c", "1"));
+    ASSERT_LEVELDB_OK(Delete("c"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "c", "2"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "d", "1"));
+    ASSERT_LEVELDB_OK(DeleteRange("d", "e"));
+    ASSERT_EQ("1,2", Get("a"));
+    ASSERT_EQ("vb,1", Get("b"));
+    ASSERT_EQ("2", Get("c"));
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+    ASSERT_EQ("1,2 vb,1 2 NOT_FOUND", MultiGet("a b c d"));
+    ASSERT_EQ("(a->1,2)(b->vb,1)(c->2)", Contents());
+
+    // Operands in the memtable apply to the values in the tables
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "3"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "2"));
+    ASSERT_EQ("1,2,3", Get("a"));
+    ASSERT_EQ("1,2", Get("a", snapshot));
+    ASSERT_EQ("vb,1,2", Get("b"));
+    ASSERT_EQ("vb,1", Get("b", snapshot));
+    ASSERT_EQ("(a->1,2,3)(b->vb,1,2)(c->2)", Contents());
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen(&options);
+    ASSERT_EQ("1,2,3", Get("a"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("[ 1,2,3 ]", AllEntriesFor("a"));
+    ASSERT_EQ("[ vb,1,2 ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ 2 ]", AllEntriesFor("c"));
+    ASSERT_EQ("[ ]", AllEntriesFor("d"));
+    ASSERT_EQ("(a->1,2,3)(b->vb,1,2)(c->2)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MergeAcrossLevels) {
+  const int last = config::kMaxMemCompactLevel;
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+  ASSERT_EQ("[ MERGE(2), MERGE(1), va ]", AllEntriesFor("a"));
+  ASSERT_EQ("va,1,2", Get("a"));
+
+  // The value is in a deeper level, so the operands are only combined
+  // with each other.
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(1,2), va ]", AllEntriesFor("a"));
+  ASSERT_EQ("va,1,2", Get("a"));
+  ASSERT_EQ("(a->va,1,2)(z->vz)", Contents());
+
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ("[ va,1,2 ]", AllEntriesFor("a"));
+  ASSERT_EQ("va,1,2", Get("a"));
+}
+
+TEST_F(DBTest, MergeErrors) {
+  // Merges need an operator to be written, and to be read.
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "a", "1").IsNotSupportedError());
+  WriteBatch batch;
+  batch.Merge("a", "1");
+  ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsNotSupportedError());
+
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "bad"));
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsCorruption());
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+}
+
+namespace {
+
+// Removes the values "drop" and upper-cases the values "change".
+class TestCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "test.TestCompactionFilter"; }
+
+  bool Filter(int /*level*/, bool /*is_bottommost*/, const Slice& /*key*/,
+              const Slice& existing_value, std::string* new_value,
+              bool* value_changed) const override {
+    if (existing_value == "drop") {
+      return true;
+    }
+    if (existing_value == "change") {
+      *new_value = "CHANGE";
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  const int last = config::kMaxMemCompactLevel;
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "keep"));
+  ASSERT_LEVELDB_OK(Put("b", "drop"));
+  ASSERT_LEVELDB_OK(Put("c", "change"));
+  ASSERT_LEVELDB_OK(Put("e", "old"));
+  ASSERT_LEVELDB_OK(Put("z", "keep"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ("drop", Get("b"));  // Flushes do not filter
+
+  // An entry removed above a deeper one for its key becomes a deletion.
+  ASSERT_LEVELDB_OK(Put("e", "drop"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("e", "drop"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("[ DEL, old ]", AllEntriesFor("e"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+
+  // Entries newer than a snapshot are kept.
+  ASSERT_LEVELDB_OK(Put("f", "drop"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("g", "drop"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->keep)(c->CHANGE)(g->drop)(z->keep)", Contents());
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("e"));
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->keep)(c->CHANGE)(z->keep)", Contents());
+
+  // Entries in the last level reach the filter as well.
+  options.compaction_filter = nullptr;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("d", "drop"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 0; level + 1 < config::kNumLevels; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+  options.compaction_filter = &filter;
+  Reopen(&options);
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ("(a->keep)(c->CHANGE)(z->keep)", Contents());
+}
+
+TEST_F(DBTest, TTLCompactionFilter) {
+  const CompactionFilter* filter = NewTTLCompactionFilter(100);
+  Options options = CurrentOptions();
+  options.compaction_filter = filter;
+  Reopen(&options);
+  const uint64_t now = env_->NowMicros() / 1000000;
+  std::string fresh = "fresh";
+  PutFixed64(&fresh, now - 10);
+  std::string expired = "expired";
+  PutFixed64(&expired, now - 1000);
+  ASSERT_LEVELDB_OK(Put("a", fresh));
+  ASSERT_LEVELDB_OK(Put("b", expired));
+  ASSERT_LEVELDB_OK(Put("c", "short"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(expired, Get("b"));
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(fresh, Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("short", Get("c"));
+  Close();
+  delete filter;
+}
+
+TEST_F(DBTest, OverlapInLevel0) {
+  do {
+    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+
+    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
+    // 0.
+    ASSERT_LEVELDB_OK(Put("100", "v100"));
+    ASSERT_LEVELDB_OK(Put("999", "v999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Delete("100"));
+    ASSERT_LEVELDB_OK(Delete("999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    // Make files spanning the following ranges in level-0:
+    //  files[0]  200 .. 900
+    //  files[1]  300 .. 500
+    // Note that files are sorted by smallest key.
+    ASSERT_LEVELDB_OK(Put("300", "v300"));
+    ASSERT_LEVELDB_OK(Put("500", "v500"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("200", "v200"));
+    ASSERT_LEVELDB_OK(Put("600", "v600"));
+    ASSERT_LEVELDB_OK(Put("900", "v900"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("2,1,1", FilesPerLevel());
+
+    // Compact away the placeholder files we created initially
+    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+    ASSERT_EQ("2", FilesPerLevel());
+
+    // Do a memtable compaction.  Before bug-fix, the compaction would
+    // not detect the overlap with level-0 files and would incorrectly place
+    // the deletion in a deeper level.
+    ASSERT_LEVELDB_OK(Delete("600"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("3", FilesPerLevel());
+    ASSERT_EQ("NOT_FOUND", Get("600"));
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, L0_CompactionBug_Issue44_a) {
+  Reopen();
+  ASSERT_LEVELDB_OK(Put("b", "v"));
+  Reopen();
+  ASSERT_LEVELDB_OK(Delete("b"));
+  ASSERT_LEVELDB_OK(Delete("a"));
+  Reopen();
+  ASSERT_LEVELDB_OK(Delete("a"));
+  Reopen();
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  Reopen();
+  Reopen();
+  ASSERT_EQ("(a->v)", Contents());
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  ASSERT_EQ("(a->v)", Contents());
+}
+
+TEST_F(DBTest, L0_CompactionBug_Issue44_b) {
+  Reopen();
+  Put("", "");
+  Reopen();
+  Delete("e");
+  Put("", "");
+  Reopen();
+  Put("c", "cv");
+  Reopen();
+  Put("", "");
+  Reopen();
+  Put("", "");
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  Reopen();
+  Put("d", "dv");
+  Reopen();
+  Put("", "");
+  Reopen();
+  Delete("d");
+  Delete("b");
+  Reopen();
+  ASSERT_EQ("(->)(c->cv)", Contents());
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  ASSERT_EQ("(->)(c->cv)", Contents());
+}
+
+TEST_F(DBTest, Fflush_Issue474) {
+  static const int kNum = 100000;
+  Random rnd(test::RandomSeed());
+  for (int i = 0; i < kNum; i++) {
+    std::fflush(nullptr);
+    ASSERT_LEVELDB_OK(Put(RandomKey(&rnd), RandomString(&rnd, 100)));
+  }
+}
+
+TEST_F(DBTest, ComparatorCheck) {
+  class NewComparator : public Comparator {
+   public:
+    const char* Name() const override { return "leveldb.NewComparator"; }
+    int Compare(const Slice& a, const Slice& b) const override {
+      return BytewiseComparator()->Compare(a, b);
+    }
+    void FindShortestSeparator(std::string* s, const Slice& l) const override {
+      BytewiseComparator()->FindShortestSeparator(s, l);
+    }
     void FindShortSuccessor(std::string* key) const override {
       BytewiseComparator()->FindShortSuccessor(key);
     }
@@ -1971,42 +2682,1162 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
-TEST_F(DBTest, LogCloseError) {
-  // Regression test for bug where we could ignore log file
-  // Close() error when switching to a new log file.
-  const int kValueSize = 20000;
-  const int kWriteCount = 10;
-  const int kWriteBufferSize = (kValueSize * kWriteCount) / 2;
-
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
   Options options = CurrentOptions();
   options.env = env_;
-  options.write_buffer_size = kWriteBufferSize;  // Small write buffer
+  options.block_cache = NewLRUCache(8 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
   Reopen(&options);
-  env_->log_file_close_.store(true, std::memory_order_release);
 
-  std::string value(kValueSize, 'x');
-  Status s;
-  for (int i = 0; i < kWriteCount && s.ok(); i++) {
-    s = Put(Key(i), value);
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
   }
-  ASSERT_TRUE(!s.ok()) << "succeeded even after log file Close failure";
-
-  // Future writes should also fail after an earlier error.
-  s = Put("hello", "world");
-  ASSERT_TRUE(!s.ok()) << "write succeeded after log file Close failure";
+  Compact("a", "z");
+  Reopen(&options);
 
-  env_->log_file_close_.store(false, std::memory_order_release);
-}
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
 
-// Multi-threaded test:
-namespace {
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
 
-static const int kNumThreads = 4;
-static const int kTestSeconds = 10;
-static const int kNumKeys = 1000;
+  // A lookup reads at most one index partition and one filter partition,
+  // and rarely a data block.  (The partitions only stay in the block cache
+  // when the table file is not memory-mapped.)
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2 * N + 3 * N / 100);
 
-struct MTState {
-  DBTest* test;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count), iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, ValueLog) {
+  Options options = CurrentOptions();
+  options.value_log_threshold = 100;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 100; i++) {
+    model[Key(i)] = (i % 2 == 0) ? RandomString(&rnd, 1000) : "small";
+    ASSERT_LEVELDB_OK(Put(Key(i), model[Key(i)]));
+  }
+  const std::string old_value = model[Key(10)];
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 100; i += 4) {
+    model[Key(i)] = RandomString(&rnd, 2000);
+    ASSERT_LEVELDB_OK(Put(Key(i), model[Key(i)]));
+  }
+  ASSERT_LEVELDB_OK(Delete(Key(2)));
+  model.erase(Key(2));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GE(ValueLogBytes(), 75 * 1000);
+
+  for (int run = 0; run < 3; run++) {
+    for (int i = 0; i < 100; i++) {
+      auto it = model.find(Key(i));
+      ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+    }
+    if (run == 0) {
+      ASSERT_EQ(old_value, Get(Key(10), snapshot));
+      db_->ReleaseSnapshot(snapshot);
+    }
+
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto model_iter = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model_iter) {
+      ASSERT_EQ(model_iter->first, iter->key().ToString());
+      ASSERT_EQ(model_iter->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model_iter == model.end());
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      --model_iter;
+      ASSERT_EQ(model_iter->first, iter->key().ToString());
+      ASSERT_EQ(model_iter->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model_iter == model.begin());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    if (run == 0) {
+      Reopen(&options);
+    } else {
+      Compact("a", "z");
+    }
+  }
+}
+
+TEST_F(DBTest, ValueLogChecksums) {
+  Options options = CurrentOptions();
+  options.value_log_threshold = 100;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", std::string(1000, 'v')));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  // Flip the last byte of the value in its value log
+  std::vector<std::string> files;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &files));
+  uint64_t number;
+  FileType type;
+  for (const std::string& file : files) {
+    if (ParseFileName(file, &number, &type) && type == kValueLogFile) {
+      const std::string fname = dbname_ + "/" + file;
+      std::string contents;
+      ASSERT_LEVELDB_OK(ReadFileToString(env_, fname, &contents));
+      contents.back() ^= 0x1;
+      ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, fname));
+    }
+  }
+  Reopen(&options);
+
+  ReadOptions verify;
+  verify.verify_checksums = true;
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+  ASSERT_TRUE(db_->Get(verify, "foo", &value).IsCorruption());
+
+  // Iterators read values with their own options
+  for (bool verify_checksums : {false, true}) {
+    verify.verify_checksums = verify_checksums;
+    Iterator* iter = db_->NewIterator(verify);
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    iter->value();
+    ASSERT_EQ(verify_checksums, iter->status().IsCorruption());
+    delete iter;
+  }
+}
+
+TEST_F(DBTest, ValueLogGarbageCollection) {
+  Options options = CurrentOptions();
+  options.value_log_threshold = 100;
+  Reopen(&options);
+
+  // Cold values are written once, hot values are overwritten, so that the
+  // first value log only stays in use because of the cold values.
+  Random rnd(301);
+  const int kValueSize = 1000;
+  std::map<std::string, std::string> model;
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 100; i++) {
+      if (round == 0 || i % 2 == 0) {
+        model[Key(i)] = RandomString(&rnd, kValueSize);
+        ASSERT_LEVELDB_OK(Put(Key(i), model[Key(i)]));
+      }
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Drop the overwritten values from the tables.  Compactions then move
+  // the cold values to new value logs until at most half of the value log
+  // space is garbage.
+  const uint64_t live_bytes = model.size() * (kValueSize + 20);
+  Compact("a", "z");
+  for (int i = 0; i < 100 && ValueLogBytes() > 2 * live_bytes; i++) {
+    env_->SleepForMicroseconds(100000);
+  }
+  ASSERT_LE(ValueLogBytes(), 2 * live_bytes);
+
+  Reopen(&options);
+  for (const auto& kvp : model) {
+    ASSERT_EQ(kvp.second, Get(kvp.first));
+  }
+}
+
+TEST_F(DBTest, ValueLogGarbageCollectionLastLevel) {
+  Options options = CurrentOptions();
+  options.value_log_threshold = 1000;
+  options.value_log_gc_ratio = 0.2;
+  options.max_file_size = 1 << 20;
+  Reopen(&options);
+
+  // The first value log holds the values of the cold keys, written once,
+  // and the first values of the hot keys.  Smaller filler values, kept in
+  // the tables, put the cold and hot keys into different files once they
+  // reach the last level, where later writes only rewrite the hot file.
+  Random rnd(301);
+  const int kValueSize = 1000;
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 3000; i++) {
+    ASSERT_LEVELDB_OK(Put("m" + Key(i), RandomString(&rnd, 500)));
+  }
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 100; i++) {
+      const std::string key = (i < 10 ? "a" : "z") + Key(i);
+      if (round == 0 || key[0] == 'z') {
+        model[key] = RandomString(&rnd, kValueSize);
+        ASSERT_LEVELDB_OK(Put(key, model[key]));
+      }
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+    }
+  }
+  ASSERT_EQ("0,0,0,0,0,0,2", FilesPerLevel());
+
+  const uint64_t live_bytes = model.size() * (kValueSize + 20);
+  for (int i = 0; i < 100 && ValueLogBytes() > live_bytes * 5 / 4; i++) {
+    env_->SleepForMicroseconds(100000);
+  }
+  ASSERT_LE(ValueLogBytes(), live_bytes * 5 / 4);
+
+  Reopen(&options);
+  for (const auto& kvp : model) {
+    ASSERT_EQ(kvp.second, Get(kvp.first));
+  }
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewDelimitedPrefixTransform('|', 1);
+  Reopen(&options);
+
+  // Tenants with an even number have keys in the files of the lower
+  // level, the others in a file of the upper level.
+  const int kTenants = 200;
+  const int kKeysPerTenant = 10;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int t = pass; t < kTenants; t += 2) {
+      for (int i = 0; i < kKeysPerTenant; i++) {
+        ASSERT_LEVELDB_OK(Put(Key(t) + "|" + Key(i), "v"));
+      }
+    }
+    if (pass == 0) {
+      Compact("a", "z");
+    } else {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(read_options);
+  for (int t = 0; t < kTenants; t += 7) {
+    int count = 0;
+    for (iter->Seek(Key(t) + "|"); iter->Valid(); iter->Next()) {
+      ASSERT_TRUE(iter->key().starts_with(Key(t) + "|"));
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(kKeysPerTenant, count);
+  }
+
+  delete iter;
+
+  // Seeking a missing prefix should rarely read any block, while the
+  // same seeks without the prefix option read one block per level.
+  const int kMissing = 1000;
+  for (bool prefix_same_as_start : {true, false}) {
+    read_options.prefix_same_as_start = prefix_same_as_start;
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < kMissing; i++) {
+      iter = db_->NewIterator(read_options);
+      // Sorts between the keys of two tenants
+      iter->Seek(Key(i % kTenants) + "x|");
+      ASSERT_TRUE(!prefix_same_as_start || !iter->Valid());
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+    }
+    int reads = env_->random_read_counter_.Read();
+    std::fprintf(stderr, "%d missing prefixes => %d reads\n", kMissing,
+                 reads);
+    if (prefix_same_as_start) {
+      ASSERT_LE(reads, 3 * kMissing / 100);
+    } else {
+      ASSERT_GE(reads, kMissing);
+    }
+  }
+
+  // Without a prefix in the target, iteration is not limited
+  read_options.prefix_same_as_start = true;
+  iter = db_->NewIterator(read_options);
+  iter->Seek(Key(kTenants - 1));
+  ASSERT_TRUE(iter->Valid());
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(kKeysPerTenant, count);
+
+  // Prev() is not supported after a prefix seek
+  iter->Seek(Key(1) + "|");
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, IterateBounds) {
+  for (char c = 'a'; c <= 'j'; c++) {
+    ASSERT_LEVELDB_OK(Put(std::string(1, c), std::string(1, c)));
+  }
+  Compact("a", "z");
+  ASSERT_LEVELDB_OK(Put("b2", "b2"));
+  ASSERT_LEVELDB_OK(Put("e2", "e2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Delete("d"));
+  ASSERT_LEVELDB_OK(Put("f", "f2"));
+
+  Slice lower("c"), upper("g");
+  ReadOptions read_options;
+  read_options.iterate_lower_bound = &lower;
+  read_options.iterate_upper_bound = &upper;
+  Iterator* iter = db_->NewIterator(read_options);
+  std::string forward, backward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->key().ToString() + "->" + iter->value().ToString() + " ";
+  }
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    backward += iter->key().ToString() + " ";
+  }
+  ASSERT_EQ("c->c e->e e2->e2 f->f2 ", forward);
+  ASSERT_EQ("f e2 e c ", backward);
+
+  iter->Seek("a");
+  ASSERT_EQ("c->c", IterStatus(iter));
+  iter->Seek("e1");
+  ASSERT_EQ("e2->e2", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("e->e", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("c->c", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("f");
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("g");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
+
+TEST_F(DBTest, IterateBoundsSkipBlocks) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.block_size = 1024;
+  Reopen(&options);
+
+  // Deleted keys follow the live ones, so a scan without an upper bound
+  // reads through all of them.
+  const int kLive = 100;
+  const int kDeleted = 1000;
+  for (int i = 0; i < kLive + kDeleted; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  for (int i = kLive; i < kLive + kDeleted; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  std::string upper_key = Key(kLive);
+  Slice upper(upper_key);
+  int reads[2];
+  for (bool bounded : {false, true}) {
+    ReadOptions read_options;
+    if (bounded) {
+      read_options.iterate_upper_bound = &upper;
+    }
+    env_->random_read_counter_.Reset();
+    Iterator* iter = db_->NewIterator(read_options);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(kLive, count);
+    delete iter;
+    reads[bounded] = env_->random_read_counter_.Read();
+  }
+  std::fprintf(stderr, "%d reads without bound, %d with\n", reads[0],
+               reads[1]);
+  ASSERT_LT(4 * reads[1], reads[0]);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kUniversalCompaction;
+  Reopen(&options);
+
+  // Every flush overwrites the same keys, so that all sorted runs have
+  // about the same size and are merged together once there are enough.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int round = 0; round < 3 * config::kL0_CompactionTrigger; round++) {
+    for (int i = 0; i < 100; i++) {
+      model[Key(i)] = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(Key(i), model[Key(i)]));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0;
+         i < 100 && NumSortedRuns() >= config::kL0_CompactionTrigger; i++) {
+      env_->SleepForMicroseconds(100000);
+    }
+    ASSERT_LT(NumSortedRuns(), config::kL0_CompactionTrigger);
+  }
+
+  Reopen(&options);
+  for (const auto& kvp : model) {
+    ASSERT_EQ(kvp.second, Get(kvp.first));
+  }
+}
+
+TEST_F(DBTest, UniversalCompactionSizeRatio) {
+  Options options = CurrentOptions();
+  options.compaction_style = kUniversalCompaction;
+  Reopen(&options);
+
+  // A large sorted run, followed by small ones.
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 100)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  for (int round = 0; round < config::kL0_CompactionTrigger - 1; round++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 100)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Only the small runs are merged, into the level above the large one.
+  for (int i = 0; i < 100 && FilesPerLevel() != "0,1,1"; i++) {
+    env_->SleepForMicroseconds(100000);
+  }
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+}
+
+TEST_F(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.level_compaction_dynamic_level_bytes = true;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  // Level-0 files are compacted into the last level until it outgrows the
+  // level-1 limit of 10MB, and then into the level above it.
+  Random rnd(301);
+  const int kNumKeys = 1200;
+  std::vector<std::string> values;
+  for (int i = 0; i < kNumKeys; i++) {
+    values.push_back(RandomString(&rnd, 10000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values.back()));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0;
+       i < 100 && NumTableFilesAtLevel(0) >= config::kL0_CompactionTrigger;
+       i++) {
+    env_->SleepForMicroseconds(100000);
+  }
+  for (int level = 1; level < config::kNumLevels - 2; level++) {
+    ASSERT_EQ(0, NumTableFilesAtLevel(level)) << level;
+  }
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 2), 0);
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 0);
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, RateLimiter) {
+  Options options = CurrentOptions();
+  options.rate_limiter = NewRateLimiter(100 << 20);
+  Reopen(&options);
+
+  // Two overlapping tables, so that the compaction cannot move them.
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + round)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  const int64_t flushed =
+      options.rate_limiter->GetTotalBytesThrough(RateLimiter::kHigh);
+  ASSERT_GT(flushed, 0);
+  ASSERT_EQ(0, options.rate_limiter->GetTotalBytesThrough(RateLimiter::kLow));
+
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(flushed,
+            options.rate_limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+  ASSERT_GT(options.rate_limiter->GetTotalBytesThrough(RateLimiter::kLow), 0);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(std::string(1000, 'b'), Get(Key(i)));
+  }
+
+  Close();
+  delete options.rate_limiter;
+}
+
+TEST_F(DBTest, DirectIO) {
+  Options options = CurrentOptions();
+  // EnvWrapper does not forward direct I/O, so use the posix Env itself.
+  options.env = Env::Default();
+  options.use_direct_io_for_flush_and_compaction = true;
+  options.block_align = true;
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int round = 0; round < 2; round++) {
+    values.clear();
+    for (int i = 0; i < 200; i++) {
+      values.push_back(RandomString(&rnd, 1000 + i));
+      ASSERT_LEVELDB_OK(Put(Key(i), values.back()));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, CompactionReadahead) {
+  Options options = CurrentOptions();
+  options.compaction_readahead_size = 64 << 10;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int round = 0; round < 2; round++) {
+    values.clear();
+    for (int i = 0; i < 200; i++) {
+      values.push_back(RandomString(&rnd, 1000 + i));
+      ASSERT_LEVELDB_OK(Put(Key(i), values.back()));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, Statistics) {
+  Options options = CurrentOptions();
+  options.statistics = NewStatistics();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+  Statistics* statistics = options.statistics;
+
+  std::string property;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  ASSERT_EQ(100, statistics->GetTickerCount(kNumberKeysWritten));
+  ASSERT_GT(statistics->GetTickerCount(kBytesWritten), 100 * 100);
+  ASSERT_GT(statistics->GetTickerCount(kWalBytes), 100 * 100);
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(0)));
+  ASSERT_EQ(1, statistics->GetTickerCount(kMemtableHit));
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(statistics->GetTickerCount(kFlushBytesWritten), 0);
+  HistogramData data;
+  statistics->GetHistogramData(kFlushMicros, &data);
+  ASSERT_EQ(1, data.count);
+
+  // The flush opened the table to verify it.  The first read of the table
+  // misses the block cache; the second one hits if the block was added,
+  // which it is not when the table is memory-mapped.
+  ASSERT_EQ(1, statistics->GetTickerCount(kTableCacheMiss));
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(1)));
+  ASSERT_EQ(1, statistics->GetTickerCount(kMemtableMiss));
+  ASSERT_EQ(1, statistics->GetTickerCount(kTableCacheHit));
+  ASSERT_EQ(1, statistics->GetTickerCount(kBlockCacheMiss));
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(1)));
+  ASSERT_EQ(2, statistics->GetTickerCount(kTableCacheHit));
+  ASSERT_EQ(2, statistics->GetTickerCount(kBlockCacheHit) +
+                   statistics->GetTickerCount(kBlockCacheMiss));
+  ASSERT_EQ(statistics->GetTickerCount(kBlockCacheAdd),
+            statistics->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(2, statistics->GetTickerCount(kBloomFilterMayMatch));
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_GT(statistics->GetTickerCount(kBloomFilterUseful), 90);
+  ASSERT_EQ(103, statistics->GetTickerCount(kNumberKeysRead));
+  ASSERT_EQ(3 * 100, statistics->GetTickerCount(kBytesRead));
+  statistics->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(103, data.count);
+
+  // An overlapping table, so that the compaction cannot move them.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'w')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_GT(statistics->GetTickerCount(kCompactionBytesRead), 0);
+  ASSERT_GT(statistics->GetTickerCount(kCompactionBytesWritten), 0);
+  uint64_t level_bytes_read = 0;
+  uint64_t level_bytes_written = 0;
+  for (int level = 0; level <= Statistics::kMaxLevel; level++) {
+    level_bytes_read += statistics->GetLevelTickerCount(kLevelBytesRead, level);
+    level_bytes_written +=
+        statistics->GetLevelTickerCount(kLevelBytesWritten, level);
+  }
+  ASSERT_EQ(statistics->GetTickerCount(kCompactionBytesRead),
+            level_bytes_read);
+  ASSERT_EQ(statistics->GetTickerCount(kFlushBytesWritten) +
+                statistics->GetTickerCount(kCompactionBytesWritten),
+            level_bytes_written);
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &property));
+  ASSERT_NE(std::string::npos, property.find("number.keys.written: 200\n"));
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics-values", &property));
+  ASSERT_NE(std::string::npos, property.find("number.keys.written 200\n"));
+
+  Close();
+  delete options.filter_policy;
+  delete options.statistics;
+
+  // Without statistics, the properties are not available.
+  options = CurrentOptions();
+  Reopen(&options);
+  ASSERT_FALSE(db_->GetProperty("leveldb.statistics", &property));
+}
+
+TEST_F(DBTest, PerfContext) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Delete("a"));
+  PerfContext* context = GetPerfContext();
+
+  // Nothing is collected by default.
+  context->Reset();
+  ASSERT_EQ("vb", Get("b"));
+  ASSERT_EQ("", context->ToString(true));
+
+  SetPerfLevel(kEnableCount);
+  ASSERT_EQ("vb", Get("b"));
+  ASSERT_EQ(1, context->get_from_memtable_count);
+  ASSERT_EQ(1, context->get_from_table_count);
+  ASSERT_EQ(0, context->table_open_count);
+  ASSERT_EQ(1, context->bloom_filter_may_match_count);
+  ASSERT_EQ(1,
+            context->block_cache_hit_count + context->block_cache_miss_count);
+  ASSERT_EQ(context->block_cache_miss_count, context->block_read_count);
+  ASSERT_EQ(0, context->get_from_output_files_nanos);
+
+  context->Reset();
+  ASSERT_EQ("NOT_FOUND", Get("ab"));
+  ASSERT_EQ(1, context->bloom_filter_useful_count);
+  ASSERT_EQ(0, context->block_read_count);
+
+  SetPerfLevel(kEnableTime);
+  context->Reset();
+  ASSERT_EQ("vb", Get("b"));
+  ASSERT_GT(context->get_from_output_files_nanos, 0);
+  ASSERT_GT(context->filter_probe_nanos, 0);
+  // The stages of the table search are timed within it.
+  ASSERT_GE(context->get_from_output_files_nanos,
+            context->find_table_nanos + context->filter_probe_nanos +
+                context->block_read_nanos);
+
+  // The seek steps over the deletion of "a" and the value it hides.
+  context->Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("a");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("b", iter->key().ToString());
+  delete iter;
+  ASSERT_EQ(1, context->internal_delete_skipped_count);
+  ASSERT_EQ(1, context->internal_key_skipped_count);
+  ASSERT_GT(context->seek_internal_nanos, 0);
+
+  SetPerfLevel(kDisable);
+  Close();
+  delete options.filter_policy;
+}
+
+// Records the events it is told about.
+class RecordingListener : public EventListener {
+ public:
+  RecordingListener() : flush_delay_micros(0) {}
+
+  void OnFlushCompleted(const FlushJobInfo& info) override {
+    {
+      MutexLock l(&mu);
+      flushes.push_back(info);
+    }
+    Env::Default()->SleepForMicroseconds(flush_delay_micros.load());
+  }
+  void OnCompactionBegin(const CompactionJobInfo& info) override {
+    MutexLock l(&mu);
+    compactions_begun.push_back(info);
+  }
+  void OnCompactionCompleted(const CompactionJobInfo& info) override {
+    MutexLock l(&mu);
+    compactions_completed.push_back(info);
+  }
+  void OnStallConditionChanged(const WriteStallInfo& info) override {
+    MutexLock l(&mu);
+    stalls.push_back(info);
+  }
+
+  port::Mutex mu;
+  std::atomic<int> flush_delay_micros;
+  std::vector<FlushJobInfo> flushes;
+  std::vector<CompactionJobInfo> compactions_begun;
+  std::vector<CompactionJobInfo> compactions_completed;
+  std::vector<WriteStallInfo> stalls;
+};
+
+TEST_F(DBTest, EventListener) {
+  RecordingListener listener;
+  Options options = CurrentOptions();
+  options.listener = &listener;
+  Reopen(&options);
+
+  // Two overlapping tables, so that the compaction cannot move them.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'w')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  // The database tells the listener about its background work before it
+  // finishes closing.
+  Close();
+
+  // CompactRange() flushed the memtable too, although it was empty.
+  ASSERT_EQ(3, listener.flushes.size());
+  for (const FlushJobInfo& info : listener.flushes) {
+    ASSERT_EQ(dbname_, info.db_name);
+    ASSERT_LEVELDB_OK(info.status);
+  }
+  ASSERT_GT(listener.flushes[0].file_size, 0);
+  ASSERT_GT(listener.flushes[1].file_size, 0);
+  ASSERT_EQ(0, listener.flushes[2].file_size);
+  ASSERT_NE(listener.flushes[0].file_number, listener.flushes[1].file_number);
+
+  ASSERT_GE(listener.compactions_begun.size(), 1);
+  ASSERT_EQ(listener.compactions_begun.size(),
+            listener.compactions_completed.size());
+  const CompactionJobInfo& begun = listener.compactions_begun[0];
+  const CompactionJobInfo& completed = listener.compactions_completed[0];
+  ASSERT_EQ(dbname_, completed.db_name);
+  ASSERT_EQ(begun.input_files, completed.input_files);
+  ASSERT_EQ(2, completed.input_files.size());
+  ASSERT_EQ(listener.flushes[0].file_size + listener.flushes[1].file_size,
+            completed.bytes_read);
+  ASSERT_TRUE(begun.output_files.empty());
+  ASSERT_EQ(1, completed.output_files.size());
+  ASSERT_GT(completed.bytes_written, 0);
+  ASSERT_LT(completed.bytes_written, completed.bytes_read);
+  ASSERT_LEVELDB_OK(completed.status);
+  ASSERT_TRUE(listener.stalls.empty());
+
+  // Writes stop while the previous memtable waits for a flush that the
+  // listener holds up.
+  options.write_buffer_size = 10000;
+  listener.flush_delay_micros = 100000;
+  Reopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'x')));
+  }
+  listener.flush_delay_micros = 0;
+  Close();
+
+  ASSERT_FALSE(listener.stalls.empty());
+  ASSERT_EQ(kWriteStallNone, listener.stalls[0].previous);
+  ASSERT_EQ(kWriteStallStopped, listener.stalls[0].condition);
+  for (size_t i = 1; i < listener.stalls.size(); i++) {
+    ASSERT_EQ(listener.stalls[i - 1].condition, listener.stalls[i].previous);
+    ASSERT_NE(listener.stalls[i].previous, listener.stalls[i].condition);
+  }
+}
+
+// Write Key(i) -> value for i in [begin,end) to an external table.
+static Status WriteExternalFile(const Options& options,
+                                const std::string& fname, int begin, int end,
+                                const std::string& value) {
+  SstFileWriter writer(options);
+  Status s = writer.Open(fname);
+  for (int i = begin; i < end && s.ok(); i++) {
+    s = writer.Put(Key(i), value);
+  }
+  if (s.ok()) {
+    s = writer.Finish();
+  }
+  return s;
+}
+
+TEST_F(DBTest, SstFileWriter) {
+  const std::string fname = testing::TempDir() + "db_test_writer.sst";
+  SstFileWriter writer(CurrentOptions());
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+  ASSERT_FALSE(env_->FileExists(fname));
+
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_LEVELDB_OK(writer.Put("b", "v"));
+  ASSERT_LEVELDB_OK(writer.Delete("c"));
+  ASSERT_TRUE(writer.Put("c", "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(writer.Finish());
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(fname, &file_size));
+  ASSERT_EQ(file_size, writer.FileSize());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(fname));
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  const std::string dir = testing::TempDir();
+  Options options = CurrentOptions();
+
+  // Into an empty range, a file goes to the last level and keeps
+  // sequence number 0.
+  ASSERT_LEVELDB_OK(
+      WriteExternalFile(options, dir + "db_test_ingest1.sst", 0, 100, "a"));
+  ASSERT_LEVELDB_OK(WriteExternalFile(options, dir + "db_test_ingest2.sst",
+                                      200, 300, "a"));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(
+      IngestExternalFileOptions(),
+      {dir + "db_test_ingest2.sst", dir + "db_test_ingest1.sst"}));
+  ASSERT_EQ(2, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_TRUE(env_->FileExists(dir + "db_test_ingest1.sst"));
+  ASSERT_EQ("a", Get(Key(0)));
+  ASSERT_EQ("a", Get(Key(299)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+
+  // Over data in the memtable, a file is newer than that data, but not
+  // visible to older snapshots.
+  ASSERT_LEVELDB_OK(Put(Key(50), "m"));
+  ASSERT_LEVELDB_OK(Put(Key(150), "m"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  IngestExternalFileOptions move;
+  move.move_files = true;
+  ASSERT_LEVELDB_OK(
+      WriteExternalFile(options, dir + "db_test_ingest3.sst", 40, 160, "b"));
+  ASSERT_LEVELDB_OK(
+      db_->IngestExternalFile(move, {dir + "db_test_ingest3.sst"}));
+  ASSERT_FALSE(env_->FileExists(dir + "db_test_ingest3.sst"));
+  ASSERT_EQ("0,1,1,0,0,0,2", FilesPerLevel());
+  ASSERT_EQ("b", Get(Key(50)));
+  ASSERT_EQ("b", Get(Key(150)));
+  ASSERT_EQ("a", Get(Key(0)));
+  ASSERT_EQ("m", Get(Key(50), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(120), snapshot));
+  ASSERT_EQ("a", Get(Key(45), snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Writes after the ingestion are newer still.
+  ASSERT_LEVELDB_OK(Put(Key(60), "c"));
+  ASSERT_EQ("c", Get(Key(60)));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(260, count);
+
+  // The sequence number given to the file survives reopening and
+  // compaction.
+  Reopen();
+  ASSERT_EQ("b", Get(Key(50)));
+  ASSERT_EQ("c", Get(Key(60)));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("b", Get(Key(50)));
+  ASSERT_EQ("b", Get(Key(150)));
+  ASSERT_EQ("c", Get(Key(60)));
+  ASSERT_EQ("a", Get(Key(0)));
+  ASSERT_EQ("a", Get(Key(299)));
+
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir + "db_test_ingest1.sst"));
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir + "db_test_ingest2.sst"));
+}
+
+namespace {
+
+struct IngestState {
+  DBTest* test;
+  std::string fname;
+  std::atomic<bool> ingested;
+  std::atomic<bool> compacted;
+};
+
+static void IngestThreadBody(void* arg) {
+  IngestState* state = reinterpret_cast<IngestState*>(arg);
+  ASSERT_LEVELDB_OK(state->test->db_->IngestExternalFile(
+      IngestExternalFileOptions(), {state->fname}));
+  state->ingested.store(true, std::memory_order_release);
+}
+
+static void CompactLevel2ThreadBody(void* arg) {
+  IngestState* state = reinterpret_cast<IngestState*>(arg);
+  state->test->dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  state->compacted.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, IngestExternalFileDuringCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Level-2 holds [0,50] and [250,300], level-4 holds [0,300], so a file
+  // of [100,200) is ingested into level-3.
+  ASSERT_LEVELDB_OK(Put(Key(0), "v"));
+  ASSERT_LEVELDB_OK(Put(Key(300), "v"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_LEVELDB_OK(Put(Key(0), "v"));
+  ASSERT_LEVELDB_OK(Put(Key(50), "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put(Key(250), "v"));
+  ASSERT_LEVELDB_OK(Put(Key(300), "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,2,0,1", FilesPerLevel());
+
+  IngestState state;
+  state.test = this;
+  state.fname = testing::TempDir() + "db_test_ingest1.sst";
+  state.ingested.store(false, std::memory_order_release);
+  state.compacted.store(false, std::memory_order_release);
+  ASSERT_LEVELDB_OK(WriteExternalFile(options, state.fname, 100, 200, "i"));
+
+  // Hold the ingestion after its level is picked, and meanwhile start a
+  // compaction of level-2 into level-3, whose output covers [0,300].  It
+  // must wait for the ingested file, or it would straddle it.
+  env_->delay_table_rename_.store(true, std::memory_order_release);
+  env_->StartThread(IngestThreadBody, &state);
+  while (!env_->table_rename_delayed_.load(std::memory_order_acquire)) {
+    DelayMilliseconds(10);
+  }
+  env_->StartThread(CompactLevel2ThreadBody, &state);
+  DelayMilliseconds(200);
+  env_->delay_table_rename_.store(false, std::memory_order_release);
+  while (!state.ingested.load(std::memory_order_acquire) ||
+         !state.compacted.load(std::memory_order_acquire)) {
+    DelayMilliseconds(10);
+  }
+
+  ASSERT_EQ("0,0,0,1,1", FilesPerLevel());
+  ASSERT_EQ("v", Get(Key(0)));
+  ASSERT_EQ("v", Get(Key(50)));
+  ASSERT_EQ("i", Get(Key(100)));
+  ASSERT_EQ("i", Get(Key(199)));
+  ASSERT_EQ("v", Get(Key(300)));
+  Reopen(&options);
+  ASSERT_EQ("i", Get(Key(150)));
+  ASSERT_EQ("0,0,0,1,1", FilesPerLevel());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(state.fname));
+}
+
+TEST_F(DBTest, IngestExternalFileErrors) {
+  const std::string dir = testing::TempDir();
+  Options options = CurrentOptions();
+  ASSERT_TRUE(db_->IngestExternalFile(IngestExternalFileOptions(), {})
+                  .IsInvalidArgument());
+
+  // Files that overlap each other
+  ASSERT_LEVELDB_OK(
+      WriteExternalFile(options, dir + "db_test_ingest1.sst", 0, 100, "a"));
+  ASSERT_LEVELDB_OK(
+      WriteExternalFile(options, dir + "db_test_ingest2.sst", 99, 200, "a"));
+  ASSERT_TRUE(db_->IngestExternalFile(IngestExternalFileOptions(),
+                                      {dir + "db_test_ingest1.sst",
+                                       dir + "db_test_ingest2.sst"})
+                  .IsInvalidArgument());
+
+  // A file that is not a table
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, std::string(100, 'x'),
+                                      dir + "db_test_ingest2.sst"));
+  ASSERT_FALSE(db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       {dir + "db_test_ingest2.sst"})
+                   .ok());
+
+  // A missing file
+  ASSERT_FALSE(db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       {dir + "db_test_ingest3.sst"})
+                   .ok());
+
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(filename, &number, &type)) {
+      ASSERT_NE(kTableFile, type) << filename;
+      ASSERT_NE(kTempFile, type) << filename;
+    }
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir + "db_test_ingest1.sst"));
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir + "db_test_ingest2.sst"));
+}
+
+TEST_F(DBTest, Checkpoint) {
+  const std::string checkpoint_dir = testing::TempDir() + "db_test_checkpoint";
+  DestroyDB(checkpoint_dir, Options());
+  Options options = CurrentOptions();
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "a"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  for (int i = 50; i < 150; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "b"));
+  }
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), Key(0)));
+  ASSERT_LEVELDB_OK(db_->CreateCheckpoint(checkpoint_dir));
+  ASSERT_TRUE(db_->CreateCheckpoint(checkpoint_dir).IsInvalidArgument());
+
+  // Later writes and compactions do not reach the checkpoint.
+  ASSERT_LEVELDB_OK(Put(Key(1), "c"));
+  ASSERT_LEVELDB_OK(Put(Key(200), "c"));
+  db_->CompactRange(nullptr, nullptr);
+
+  DB* checkpoint = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(options, checkpoint_dir, &checkpoint));
+  std::string value;
+  ASSERT_TRUE(checkpoint->Get(ReadOptions(), Key(0), &value).IsNotFound());
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), Key(1), &value));
+  ASSERT_EQ("a", value);
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), Key(99), &value));
+  ASSERT_EQ("b", value);
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), Key(149), &value));
+  ASSERT_EQ("b", value);
+  ASSERT_TRUE(checkpoint->Get(ReadOptions(), Key(200), &value).IsNotFound());
+
+  // The checkpoint is a database of its own.
+  ASSERT_LEVELDB_OK(checkpoint->Put(WriteOptions(), Key(1), "d"));
+  delete checkpoint;
+  ASSERT_EQ("c", Get(Key(1)));
+  ASSERT_LEVELDB_OK(DB::Open(options, checkpoint_dir, &checkpoint));
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), Key(1), &value));
+  ASSERT_EQ("d", value);
+  delete checkpoint;
+  ASSERT_LEVELDB_OK(DestroyDB(checkpoint_dir, options));
+}
+
+TEST_F(DBTest, CheckpointTempDirExists) {
+  const std::string checkpoint_dir = testing::TempDir() + "db_test_checkpoint";
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  DestroyDB(checkpoint_dir, Options());
+  env_->CreateDir(tmp_dir);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "keep", tmp_dir + "/file"));
+  ASSERT_LEVELDB_OK(Put(Key(0), "a"));
+
+  // A directory in the way of the checkpoint is left as it is.
+  ASSERT_TRUE(db_->CreateCheckpoint(checkpoint_dir).IsInvalidArgument());
+  ASSERT_FALSE(env_->FileExists(checkpoint_dir));
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, tmp_dir + "/file", &contents));
+  ASSERT_EQ("keep", contents);
+
+  ASSERT_LEVELDB_OK(env_->RemoveFile(tmp_dir + "/file"));
+  ASSERT_LEVELDB_OK(env_->RemoveDir(tmp_dir));
+}
+
+TEST_F(DBTest, LogCloseError) {
+  // Regression test for bug where we could ignore log file
+  // Close() error when switching to a new log file.
+  const int kValueSize = 20000;
+  const int kWriteCount = 10;
+  const int kWriteBufferSize = (kValueSize * kWriteCount) / 2;
+
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = kWriteBufferSize;  // Small write buffer
+  Reopen(&options);
+  env_->log_file_close_.store(true, std::memory_order_release);
+
+  std::string value(kValueSize, 'x');
+  Status s;
+  for (int i = 0; i < kWriteCount && s.ok(); i++) {
+    s = Put(Key(i), value);
+  }
+  ASSERT_TRUE(!s.ok()) << "succeeded even after log file Close failure";
+
+  // Future writes should also fail after an earlier error.
+  s = Put("hello", "world");
+  ASSERT_TRUE(!s.ok()) << "write succeeded after log file Close failure";
+
+  env_->log_file_close_.store(false, std::memory_order_release);
+}
+
+// Multi-threaded test:
+namespace {
+
+static const int kNumThreads = 4;
+static const int kTestSeconds = 10;
+static const int kNumKeys = 1000;
+
+struct MTState {
+  DBTest* test;
   std::atomic<bool> stop;
   std::atomic<int> counter[kNumThreads];
   std::atomic<bool> thread_done[kNumThreads];
@@ -2147,6 +3978,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+        if (begin_key.compare(end_key) < 0) {
+          map_->erase(map_->lower_bound(begin_key.ToString()),
+                      map_->lower_bound(end_key.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2319,7 +4156,9 @@ TEST_F(DBTest, Randomized) {
             // Periodically re-use the same key from the previous iter, so
             // we have multiple entries in the write batch for the same key
           }
-          if (rnd.OneIn(2)) {
+          if (rnd.OneIn(20)) {
+            b.DeleteRange(k, RandomKey(&rnd));
+          } else if (rnd.OneIn(2)) {
             v = RandomString(&rnd, rnd.Uniform(10));
             b.Put(k, v);
           } else {
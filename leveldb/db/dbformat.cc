@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -96,7 +97,27 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
-const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor,
+    bool whole_key_filtering)
+    : user_policy_(p),
+      prefix_extractor_(prefix_extractor),
+      whole_key_filtering_(whole_key_filtering || prefix_extractor == nullptr) {
+  // Filters that also hold prefixes get a name of their own, so that
+  // the filters of tables written with other prefixes are ignored.
+  if (user_policy_ != nullptr) {
+    name_ = user_policy_->Name();
+    if (prefix_extractor_ != nullptr) {
+      name_.append(".");
+      name_.append(prefix_extractor_->Name());
+      if (!whole_key_filtering_) {
+        name_.append(".PrefixOnly");
+      }
+    }
+  }
+}
+
+const char* InternalFilterPolicy::Name() const { return name_.c_str(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
@@ -107,11 +128,49 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == nullptr) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  std::vector<Slice> filter_keys;
+  if (whole_key_filtering_) {
+    filter_keys.assign(keys, keys + n);
+  }
+  Slice last_prefix;
+  bool has_last_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      // Keys are sorted, so equal prefixes are next to each other
+      if (!has_last_prefix || prefix != last_prefix) {
+        filter_keys.push_back(prefix);
+        last_prefix = prefix;
+        has_last_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(filter_keys.data(),
+                             static_cast<int>(filter_keys.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
-  return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
+  Slice user_key = ExtractUserKey(key);
+  if (!whole_key_filtering_) {
+    // Only the prefix of the key can be checked
+    return !prefix_extractor_->InDomain(user_key) ||
+           user_policy_->KeyMayMatch(prefix_extractor_->Transform(user_key), f);
+  }
+  return user_policy_->KeyMayMatch(user_key, f);
+}
+
+bool InternalFilterPolicy::PrefixMayMatch(const Slice& key,
+                                          const Slice& f) const {
+  Slice user_key = ExtractUserKey(key);
+  if (prefix_extractor_ == nullptr || !prefix_extractor_->InDomain(user_key)) {
+    return true;
+  }
+  return user_policy_->KeyMayMatch(prefix_extractor_->Transform(user_key), f);
 }
 
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
@@ -125,4 +125,42 @@ TEST(FormatTest, InternalKeyDebugString) {
   ASSERT_EQ("(bad)", invalid_key.DebugString());
 }
 
+TEST(FormatTest, InternalFilterPolicyPrefixes) {
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const SliceTransform* prefix = NewDelimitedPrefixTransform('|', 1);
+  std::vector<std::string> keys = {IKey("a|1", 10, kTypeValue),
+                                   IKey("a|2", 11, kTypeValue),
+                                   IKey("c|1", 12, kTypeValue),
+                                   IKey("nodelim", 13, kTypeValue)};
+
+  for (bool whole_key_filtering : {true, false}) {
+    InternalFilterPolicy policy(bloom, prefix, whole_key_filtering);
+    std::vector<Slice> slices(keys.begin(), keys.end());
+    std::string filter;
+    policy.CreateFilter(slices.data(), static_cast<int>(slices.size()),
+                        &filter);
+
+    ASSERT_TRUE(policy.PrefixMayMatch(IKey("a|", 100, kTypeValue), filter));
+    ASSERT_TRUE(policy.PrefixMayMatch(IKey("c|9", 100, kTypeValue), filter));
+    ASSERT_TRUE(!policy.PrefixMayMatch(IKey("b|1", 100, kTypeValue), filter));
+    // Keys without a prefix cannot be ruled out
+    ASSERT_TRUE(policy.PrefixMayMatch(IKey("b", 100, kTypeValue), filter));
+
+    ASSERT_TRUE(policy.KeyMayMatch(IKey("a|1", 100, kTypeValue), filter));
+    ASSERT_TRUE(policy.KeyMayMatch(IKey("nodelim", 100, kTypeValue), filter));
+    ASSERT_TRUE(!policy.KeyMayMatch(IKey("b|1", 100, kTypeValue), filter));
+    // Only whole keys tell apart keys with a known prefix
+    ASSERT_EQ(!whole_key_filtering,
+              policy.KeyMayMatch(IKey("a|3", 100, kTypeValue), filter));
+  }
+
+  ASSERT_EQ(std::string(bloom->Name()), InternalFilterPolicy(bloom).Name());
+  ASSERT_NE(std::string(bloom->Name()),
+            InternalFilterPolicy(bloom, prefix, true).Name());
+  ASSERT_NE(std::string(InternalFilterPolicy(bloom, prefix, true).Name()),
+            InternalFilterPolicy(bloom, prefix, false).Name());
+  delete prefix;
+  delete bloom;
+}
+
 }  // namespace leveldb
@@ -25,7 +25,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kValueLogFile
 };
 
 // Return the name of the log file with the specified number
@@ -43,6 +44,11 @@ std::string TableFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the value log file with the specified number
+// in the db named by "dbname".  The result will be prefixed with
+// "dbname".
+std::string ValueLogFileName(const std::string& dbname, uint64_t number);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
@@ -78,6 +84,10 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
 Status SetCurrentFile(Env* env, const std::string& dbname,
                       uint64_t descriptor_number);
 
+// Copy the contents of the file named "src" into a new file named
+// "target", and Sync() it.  On failure, "target" is removed.
+Status CopyFile(Env* env, const std::string& src, const std::string& target);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_FILENAME_H_
@@ -8,9 +8,14 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+// Number of range tombstones a memtable scans one by one on lookups
+// before it rebuilds its fragmented tombstone list.
+static const size_t kMaxPendingTombstones = 16;
+
 static Slice GetLengthPrefixedSlice(const char* data) {
   uint32_t len;
   const char* p = data;
@@ -19,9 +24,17 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-
-MemTable::~MemTable() { assert(refs_ == 0); }
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      has_range_tombstones_(false),
+      range_del_list_(nullptr) {}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete range_del_list_;
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
@@ -73,8 +86,18 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
+size_t MemTable::EncodedLength(const Slice& key, const Slice& value) {
+  size_t internal_key_size = key.size() + 8;
+  return VarintLength(internal_key_size) + internal_key_size +
+         VarintLength(value.size()) + value.size();
+}
+
+void MemTable::EncodeEntry(char* buf, SequenceNumber s, ValueType type,
+                           const Slice& key, const Slice& value) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -84,10 +107,6 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
-  const size_t encoded_len = VarintLength(internal_key_size) +
-                             internal_key_size + VarintLength(val_size) +
-                             val_size;
-  char* buf = arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -95,15 +114,87 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p += 8;
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
-  assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  assert(p + val_size == buf + EncodedLength(key, value));
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+  if (type == kTypeRangeDeletion) {
+    if (comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+      return;  // Empty range
+    }
+    AddToTombstoneList(s, key, value);
+    has_range_tombstones_.store(true, std::memory_order_release);
+  }
+  char* buf = arena_.Allocate(EncodedLength(key, value));
+  EncodeEntry(buf, s, type, key, value);
+  TableFor(type)->Insert(buf);
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  if (type == kTypeRangeDeletion) {
+    if (comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+      return;  // Empty range
+    }
+    AddToTombstoneList(s, key, value);
+    has_range_tombstones_.store(true, std::memory_order_release);
+  }
+  char* buf = arena_.AllocateConcurrently(EncodedLength(key, value));
+  EncodeEntry(buf, s, type, key, value);
+  TableFor(type)->InsertConcurrently(buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+void MemTable::AddToTombstoneList(SequenceNumber seq, const Slice& begin,
+                                  const Slice& end) {
+  MutexLock l(&range_del_mutex_);
+  pending_tombstones_.push_back(RangeTombstone(begin, end, seq));
+  if (pending_tombstones_.size() < kMaxPendingTombstones) {
+    return;
+  }
+  RangeTombstoneList* list =
+      new RangeTombstoneList(comparator_.comparator.user_comparator());
+  if (range_del_list_ != nullptr) {
+    list->AddAll(*range_del_list_);
+    delete range_del_list_;
+  }
+  for (const RangeTombstone& t : pending_tombstones_) {
+    list->Add(t.begin, t.end, t.seq);
+  }
+  list->Finish();
+  range_del_list_ = list;
+  pending_tombstones_.clear();
+}
+
+SequenceNumber MemTable::MaxCoveringTombstoneSequence(const Slice& user_key,
+                                                      SequenceNumber snapshot) {
+  if (!has_range_tombstones_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  SequenceNumber result = 0;
+  MutexLock l(&range_del_mutex_);
+  if (range_del_list_ != nullptr) {
+    result = range_del_list_->MaxCoveringSequence(user_key, snapshot);
+  }
+  for (const RangeTombstone& t : pending_tombstones_) {
+    if (t.seq > result && t.seq <= snapshot &&
+        ucmp->Compare(t.begin, user_key) <= 0 &&
+        ucmp->Compare(user_key, t.end) < 0) {
+      result = t.seq;
+    }
+  }
+  return result;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::vector<std::string>* operands) {
   Slice memkey = key.memtable_key();
+  const SequenceNumber tombstone_seq =
+      MaxCoveringTombstoneSequence(key.user_key(), key.sequence());
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  // Step over the merge operands, which apply to the entries after them.
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -117,21 +208,38 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+            Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) < tombstone_seq) {
+      *s = Status::NotFound(Slice());
+      return true;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        value->assign(v.data(), v.size());
+        return true;
       }
+      case kTypeMerge: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        operands->emplace_back(v.data(), v.size());
+        break;
+      }
+      case kTypeDeletion:
+      case kTypeRangeDeletion:
+      case kTypeValueHandle:  // Never held by a memtable
+        *s = Status::NotFound(Slice());
+        return true;
     }
   }
+  if (tombstone_seq > 0) {
+    // Older entries for key, in other memtables and in tables, are hidden.
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
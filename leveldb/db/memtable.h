@@ -5,11 +5,16 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
@@ -50,17 +55,32 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator that yields the range tombstones of the memtable
+  // (see db/range_tombstone.h), under the same conditions as NewIterator().
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  An entry of
+  // type kTypeRangeDeletion is a range tombstone from key to value.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called by several threads at once, as long as
+  // none of them calls Add() at the same time.
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // covers it, store a NotFound() error in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // The merge operands for key newer than that value or deletion are
+  // appended to *operands, newest first, and apply to it.  When false is
+  // returned, the operands found apply to the older entries for key.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::vector<std::string>* operands);
 
  private:
   friend class MemTableIterator;
@@ -76,10 +96,40 @@ class MemTable {
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  // Return the length of the entry Add() builds for the arguments.
+  static size_t EncodedLength(const Slice& key, const Slice& value);
+
+  // Build the entry for an Add() of the arguments in "buf", which must
+  // have room for EncodedLength(key, value) bytes.
+  static void EncodeEntry(char* buf, SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value);
+
+  Table* TableFor(ValueType type) {
+    return (type == kTypeRangeDeletion) ? &range_del_table_ : &table_;
+  }
+
+  // Record the range tombstone [begin, end)@seq for lookups.
+  void AddToTombstoneList(SequenceNumber seq, const Slice& begin,
+                          const Slice& end);
+
+  // Return the largest sequence number <= snapshot of the range
+  // tombstones that cover user_key, or 0 if there are none.
+  SequenceNumber MaxCoveringTombstoneSequence(const Slice& user_key,
+                                              SequenceNumber snapshot);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;
+  std::atomic<bool> has_range_tombstones_;
+
+  // A copy of the range tombstones that point lookups can binary-search.
+  // Tombstones added since the list was last built wait in
+  // pending_tombstones_, which is folded into the list once it grows.
+  port::Mutex range_del_mutex_;
+  RangeTombstoneList* range_del_list_ GUARDED_BY(range_del_mutex_);
+  std::vector<RangeTombstone> pending_tombstones_ GUARDED_BY(range_del_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,125 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+}  // namespace
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : user_comparator_(user_comparator), finished_(false) {}
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber seq) {
+  assert(!finished_);
+  if (user_comparator_->Compare(begin, end) < 0) {
+    tombstones_.push_back(RangeTombstone(begin, end, seq));
+  }
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::AddAll(const RangeTombstoneList& other) {
+  assert(!finished_);
+  tombstones_.insert(tombstones_.end(), other.tombstones_.begin(),
+                     other.tombstones_.end());
+}
+
+void RangeTombstoneList::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  // Cut the key space at every begin and end key, and record in each
+  // piece the tombstones that span it.
+  UserKeyLess less;
+  less.ucmp = user_comparator_;
+  std::vector<std::string> bounds;
+  bounds.reserve(2 * tombstones_.size());
+  for (const RangeTombstone& t : tombstones_) {
+    bounds.push_back(t.begin);
+    bounds.push_back(t.end);
+  }
+  std::sort(bounds.begin(), bounds.end(), less);
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [this](const std::string& a, const std::string& b) {
+                             return user_comparator_->Compare(a, b) == 0;
+                           }),
+               bounds.end());
+
+  std::vector<std::vector<SequenceNumber>> seqs(bounds.size());
+  for (const RangeTombstone& t : tombstones_) {
+    size_t i = std::lower_bound(bounds.begin(), bounds.end(), t.begin, less) -
+               bounds.begin();
+    for (; less(bounds[i], t.end); i++) {
+      seqs[i].push_back(t.seq);
+    }
+  }
+
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    if (seqs[i].empty()) continue;
+    Fragment f;
+    f.begin = bounds[i];
+    f.end = bounds[i + 1];
+    f.seqs.swap(seqs[i]);
+    std::sort(f.seqs.begin(), f.seqs.end(), std::greater<SequenceNumber>());
+    f.seqs.erase(std::unique(f.seqs.begin(), f.seqs.end()), f.seqs.end());
+    fragments_.push_back(f);
+  }
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(finished_);
+  // Find the last fragment that begins at or before user_key.
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (user_comparator_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0) {
+    return 0;
+  }
+  const Fragment& f = fragments_[left - 1];
+  if (user_comparator_->Compare(user_key, f.end) >= 0) {
+    return 0;
+  }
+  std::vector<SequenceNumber>::const_iterator it =
+      std::lower_bound(f.seqs.begin(), f.seqs.end(), snapshot,
+                       std::greater<SequenceNumber>());
+  return (it == f.seqs.end()) ? 0 : *it;
+}
+
+}  // namespace leveldb
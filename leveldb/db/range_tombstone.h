@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by DB::DeleteRange(), hides every entry
+// whose user key is in [begin, end) and whose sequence number is smaller
+// than the tombstone's.  Memtables and tables keep their range tombstones
+// apart from their other entries, as (begin, seq, kTypeRangeDeletion) =>
+// end entries.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct RangeTombstone {
+  RangeTombstone() : seq(0) {}
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), seq(s) {}
+
+  std::string begin;  // Inclusive
+  std::string end;    // Exclusive
+  SequenceNumber seq;
+};
+
+// A set of range tombstones that answers which of them cover a key.
+//
+// Tombstones are added with Add() or AddAll(), then Finish() splits them
+// into non-overlapping fragments so that lookups take logarithmic time.
+// Once finished, a list is immutable and may be used by several threads
+// without external synchronization.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  // REQUIRES: Finish() has not been called.
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add the tombstones yielded by "iter", which must hold range tombstone
+  // entries in the format described at the top of this file.  Does not
+  // take ownership of "iter".
+  // REQUIRES: Finish() has not been called.
+  Status AddAll(Iterator* iter);
+
+  // Add every tombstone of "other".
+  // REQUIRES: Finish() has not been called.
+  void AddAll(const RangeTombstoneList& other);
+
+  void Finish();
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // The tombstones that were added, in the order they were added.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Return the largest sequence number that is <= snapshot of the
+  // tombstones that cover "user_key", or 0 if there are none.
+  // REQUIRES: Finish() has been called.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Return true iff an entry for "user_key" with sequence number "seq"
+  // is hidden from readers of "snapshot".
+  // REQUIRES: Finish() has been called.
+  bool ShouldDelete(const Slice& user_key, SequenceNumber seq,
+                    SequenceNumber snapshot) const {
+    return MaxCoveringSequence(user_key, snapshot) > seq;
+  }
+
+ private:
+  // A piece of the key space, [begin, end), and the sequence numbers of
+  // the tombstones covering it, in decreasing order.
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    std::vector<SequenceNumber> seqs;
+  };
+
+  const Comparator* const user_comparator_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;  // Sorted by begin, disjoint
+  bool finished_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+class RangeTombstoneTest : public testing::Test {
+ public:
+  RangeTombstoneTest() : list_(BytewiseComparator()) {}
+
+  SequenceNumber Covering(const char* key, SequenceNumber snapshot = 1000) {
+    return list_.MaxCoveringSequence(key, snapshot);
+  }
+
+  RangeTombstoneList list_;
+};
+
+TEST_F(RangeTombstoneTest, Empty) {
+  list_.Add("c", "c", 10);
+  list_.Add("d", "a", 10);
+  ASSERT_TRUE(list_.empty());
+  list_.Finish();
+  ASSERT_EQ(0, Covering("a"));
+  ASSERT_EQ(0, Covering("c"));
+}
+
+TEST_F(RangeTombstoneTest, Single) {
+  list_.Add("b", "d", 10);
+  list_.Finish();
+  ASSERT_EQ(0, Covering("a"));
+  ASSERT_EQ(10, Covering("b"));
+  ASSERT_EQ(10, Covering("c"));
+  ASSERT_EQ(10, Covering("cz"));
+  ASSERT_EQ(0, Covering("d"));
+  ASSERT_EQ(0, Covering("e"));
+  ASSERT_EQ(0, Covering("c", 9));
+  ASSERT_TRUE(list_.ShouldDelete("c", 9, 1000));
+  ASSERT_TRUE(!list_.ShouldDelete("c", 10, 1000));
+  ASSERT_TRUE(!list_.ShouldDelete("c", 5, 9));
+}
+
+TEST_F(RangeTombstoneTest, Overlapping) {
+  list_.Add("a", "e", 10);
+  list_.Add("c", "g", 20);
+  list_.Add("d", "f", 5);
+  list_.Add("x", "z", 30);
+  list_.Finish();
+  ASSERT_EQ(10, Covering("a"));
+  ASSERT_EQ(10, Covering("b"));
+  ASSERT_EQ(20, Covering("c"));
+  ASSERT_EQ(20, Covering("e"));
+  ASSERT_EQ(0, Covering("g"));
+  ASSERT_EQ(0, Covering("w"));
+  ASSERT_EQ(30, Covering("y"));
+
+  // Snapshots only see older tombstones
+  ASSERT_EQ(10, Covering("d", 19));
+  ASSERT_EQ(5, Covering("d", 9));
+  ASSERT_EQ(5, Covering("e", 9));
+  ASSERT_EQ(0, Covering("c", 9));
+  ASSERT_EQ(0, Covering("d", 4));
+}
+
+TEST_F(RangeTombstoneTest, AddAll) {
+  RangeTombstoneList other(BytewiseComparator());
+  other.Add("a", "c", 7);
+  other.Add("b", "d", 8);
+  list_.AddAll(other);
+  ASSERT_EQ(2, list_.tombstones().size());
+  list_.Finish();
+  ASSERT_EQ(7, Covering("a"));
+  ASSERT_EQ(8, Covering("b"));
+  ASSERT_EQ(0, Covering("d"));
+}
+
+}  // namespace leveldb
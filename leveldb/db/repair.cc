@@ -14,6 +14,7 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - every value log file is kept
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -31,7 +32,9 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
+#include "db/value_log.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/comparator.h"
@@ -48,7 +51,8 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor,
+                 options.whole_key_filtering),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -119,6 +123,8 @@ class Repairer {
             logs_.push_back(number);
           } else if (type == kTableFile) {
             table_numbers_.push_back(number);
+          } else if (type == kValueLogFile) {
+            value_log_numbers_.push_back(number);
           } else {
             // Ignore other files
           }
@@ -203,7 +209,10 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, nullptr, &meta);
+    delete range_del_iter;
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -276,11 +285,44 @@ class Repairer {
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
+      if (parsed.type == kTypeValueHandle) {
+        ValueHandle handle;
+        Slice input = iter->value();
+        if (handle.DecodeFrom(&input).ok()) {
+          if (t.meta.oldest_value_log == 0 ||
+              handle.file_number() < t.meta.oldest_value_log) {
+            t.meta.oldest_value_log = handle.file_number();
+          }
+          t.meta.value_log_bytes += handle.size();
+        }
+      }
     }
     if (!iter->status().ok()) {
       status = iter->status();
     }
     delete iter;
+
+    // The key range of the table also spans its range tombstones.
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size, &tombstones);
+    }
+    for (const RangeTombstone& r : tombstones.tombstones()) {
+      InternalKey begin(r.begin, r.seq, kTypeRangeDeletion);
+      InternalKey end(r.end, kMaxSequenceNumber, kTypeRangeDeletion);
+      if (empty || icmp_.Compare(begin, t.meta.smallest) < 0) {
+        t.meta.smallest = begin;
+      }
+      if (empty || icmp_.Compare(end, t.meta.largest) > 0) {
+        t.meta.largest = end;
+      }
+      empty = false;
+      if (r.seq > t.max_sequence) {
+        t.max_sequence = r.seq;
+      }
+      t.meta.has_range_deletions = true;
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +354,14 @@ class Repairer {
       counter++;
     }
     delete iter;
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    table_cache_->AddRangeTombstones(t.meta.number, t.meta.file_size,
+                                     &tombstones);
+    for (const RangeTombstone& r : tombstones.tombstones()) {
+      builder->AddRangeTombstone(
+          InternalKey(r.begin, r.seq, kTypeRangeDeletion).Encode(), r.end);
+      counter++;
+    }
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -369,7 +419,16 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_deletions,
+                    t.meta.oldest_value_log, t.meta.value_log_bytes);
+    }
+    for (size_t i = 0; i < value_log_numbers_.size(); i++) {
+      uint64_t file_size;
+      if (env_->GetFileSize(ValueLogFileName(dbname_, value_log_numbers_[i]),
+                            &file_size)
+              .ok()) {
+        edit_.AddValueLog(value_log_numbers_[i], file_size);
+      }
     }
 
     // std::fprintf(stderr,
@@ -437,6 +496,7 @@ class Repairer {
 
   std::vector<std::string> manifests_;
   std::vector<uint64_t> table_numbers_;
+  std::vector<uint64_t> value_log_numbers_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
@@ -365,4 +365,71 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert interleaved keys with InsertConcurrently().
+struct ConcurrentInsertState {
+  static constexpr int kNumThreads = 4;
+  static constexpr int kKeysPerThread = 20000;
+
+  ConcurrentInsertState() : list(cmp, &arena), done_cv(&mu), num_done(0) {}
+
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list;
+  port::Mutex mu;
+  port::CondVar done_cv;
+  int num_done GUARDED_BY(mu);
+};
+
+struct ConcurrentInserter {
+  ConcurrentInsertState* state;
+  int id;
+};
+
+static void ConcurrentInsert(void* arg) {
+  ConcurrentInserter* inserter = reinterpret_cast<ConcurrentInserter*>(arg);
+  ConcurrentInsertState* state = inserter->state;
+  for (int i = 0; i < ConcurrentInsertState::kKeysPerThread; i++) {
+    state->list.InsertConcurrently(
+        static_cast<Key>(i) * ConcurrentInsertState::kNumThreads +
+        inserter->id);
+  }
+  state->mu.Lock();
+  state->num_done++;
+  state->done_cv.Signal();
+  state->mu.Unlock();
+}
+
+TEST(SkipTest, InsertConcurrently) {
+  ConcurrentInsertState state;
+  ConcurrentInserter inserters[ConcurrentInsertState::kNumThreads];
+  for (int id = 0; id < ConcurrentInsertState::kNumThreads; id++) {
+    inserters[id].state = &state;
+    inserters[id].id = id;
+    Env::Default()->StartThread(ConcurrentInsert, &inserters[id]);
+  }
+  state.mu.Lock();
+  while (state.num_done < ConcurrentInsertState::kNumThreads) {
+    state.done_cv.Wait();
+  }
+  state.mu.Unlock();
+
+  // Every key is present, in order.
+  const Key kNumKeys = static_cast<Key>(ConcurrentInsertState::kNumThreads) *
+                       ConcurrentInsertState::kKeysPerThread;
+  SkipList<Key, Comparator>::Iterator iter(&state.list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < kNumKeys; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < kNumKeys; k += 97) {
+    ASSERT_TRUE(state.list.Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+}
+
 }  // namespace leveldb
@@ -0,0 +1,133 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& raw_options)
+      : icmp(raw_options.comparator),
+        ipolicy(raw_options.filter_policy, raw_options.prefix_extractor,
+                raw_options.whole_key_filtering),
+        options(raw_options),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0) {
+    options.comparator = &icmp;
+    if (raw_options.filter_policy != nullptr) {
+      options.filter_policy = &ipolicy;
+    }
+  }
+
+  // Drop the file in progress, if any.
+  void Abandon() {
+    if (builder != nullptr) {
+      builder->Abandon();
+      delete builder;
+      builder = nullptr;
+      file->Close();
+      delete file;
+      file = nullptr;
+      options.env->RemoveFile(fname);
+    }
+  }
+
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // User key of the last entry added
+  uint64_t file_size;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  rep_->Abandon();
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  r->Abandon();
+  r->fname = fname;
+  r->last_key.clear();
+  r->file_size = 0;
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (s.ok()) {
+    r->builder = new TableBuilder(r->options, r->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  if (r->builder->NumEntries() > 0 &&
+      r->icmp.user_comparator()->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in increasing order",
+                                   key);
+  }
+  r->last_key.assign(key.data(), key.size());
+
+  // Entries carry sequence number 0; the database gives them the
+  // sequence number they are ingested at.
+  std::string ikey;
+  AppendInternalKey(&ikey, ParsedInternalKey(key, 0,
+                                             deletion ? kTypeDeletion
+                                                      : kTypeValue));
+  r->builder->Add(ikey, value);
+  r->file_size = r->builder->FileSize();
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  if (r->builder->NumEntries() == 0) {
+    r->Abandon();
+    return Status::InvalidArgument("no entries added", r->fname);
+  }
+  Status s = r->builder->Finish();
+  r->file_size = r->builder->FileSize();
+  delete r->builder;
+  r->builder = nullptr;
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->file;
+  r->file = nullptr;
+  if (!s.ok()) {
+    r->options.env->RemoveFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const { return rep_->file_size; }
+
+}  // namespace leveldb
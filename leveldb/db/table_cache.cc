@@ -5,30 +5,138 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_tombstone.h"
+#include "db/value_log.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/perf_timer.h"
+#include "util/readahead_file.h"
+#include "util/stop_watch.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* range_tombstones;  // nullptr if the table has none
+  SequenceNumber global_sequence;        // 0 if the table has none
 };
 
+namespace {
+
+// Store in *dst the internal key "ikey" with its sequence number replaced
+// by "seq".
+void ReplaceSequence(const Slice& ikey, SequenceNumber seq, std::string* dst) {
+  const uint64_t tag = DecodeFixed64(ikey.data() + ikey.size() - 8);
+  dst->assign(ikey.data(), ikey.size() - 8);
+  PutFixed64(dst, (seq << 8) | (tag & 0xff));
+}
+
+// Presents the entries of an ingested table, which were written with
+// sequence number 0, as having the table's global sequence number.
+class GlobalSequenceIterator : public Iterator {
+ public:
+  GlobalSequenceIterator(Iterator* iter, SequenceNumber seq)
+      : iter_(iter), seq_(seq) {}
+
+  ~GlobalSequenceIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    UpdateKey();
+  }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    UpdateKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    UpdateKey();
+  }
+  void Next() override {
+    iter_->Next();
+    UpdateKey();
+  }
+  void Prev() override {
+    iter_->Prev();
+    UpdateKey();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void UpdateKey() {
+    if (iter_->Valid()) {
+      ReplaceSequence(iter_->key(), seq_, &key_);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber seq_;
+  std::string key_;
+};
+
+// Passes the entries found in an ingested table on to the handler of a
+// lookup with their global sequence number, unless that makes them newer
+// than the snapshot of the lookup.
+struct GlobalSequenceSaver {
+  SequenceNumber global_sequence;
+  SequenceNumber snapshot;
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+};
+
+void SaveWithGlobalSequence(void* arg, const Slice& k, const Slice& v) {
+  const GlobalSequenceSaver* saver =
+      reinterpret_cast<const GlobalSequenceSaver*>(arg);
+  if (saver->global_sequence > saver->snapshot) {
+    return;
+  }
+  std::string key;
+  ReplaceSequence(k, saver->global_sequence, &key);
+  (*saver->handle_result)(saver->arg, key, v);
+}
+
+GlobalSequenceSaver MakeGlobalSequenceSaver(
+    SequenceNumber global_sequence, const Slice& k, void* arg,
+    void (*handle_result)(void*, const Slice&, const Slice&)) {
+  GlobalSequenceSaver saver;
+  saver.global_sequence = global_sequence;
+  saver.snapshot = DecodeFixed64(k.data() + k.size() - 8) >> 8;
+  saver.arg = arg;
+  saver.handle_result = handle_result;
+  return saver;
+}
+
+}  // namespace
+
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
 }
 
+static void DeleteValueLogEntry(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
   cache->Release(h);
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<Table*>(arg1);
+  delete reinterpret_cast<RandomAccessFile*>(arg2);
+}
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
@@ -38,6 +146,22 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
 
 TableCache::~TableCache() { delete cache_; }
 
+Status TableCache::OpenTableFile(uint64_t file_number, bool direct,
+                                 RandomAccessFile** file) {
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if ((direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                : env_->NewRandomAccessFile(old_fname, file))
+            .ok()) {
+      s = Status::OK();
+    }
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
   Status s;
@@ -45,19 +169,36 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
-  if (*handle == nullptr) {
-    std::string fname = TableFileName(dbname_, file_number);
+  if (*handle != nullptr) {
+    RecordTick(options_.statistics, kTableCacheHit);
+  } else {
+    RecordTick(options_.statistics, kTableCacheMiss);
+    PerfCount(&PerfContext::table_open_count);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
+    {
+      StopWatch sw(env_, options_.statistics, kTableOpenMicros);
+      s = OpenTableFile(file_number, false, &file);
+      if (s.ok()) {
+        s = Table::Open(options_, file, file_size, &table);
       }
     }
+    RangeTombstoneList* range_tombstones = nullptr;
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      Iterator* iter = table->NewRangeTombstoneIterator();
+      if (iter != nullptr) {
+        range_tombstones = new RangeTombstoneList(
+            static_cast<const InternalKeyComparator*>(options_.comparator)
+                ->user_comparator());
+        s = range_tombstones->AddAll(iter);
+        range_tombstones->Finish();
+        delete iter;
+        if (!s.ok()) {
+          delete range_tombstones;
+          delete table;
+          table = nullptr;
+        }
+      }
     }
 
     if (!s.ok()) {
@@ -69,12 +210,32 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_tombstones = range_tombstones;
+      tf->global_sequence = GlobalSequence(file_number);
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
   return s;
 }
 
+Status TableCache::FindValueLog(uint64_t file_number,
+                                Cache::Handle** handle) {
+  Status s;
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == nullptr) {
+    RandomAccessFile* file = nullptr;
+    s = env_->NewRandomAccessFile(ValueLogFileName(dbname_, file_number),
+                                  &file);
+    if (s.ok()) {
+      *handle = cache_->Insert(key, file, 1, &DeleteValueLogEntry);
+    }
+  }
+  return s;
+}
+
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
                                   Table** tableptr) {
@@ -88,8 +249,12 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
     return NewErrorIterator(s);
   }
 
-  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  Table* table = tf->table;
   Iterator* result = table->NewIterator(options);
+  if (tf->global_sequence != 0) {
+    result = new GlobalSequenceIterator(result, tf->global_sequence);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -97,24 +262,195 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size) {
+  if (!options_.use_direct_io_for_flush_and_compaction &&
+      options_.compaction_readahead_size == 0) {
+    return NewIterator(options, file_number, file_size);
+  }
+
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  Status s = OpenTableFile(
+      file_number, options_.use_direct_io_for_flush_and_compaction, &file);
+  if (s.ok() && options_.compaction_readahead_size > 0) {
+    file = NewReadaheadRandomAccessFile(file, file_size,
+                                        options_.compaction_readahead_size);
+  }
+  if (s.ok()) {
+    s = Table::Open(options_, file, file_size, &table);
+  }
+  if (!s.ok()) {
+    delete file;
+    return NewErrorIterator(s);
+  }
+  Iterator* result = table->NewIterator(options);
+  const SequenceNumber global_sequence = GlobalSequence(file_number);
+  if (global_sequence != 0) {
+    result = new GlobalSequenceIterator(result, global_sequence);
+  }
+  result->RegisterCleanup(&DeleteTableAndFile, table, file);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
+  PerfCount(&PerfContext::get_from_table_count);
+  PerfTimer find_timer(&PerfContext::find_table_nanos);
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  find_timer.Stop();
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->global_sequence == 0) {
+      s = tf->table->InternalGet(options, k, arg, handle_result);
+    } else {
+      GlobalSequenceSaver saver =
+          MakeGlobalSequenceSaver(tf->global_sequence, k, arg, handle_result);
+      s = tf->table->InternalGet(options, k, &saver, &SaveWithGlobalSequence);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+void TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                          uint64_t file_size, int n, const Slice* keys,
+                          void* const* args, Status* statuses,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&)) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->global_sequence == 0) {
+      tf->table->InternalMultiGet(options, n, keys, args, statuses,
+                                  handle_result);
+    } else {
+      std::vector<GlobalSequenceSaver> savers;
+      std::vector<void*> saver_args(n);
+      savers.reserve(n);
+      for (int i = 0; i < n; i++) {
+        savers.push_back(MakeGlobalSequenceSaver(tf->global_sequence, keys[i],
+                                                 args[i], handle_result));
+        saver_args[i] = &savers[i];
+      }
+      tf->table->InternalMultiGet(options, n, keys, saver_args.data(),
+                                  statuses, &SaveWithGlobalSequence);
+    }
+    cache_->Release(handle);
+  } else {
+    for (int i = 0; i < n; i++) {
+      statuses[i] = s;
+    }
+  }
+}
+
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                                const Slice& k) {
+  bool may_match = true;
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    may_match = t->PrefixMayMatch(k);
+    cache_->Release(handle);
+  }
+  return may_match;
+}
+
+Status TableCache::MaxCoveringTombstoneSequence(uint64_t file_number,
+                                                uint64_t file_size,
+                                                const Slice& user_key,
+                                                SequenceNumber snapshot,
+                                                SequenceNumber* seq) {
+  *seq = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (list != nullptr) {
+      *seq = list->MaxCoveringSequence(user_key, snapshot);
+    }
     cache_->Release(handle);
   }
   return s;
 }
 
+Status TableCache::AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                                      RangeTombstoneList* list) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* file_list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (file_list != nullptr) {
+      list->AddAll(*file_list);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::ReadValue(const ReadOptions& options, const Slice& handle,
+                             std::string* value) {
+  ValueHandle vh;
+  Slice input = handle;
+  Status s = vh.DecodeFrom(&input);
+  if (!s.ok()) {
+    return s;
+  }
+  Cache::Handle* cache_handle = nullptr;
+  s = FindValueLog(vh.file_number(), &cache_handle);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file =
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(cache_handle));
+  const size_t n = static_cast<size_t>(vh.size());
+  char* scratch = new char[n];
+  Slice contents;
+  s = file->Read(vh.offset(), n, &contents, scratch);
+  if (s.ok()) {
+    if (contents.size() != n) {
+      s = Status::Corruption("truncated value log record");
+    } else {
+      Slice v;
+      s = ParseValueLogRecord(contents, options.verify_checksums, &v);
+      if (s.ok()) {
+        value->assign(v.data(), v.size());
+      }
+    }
+  }
+  // "contents" may point into the file's memory map
+  cache_->Release(cache_handle);
+  delete[] scratch;
+  return s;
+}
+
+void TableCache::SetGlobalSequence(uint64_t file_number, SequenceNumber seq) {
+  MutexLock l(&mutex_);
+  global_sequences_[file_number] = seq;
+}
+
+SequenceNumber TableCache::GlobalSequence(uint64_t file_number) {
+  MutexLock l(&mutex_);
+  auto it = global_sequences_.find(file_number);
+  return (it == global_sequences_.end()) ? 0 : it->second;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   cache_->Erase(Slice(buf, sizeof(buf)));
+  MutexLock l(&mutex_);
+  global_sequences_.erase(file_number);
 }
 
 }  // namespace leveldb
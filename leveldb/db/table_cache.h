@@ -8,16 +8,19 @@
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
 #include <cstdint>
+#include <map>
 #include <string>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
+#include "port/thread_annotations.h"
 
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 class TableCache {
  public:
@@ -38,22 +41,76 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Like NewIterator(), for reading the specified file as a compaction
+  // input.  With options.use_direct_io_for_flush_and_compaction or
+  // options.compaction_readahead_size, the file is opened apart from the
+  // cache, for direct I/O or with readahead as requested, and closed when
+  // the returned iterator is deleted.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
-  // Evict any entry for the specified file number
+  // Batched form of Get() for "n" internal keys sorted in increasing
+  // order.  For each i, calls (*handle_result)(args[i], found_key,
+  // found_value) if a seek to keys[i] finds an entry, and stores the
+  // outcome of that lookup in statuses[i].
+  void MultiGet(const ReadOptions& options, uint64_t file_number,
+                uint64_t file_size, int n, const Slice* keys,
+                void* const* args, Status* statuses,
+                void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Return false if the filter of the specified file says that no entry
+  // at or after internal key "k" shares the prefix of "k".  Errors are
+  // treated as potential matches.
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      const Slice& k);
+
+  // Store in *seq the largest sequence number <= snapshot of the range
+  // tombstones in the specified file that cover "user_key", or 0 if there
+  // are none.
+  Status MaxCoveringTombstoneSequence(uint64_t file_number,
+                                      uint64_t file_size,
+                                      const Slice& user_key,
+                                      SequenceNumber snapshot,
+                                      SequenceNumber* seq);
+
+  // Add the range tombstones of the specified file to *list.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneList* list);
+
+  // Read into *value the value that "handle", an encoded ValueHandle,
+  // locates in a value log file.  "handle" may point into *value.
+  Status ReadValue(const ReadOptions& options, const Slice& handle,
+                   std::string* value);
+
+  // Read the entries of the specified table, an ingested one whose
+  // entries were written with sequence number 0, as having sequence
+  // number "seq".  Must be called before the table is first read.
+  void SetGlobalSequence(uint64_t file_number, SequenceNumber seq);
+
+  // Evict any entry for the specified table or value log file number
   void Evict(uint64_t file_number);
 
  private:
+  Status OpenTableFile(uint64_t file_number, bool direct,
+                       RandomAccessFile** file);
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindValueLog(uint64_t file_number, Cache::Handle**);
+  SequenceNumber GlobalSequence(uint64_t file_number);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+
+  port::Mutex mutex_;
+  // Global sequence numbers of the ingested tables that have one
+  std::map<uint64_t, SequenceNumber> global_sequences_ GUARDED_BY(mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/value_log.h"
+
+#include <cassert>
+
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+void ValueHandle::EncodeTo(std::string* dst) const {
+  // Sanity check that all fields have been set
+  assert(file_number_ != 0);
+  PutVarint64(dst, file_number_);
+  PutVarint64(dst, offset_);
+  PutVarint64(dst, size_);
+}
+
+Status ValueHandle::DecodeFrom(Slice* input) {
+  if (GetVarint64(input, &file_number_) && GetVarint64(input, &offset_) &&
+      GetVarint64(input, &size_)) {
+    return Status::OK();
+  } else {
+    return Status::Corruption("bad value handle");
+  }
+}
+
+ValueLogBuilder::ValueLogBuilder(Env* env, const std::string& dbname,
+                                 uint64_t file_number)
+    : env_(env),
+      fname_(ValueLogFileName(dbname, file_number)),
+      file_number_(file_number),
+      file_(nullptr),
+      file_size_(0),
+      closed_(false) {}
+
+ValueLogBuilder::~ValueLogBuilder() {
+  assert(closed_ || file_ == nullptr);
+  delete file_;
+}
+
+Status ValueLogBuilder::Add(const Slice& user_key, const Slice& value,
+                            ValueHandle* handle) {
+  assert(!closed_);
+  if (file_ == nullptr) {
+    Status s = env_->NewWritableFile(fname_, &file_);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  record_.assign(4, '\0');  // Room for the checksum
+  PutVarint32(&record_, static_cast<uint32_t>(user_key.size()));
+  record_.append(user_key.data(), user_key.size());
+  record_.append(value.data(), value.size());
+  uint32_t crc = crc32c::Value(record_.data() + 4, record_.size() - 4);
+  EncodeFixed32(&record_[0], crc32c::Mask(crc));
+
+  Status s = file_->Append(record_);
+  if (s.ok()) {
+    handle->set_file_number(file_number_);
+    handle->set_offset(file_size_);
+    handle->set_size(record_.size());
+    file_size_ += record_.size();
+  }
+  return s;
+}
+
+Status ValueLogBuilder::Finish() {
+  assert(!closed_);
+  closed_ = true;
+  if (file_ == nullptr) {
+    return Status::OK();
+  }
+  Status s = file_->Sync();
+  if (s.ok()) {
+    s = file_->Close();
+  }
+  return s;
+}
+
+void ValueLogBuilder::Abandon() {
+  if (!closed_) {
+    closed_ = true;
+    if (file_ != nullptr) {
+      file_->Close();
+    }
+  }
+  if (file_ != nullptr) {
+    env_->RemoveFile(fname_);
+  }
+}
+
+Status ParseValueLogRecord(const Slice& record, bool verify_checksum,
+                           Slice* value) {
+  if (record.size() < 4) {
+    return Status::Corruption("truncated value log record");
+  }
+  if (verify_checksum) {
+    const uint32_t expected = crc32c::Unmask(DecodeFixed32(record.data()));
+    const uint32_t actual = crc32c::Value(record.data() + 4, record.size() - 4);
+    if (actual != expected) {
+      return Status::Corruption("value log record checksum mismatch");
+    }
+  }
+  Slice input(record.data() + 4, record.size() - 4);
+  uint32_t key_length;
+  if (!GetVarint32(&input, &key_length) || key_length > input.size()) {
+    return Status::Corruption("bad value log record");
+  }
+  input.remove_prefix(key_length);
+  *value = input;
+  return Status::OK();
+}
+
+}  // namespace leveldb
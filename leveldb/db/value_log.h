@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A value log file holds the values that Options::value_log_threshold
+// keeps out of the tables, as a sequence of records:
+//
+//    checksum: fixed32      // masked crc32c of the rest of the record
+//    key_length: varint32
+//    key: char[key_length]  // user key the value was written for
+//    value: char[...]       // the rest of the record
+//
+// A table refers to a record through a kTypeValueHandle entry whose value
+// is the encoded ValueHandle of the record.  Value log files are never
+// modified once written.  Compactions copy the values that are still
+// referenced out of the oldest ones, which are deleted once no table
+// refers to them any more.
+
+#ifndef STORAGE_LEVELDB_DB_VALUE_LOG_H_
+#define STORAGE_LEVELDB_DB_VALUE_LOG_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class WritableFile;
+
+// ValueHandle is a pointer to a record of a value log file.
+class ValueHandle {
+ public:
+  // Maximum encoding length of a ValueHandle
+  enum { kMaxEncodedLength = 10 + 10 + 10 };
+
+  ValueHandle() : file_number_(0), offset_(0), size_(0) {}
+
+  // The number of the value log file holding the record.
+  uint64_t file_number() const { return file_number_; }
+  void set_file_number(uint64_t number) { file_number_ = number; }
+
+  // The offset of the record in the file.
+  uint64_t offset() const { return offset_; }
+  void set_offset(uint64_t offset) { offset_ = offset; }
+
+  // The size of the whole record.
+  uint64_t size() const { return size_; }
+  void set_size(uint64_t size) { size_ = size; }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(Slice* input);
+
+ private:
+  uint64_t file_number_;
+  uint64_t offset_;
+  uint64_t size_;
+};
+
+// Writes the records of a new value log file.  The file is only created
+// when the first record is added.
+class ValueLogBuilder {
+ public:
+  ValueLogBuilder(Env* env, const std::string& dbname, uint64_t file_number);
+
+  ValueLogBuilder(const ValueLogBuilder&) = delete;
+  ValueLogBuilder& operator=(const ValueLogBuilder&) = delete;
+
+  // REQUIRES: Either Finish() or Abandon() has been called.
+  ~ValueLogBuilder();
+
+  uint64_t file_number() const { return file_number_; }
+
+  // Return true iff no record has been added.
+  bool empty() const { return file_size_ == 0; }
+
+  // Size of the file generated so far.
+  uint64_t FileSize() const { return file_size_; }
+
+  // Append a record holding "value" for "user_key", and store its
+  // location in *handle.
+  Status Add(const Slice& user_key, const Slice& value, ValueHandle* handle);
+
+  // Sync and close the file, if it was created.
+  Status Finish();
+
+  // Close and remove the file, if it was created.
+  void Abandon();
+
+ private:
+  Env* const env_;
+  const std::string fname_;
+  const uint64_t file_number_;
+  WritableFile* file_;
+  uint64_t file_size_;
+  bool closed_;
+  std::string record_;  // Scratch space for Add()
+};
+
+// Extract into *value the value of "record", a whole value log record
+// as located by a ValueHandle.  *value points into "record".
+Status ParseValueLogRecord(const Slice& record, bool verify_checksum,
+                           Slice* value);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_VALUE_LOG_H_
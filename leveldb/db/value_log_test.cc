@@ -0,0 +1,130 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/value_log.h"
+
+#include "gtest/gtest.h"
+#include "db/filename.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+static const char kDbName[] = "/vlog";
+
+class ValueLogTest : public testing::Test {
+ public:
+  ValueLogTest() : env_(NewMemEnv(Env::Default())) {
+    env_->CreateDir(kDbName);
+  }
+
+  ~ValueLogTest() override { delete env_; }
+
+  // Read the value of the record located by "handle".
+  Status Read(const ValueHandle& handle, bool verify_checksum,
+              std::string* value) {
+    RandomAccessFile* file;
+    Status s = env_->NewRandomAccessFile(
+        ValueLogFileName(kDbName, handle.file_number()), &file);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string scratch(handle.size(), '\0');
+    Slice record;
+    s = file->Read(handle.offset(), handle.size(), &record, &scratch[0]);
+    Slice v;
+    if (s.ok()) {
+      s = ParseValueLogRecord(record, verify_checksum, &v);
+    }
+    if (s.ok()) {
+      value->assign(v.data(), v.size());
+    }
+    delete file;
+    return s;
+  }
+
+  Env* env_;
+};
+
+TEST_F(ValueLogTest, EncodeDecodeHandle) {
+  ValueHandle handle;
+  handle.set_file_number(7);
+  handle.set_offset(1ull << 40);
+  handle.set_size(300);
+  std::string encoded;
+  handle.EncodeTo(&encoded);
+  ASSERT_LE(encoded.size(), ValueHandle::kMaxEncodedLength);
+
+  ValueHandle decoded;
+  Slice input = encoded;
+  ASSERT_TRUE(decoded.DecodeFrom(&input).ok());
+  ASSERT_TRUE(input.empty());
+  ASSERT_EQ(7, decoded.file_number());
+  ASSERT_EQ(1ull << 40, decoded.offset());
+  ASSERT_EQ(300, decoded.size());
+
+  input = Slice(encoded.data(), encoded.size() - 1);
+  ASSERT_TRUE(decoded.DecodeFrom(&input).IsCorruption());
+}
+
+TEST_F(ValueLogTest, Empty) {
+  ValueLogBuilder builder(env_, kDbName, 5);
+  ASSERT_TRUE(builder.empty());
+  ASSERT_TRUE(builder.Finish().ok());
+  ASSERT_EQ(0, builder.FileSize());
+  ASSERT_TRUE(!env_->FileExists(ValueLogFileName(kDbName, 5)));
+}
+
+TEST_F(ValueLogTest, ReadBack) {
+  ValueLogBuilder builder(env_, kDbName, 5);
+  ValueHandle h1, h2, h3;
+  ASSERT_TRUE(builder.Add("foo", "v1", &h1).ok());
+  ASSERT_TRUE(builder.Add("bar", std::string(10000, 'x'), &h2).ok());
+  ASSERT_TRUE(builder.Add("", "", &h3).ok());
+  ASSERT_TRUE(!builder.empty());
+  ASSERT_TRUE(builder.Finish().ok());
+  ASSERT_EQ(h3.offset() + h3.size(), builder.FileSize());
+  ASSERT_EQ(5, h2.file_number());
+  ASSERT_EQ(h1.offset() + h1.size(), h2.offset());
+
+  std::string value;
+  ASSERT_TRUE(Read(h1, true, &value).ok());
+  ASSERT_EQ("v1", value);
+  ASSERT_TRUE(Read(h2, true, &value).ok());
+  ASSERT_EQ(std::string(10000, 'x'), value);
+  ASSERT_TRUE(Read(h3, true, &value).ok());
+  ASSERT_EQ("", value);
+}
+
+TEST_F(ValueLogTest, Corruption) {
+  ValueLogBuilder builder(env_, kDbName, 5);
+  ValueHandle handle;
+  ASSERT_TRUE(builder.Add("foo", "hello", &handle).ok());
+  ASSERT_TRUE(builder.Finish().ok());
+
+  // Flip the last byte of the value.
+  std::string fname = ValueLogFileName(kDbName, 5);
+  std::string contents;
+  ASSERT_TRUE(ReadFileToString(env_, fname, &contents).ok());
+  contents[contents.size() - 1] ^= 1;
+  ASSERT_TRUE(WriteStringToFile(env_, contents, fname).ok());
+
+  std::string value;
+  ASSERT_TRUE(Read(handle, true, &value).IsCorruption());
+  ASSERT_TRUE(Read(handle, false, &value).ok());
+  ASSERT_EQ("helln", value);
+
+  Slice v;
+  ASSERT_TRUE(ParseValueLogRecord("abc", false, &v).IsCorruption());
+}
+
+TEST_F(ValueLogTest, Abandon) {
+  ValueLogBuilder builder(env_, kDbName, 5);
+  ValueHandle handle;
+  ASSERT_TRUE(builder.Add("foo", "hello", &handle).ok());
+  builder.Abandon();
+  ASSERT_TRUE(!env_->FileExists(ValueLogFileName(kDbName, 5)));
+}
+
+}  // namespace leveldb
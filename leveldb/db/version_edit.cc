@@ -20,7 +20,11 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewFileWithRangeDeletions = 10,  // Like kNewFile
+  kNewValueLog = 11,
+  kValueLogRefs = 12,   // Value log references of the preceding new file
+  kGlobalSequence = 13  // Global sequence number of the preceding new file
 };
 
 void VersionEdit::Clear() {
@@ -37,6 +41,7 @@ void VersionEdit::Clear() {
   compact_pointers_.clear();
   deleted_files_.clear();
   new_files_.clear();
+  new_value_logs_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -75,12 +80,28 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDeletions
+                                           : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.oldest_value_log != 0) {
+      PutVarint32(dst, kValueLogRefs);
+      PutVarint64(dst, f.oldest_value_log);
+      PutVarint64(dst, f.value_log_bytes);
+    }
+    if (f.global_sequence != 0) {
+      PutVarint32(dst, kGlobalSequence);
+      PutVarint64(dst, f.global_sequence);
+    }
+  }
+
+  for (const auto& value_log_kvp : new_value_logs_) {
+    PutVarint32(dst, kNewValueLog);
+    PutVarint64(dst, value_log_kvp.first);   // file number
+    PutVarint64(dst, value_log_kvp.second);  // file size
   }
 }
 
@@ -112,6 +133,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   // Temporary storage for parsing
   int level;
   uint64_t number;
+  uint64_t size;
   FileMetaData f;
   Slice str;
   InternalKey key;
@@ -176,16 +198,46 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDeletions:
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kValueLogRefs:
+        if (!new_files_.empty() && GetVarint64(&input, &number) &&
+            GetVarint64(&input, &size)) {
+          FileMetaData& last = new_files_.back().second;
+          last.oldest_value_log = number;
+          last.value_log_bytes = size;
+        } else {
+          msg = "value log refs";
+        }
+        break;
+
+      case kGlobalSequence:
+        if (!new_files_.empty() &&
+            GetVarint64(&input, &new_files_.back().second.global_sequence)) {
+          // Done
+        } else {
+          msg = "global sequence number";
+        }
+        break;
+
+      case kNewValueLog:
+        if (GetVarint64(&input, &number) && GetVarint64(&input, &size)) {
+          new_value_logs_[number] = size;
+        } else {
+          msg = "new value log";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +302,25 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" rangedel");
+    }
+    if (f.oldest_value_log != 0) {
+      r.append(" vlog ");
+      AppendNumberTo(&r, f.oldest_value_log);
+      r.append(" ");
+      AppendNumberTo(&r, f.value_log_bytes);
+    }
+    if (f.global_sequence != 0) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.global_sequence);
+    }
+  }
+  for (const auto& value_log_kvp : new_value_logs_) {
+    r.append("\n  AddValueLog: ");
+    AppendNumberTo(&r, value_log_kvp.first);
+    r.append(" ");
+    AppendNumberTo(&r, value_log_kvp.second);
   }
   r.append("\n}\n");
   return r;
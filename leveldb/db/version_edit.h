@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 #define STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 
+#include <map>
 #include <set>
 #include <utility>
 #include <vector>
@@ -16,7 +17,15 @@ namespace leveldb {
 class VersionSet;//forward declaration
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        has_range_deletions(false),
+        oldest_value_log(0),
+        value_log_bytes(0),
+        global_sequence(0),
+        being_compacted(false) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +33,13 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool has_range_deletions;  // Table holds range tombstones
+  uint64_t oldest_value_log;  // Oldest value log file referenced, or 0
+  uint64_t value_log_bytes;   // Bytes of value log records referenced
+  // Sequence number the entries of an ingested table are read with, or 0
+  // if they are read as written
+  SequenceNumber global_sequence;
+  bool being_compacted;  // Input of a running compaction (guarded by DB mutex)
 };
 
 class VersionEdit {
@@ -59,17 +75,37 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  // including the bounds of its range tombstones
+  // REQUIRES: "oldest_value_log" is the oldest value log file the table
+  // refers to (0 if none), and "value_log_bytes" the size of the value log
+  // records it refers to
+  // REQUIRES: "global_sequence" is 0, or the sequence number that all the
+  // entries of the table, which were written with sequence number 0, are
+  // to be read with
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               bool has_range_deletions = false,
+               uint64_t oldest_value_log = 0, uint64_t value_log_bytes = 0,
+               SequenceNumber global_sequence = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
+    f.oldest_value_log = oldest_value_log;
+    f.value_log_bytes = value_log_bytes;
+    f.global_sequence = global_sequence;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the specified value log file.  It is deleted once no table
+  // refers to it or to an older value log file.
+  void AddValueLog(uint64_t file, uint64_t file_size) {
+    new_value_logs_[file] = file_size;
+  }
+
   // Delete the specified "file" from the specified "level".
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -99,6 +135,7 @@ class VersionEdit {
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector<std::pair<int, FileMetaData>> new_files_;
+  std::map<uint64_t, uint64_t> new_value_logs_;  // File number -> size
 };
 
 }  // namespace leveldb
@@ -26,7 +26,11 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 (i % 2) == 1, (i % 3) == 0 ? 0 : kBig + 800 + i,
+                 (i % 3) == 0 ? 0 : kBig + 850 + i,
+                 (i % 2) == 0 ? 0 : kBig + 870 + i);
+    edit.AddValueLog(kBig + 950 + i, kBig + 980 + i);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
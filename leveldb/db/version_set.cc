@@ -6,11 +6,14 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <iterator>
+#include <limits>
 
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -51,6 +54,59 @@ static double MaxBytesForLevel(const Options* options, int level) {
   return result;
 }
 
+// Store in max_bytes[level] the size limit of every level above level-0
+// under Options::level_compaction_dynamic_level_bytes, given the files of
+// every level, and return the level that level-0 files are compacted into.
+// Each level is ten times smaller than the next one, working back from the
+// largest level, and the levels that would be smaller than the level-1
+// limit of MaxBytesForLevel() are left empty.
+static int DynamicMaxBytesForLevels(const Options* options,
+                                    const std::vector<FileMetaData*>* files,
+                                    double* max_bytes) {
+  const double base_max = MaxBytesForLevel(options, 1);
+  const double base_min = base_max / 10;
+
+  int first_level = config::kNumLevels - 1;  // First non-empty level
+  uint64_t largest = 0;
+  for (int level = config::kNumLevels - 1; level >= 1; level--) {
+    uint64_t level_bytes = 0;
+    for (FileMetaData* f : files[level]) {
+      level_bytes += f->file_size;
+    }
+    if (level_bytes > 0) {
+      first_level = level;
+      largest = std::max(largest, level_bytes);
+    }
+  }
+
+  // Size of the first non-empty level if the largest one were the last.
+  double bytes = largest;
+  for (int level = config::kNumLevels - 2; level >= first_level; level--) {
+    bytes /= 10;
+  }
+  int base_level = first_level;
+  if (bytes <= base_min) {
+    bytes = base_min;
+  } else {
+    // Fill the levels above the first one until it is small enough.
+    while (base_level > 1 && bytes > base_max) {
+      base_level--;
+      bytes /= 10;
+    }
+    bytes = std::min(bytes, base_max);
+  }
+
+  // Limits below base_max would compact the levels above level-0 ahead of
+  // level-0 itself.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (level > base_level) {
+      bytes *= 10;
+    }
+    max_bytes[level] = std::max(bytes, base_max);
+  }
+  return base_level;
+}
+
 static uint64_t MaxFileSizeForLevel(const Options* options, int level) {
   // We could vary per level to reduce number of files?
   return TargetFileSize(options);
@@ -164,24 +220,32 @@ class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
                        const std::vector<FileMetaData*>* flist)
-      : icmp_(icmp), flist_(flist), index_(flist->size()) {  // Marks as invalid
-  }
-  bool Valid() const override { return index_ < flist_->size(); }
+      : LevelFileNumIterator(icmp, flist, 0, flist->size()) {}
+  // Only yields the files of *flist in [begin, end).
+  LevelFileNumIterator(const InternalKeyComparator& icmp,
+                       const std::vector<FileMetaData*>* flist,
+                       uint32_t begin, uint32_t end)
+      : icmp_(icmp),
+        flist_(flist),
+        begin_(begin),
+        end_(end),
+        index_(end) {  // Marks as invalid
+  }
+  bool Valid() const override { return index_ < end_; }
   void Seek(const Slice& target) override {
-    index_ = FindFile(icmp_, *flist_, target);
-  }
-  void SeekToFirst() override { index_ = 0; }
-  void SeekToLast() override {
-    index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    index_ = std::min<uint32_t>(
+        std::max<uint32_t>(FindFile(icmp_, *flist_, target), begin_), end_);
   }
+  void SeekToFirst() override { index_ = begin_; }
+  void SeekToLast() override { index_ = begin_ == end_ ? end_ : end_ - 1; }
   void Next() override {
     assert(Valid());
     index_++;
   }
   void Prev() override {
     assert(Valid());
-    if (index_ == 0) {
-      index_ = flist_->size();  // Marks as invalid
+    if (index_ == begin_) {
+      index_ = end_;  // Marks as invalid
     } else {
       index_--;
     }
@@ -201,6 +265,8 @@ class Version::LevelFileNumIterator : public Iterator {
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const uint32_t begin_;
+  const uint32_t end_;
   uint32_t index_;
 
   // Backing store for value().  Holds the file number and size.
@@ -219,19 +285,75 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(options,
+                                        DecodeFixed64(file_value.data()),
+                                        DecodeFixed64(file_value.data() + 8));
+  }
+}
+
+// Lets a prefix Seek() skip a file without reading any of its blocks.
+static bool FileMayMatchPrefix(void* arg, const ReadOptions& /*options*/,
+                               const Slice& file_value, const Slice& target) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return true;  // GetFileIterator() reports the corruption
+  }
+  return cache->PrefixMayMatch(DecodeFixed64(file_value.data()),
+                               DecodeFixed64(file_value.data() + 8), target);
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
-  return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+  const InternalKeyComparator& icmp = vset_->icmp_;
+  const std::vector<FileMetaData*>& files = files_[level];
+  // Leave out the files outside the bounds, so they are never opened
+  uint32_t begin = 0;
+  uint32_t end = files.size();
+  if (options.iterate_lower_bound != nullptr) {
+    begin = FindFile(icmp, files, *options.iterate_lower_bound);
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    end = FindFile(icmp, files, *options.iterate_upper_bound);
+    if (end < files.size() &&
+        icmp.Compare(files[end]->smallest.Encode(),
+                     *options.iterate_upper_bound) < 0) {
+      end++;  // The file straddles the upper bound
+    }
+  }
+  Iterator* index_iter =
+      new LevelFileNumIterator(icmp, &files, begin, std::max(begin, end));
+  if (options.prefix_same_as_start) {
+    return NewTwoLevelIterator(index_iter, &GetFileIterator,
+                               &FileMayMatchPrefix, &icmp, vset_->table_cache_,
+                               options);
+  }
+  return NewTwoLevelIterator(index_iter, &GetFileIterator, nullptr, &icmp,
+                             vset_->table_cache_, options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
   // Merge all level zero files together since they may overlap
-  for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+  const InternalKeyComparator& icmp = vset_->icmp_;
+  const Slice* lower_bound = options.iterate_lower_bound;
+  const Slice* upper_bound = options.iterate_upper_bound;
+  for (FileMetaData* f : files_[0]) {
+    if ((lower_bound != nullptr &&
+         icmp.Compare(f->largest.Encode(), *lower_bound) < 0) ||
+        (upper_bound != nullptr &&
+         icmp.Compare(f->smallest.Encode(), *upper_bound) >= 0)) {
+      continue;  // Outside the bounds
+    }
+    iters->push_back(
+        vset_->table_cache_->NewIterator(options, f->number, f->file_size));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -244,6 +366,20 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::AddRangeTombstones(RangeTombstoneList* list) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (FileMetaData* f : files_[level]) {
+      if (f->has_range_deletions) {
+        s = vset_->table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                    list);
+        if (!s.ok()) break;
+      }
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -251,12 +387,20 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,  // Found merge operands that apply to older entries
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
+  SequenceNumber snapshot;
+  // Largest sequence number of the range tombstones that cover user_key
+  // in the file being searched
+  SequenceNumber tombstone_seq;
   std::string* value;
+  bool value_is_handle;  // *value is a ValueHandle into a value log
+  std::vector<std::string>* operands;  // Merge operands found, newest first
+  SequenceNumber merge_sequence;       // Sequence of the oldest operand
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -265,15 +409,59 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
-    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) != 0) {
+      // No entry for the key
+    } else if (parsed_key.type == kTypeMerge &&
+               parsed_key.sequence >= s->tombstone_seq) {
+      s->state = kMerge;
+      s->operands->emplace_back(v.data(), v.size());
+      s->merge_sequence = parsed_key.sequence;
+    } else {
+      s->state = ((parsed_key.type == kTypeValue ||
+                   parsed_key.type == kTypeValueHandle) &&
+                  parsed_key.sequence >= s->tombstone_seq)
+                     ? kFound
+                     : kDeleted;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
+        s->value_is_handle = (parsed_key.type == kTypeValueHandle);
       }
     }
   }
 }
 
+// Called after a lookup in "f" found merge operands for saver->user_key.
+// Looks in "f" for the older entries for the key, which the operands
+// apply to.  Leaves saver->state at kNotFound if there are none.
+static Status GetOlderFromFile(TableCache* table_cache,
+                               const ReadOptions& options, FileMetaData* f,
+                               Saver* saver) {
+  Status s;
+  while (s.ok() && saver->state == kMerge) {
+    saver->state = kNotFound;
+    if (saver->merge_sequence == 0) {
+      break;
+    }
+    InternalKey older(saver->user_key, saver->merge_sequence - 1,
+                      kValueTypeForSeek);
+    s = table_cache->Get(options, f->number, f->file_size, older.Encode(),
+                         saver, SaveValue);
+  }
+  return s;
+}
+
+// Like TableCache::Get() for "saver", but looks past the merge operands
+// found.
+static Status GetFromFile(TableCache* table_cache, const ReadOptions& options,
+                          FileMetaData* f, const Slice& ikey, Saver* saver) {
+  Status s = table_cache->Get(options, f->number, f->file_size, ikey, saver,
+                              SaveValue);
+  if (s.ok()) {
+    s = GetOlderFromFile(table_cache, options, f, saver);
+  }
+  return s;
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -322,7 +510,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, std::vector<std::string>* operands,
+                    GetStats* stats) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -351,17 +540,31 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      if (f->has_range_deletions) {
+        state->s = state->vset->table_cache_->MaxCoveringTombstoneSequence(
+            f->number, f->file_size, state->saver.user_key,
+            state->saver.snapshot, &state->saver.tombstone_seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+      }
+      state->s = GetFromFile(state->vset->table_cache_, *state->options, f,
+                             state->ikey, &state->saver);
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
       switch (state->saver.state) {
         case kNotFound:
-          return true;  // Keep searching in other files
+        case kMerge:  // Not reached
+          // Entries in later files are older than the file's tombstones.
+          return state->saver.tombstone_seq == 0;
         case kFound:
+          if (state->saver.value_is_handle) {
+            state->s = state->vset->table_cache_->ReadValue(
+                *state->options, *state->saver.value, state->saver.value);
+          }
           state->found = true;
           return false;
         case kDeleted:
@@ -392,13 +595,198 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
+  state.saver.snapshot = k.sequence();
+  state.saver.tombstone_seq = 0;
   state.saver.value = value;
+  state.saver.value_is_handle = false;
+  state.saver.operands = operands;
+  state.saver.merge_sequence = 0;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+namespace {
+// Per-key lookup state for Version::MultiGet().
+struct MultiGetState {
+  Saver saver;
+  Status s;
+  bool done;
+  Version::GetStats* stats;
+  FileMetaData* last_file_read;
+  int last_file_read_level;
+};
+}  // namespace
+
+// Looks up the keys whose indices are listed in "batch" in file "f" (which
+// lives in "level") and records the outcome in the matching "state" entries.
+static void MultiGetFromFile(TableCache* table_cache,
+                             const ReadOptions& options, int level,
+                             FileMetaData* f, const std::vector<int>& batch,
+                             const LookupKey* const* keys,
+                             MultiGetState* state) {
+  const int n = static_cast<int>(batch.size());
+  std::vector<Slice> ikeys(n);
+  std::vector<void*> args(n);
+  std::vector<Status> statuses(n);
+  for (int j = 0; j < n; j++) {
+    MultiGetState* st = &state[batch[j]];
+    if (st->stats->seek_file == nullptr && st->last_file_read != nullptr) {
+      // We have had more than one seek for this read.  Charge the 1st file.
+      st->stats->seek_file = st->last_file_read;
+      st->stats->seek_file_level = st->last_file_read_level;
+    }
+    st->last_file_read = f;
+    st->last_file_read_level = level;
+    ikeys[j] = keys[batch[j]]->internal_key();
+    args[j] = &st->saver;
+    if (f->has_range_deletions) {
+      Status s = table_cache->MaxCoveringTombstoneSequence(
+          f->number, f->file_size, st->saver.user_key, st->saver.snapshot,
+          &st->saver.tombstone_seq);
+      if (!s.ok()) {
+        for (int i = 0; i < n; i++) {
+          state[batch[i]].s = s;
+          state[batch[i]].done = true;
+        }
+        return;
+      }
+    }
+  }
+
+  table_cache->MultiGet(options, f->number, f->file_size, n, &ikeys[0],
+                        &args[0], &statuses[0], SaveValue);
+
+  for (int j = 0; j < n; j++) {
+    MultiGetState* st = &state[batch[j]];
+    if (statuses[j].ok()) {
+      statuses[j] = GetOlderFromFile(table_cache, options, f, &st->saver);
+    }
+    if (!statuses[j].ok()) {
+      st->s = statuses[j];
+      st->done = true;
+      continue;
+    }
+    switch (st->saver.state) {
+      case kNotFound:
+      case kMerge:  // Not reached
+        if (st->saver.tombstone_seq > 0) {
+          // Entries in later files are older than the file's tombstones.
+          st->s = Status::NotFound(Slice());
+          st->done = true;
+        }
+        break;
+      case kFound:
+        if (st->saver.value_is_handle) {
+          st->s = table_cache->ReadValue(options, *st->saver.value,
+                                         st->saver.value);
+        }
+        st->done = true;
+        break;
+      case kDeleted:
+        st->s = Status::NotFound(Slice());
+        st->done = true;
+        break;
+      case kCorrupt:
+        st->s = Status::Corruption("corrupted key for ", st->saver.user_key);
+        st->done = true;
+        break;
+    }
+  }
+}
+
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys, std::string** values,
+                       std::vector<std::string>** operands, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  std::vector<MultiGetState> state(n);
+  for (int i = 0; i < n; i++) {
+    assert(i == 0 ||
+           ucmp->Compare(keys[i - 1]->user_key(), keys[i]->user_key()) <= 0);
+    stats[i].seek_file = nullptr;
+    stats[i].seek_file_level = -1;
+    MultiGetState* st = &state[i];
+    st->saver.state = kNotFound;
+    st->saver.ucmp = ucmp;
+    st->saver.user_key = keys[i]->user_key();
+    st->saver.snapshot = keys[i]->sequence();
+    st->saver.tombstone_seq = 0;
+    st->saver.value = values[i];
+    st->saver.value_is_handle = false;
+    st->saver.operands = operands[i];
+    st->saver.merge_sequence = 0;
+    st->done = false;
+    st->stats = &stats[i];
+    st->last_file_read = nullptr;
+    st->last_file_read_level = -1;
+  }
+
+  // Search level-0 in order from newest to oldest, handing each file all of
+  // the unresolved keys that fall inside its range.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  std::vector<int> batch;
+  for (size_t k = 0; k < tmp.size(); k++) {
+    FileMetaData* f = tmp[k];
+    batch.clear();
+    for (int i = 0; i < n; i++) {
+      if (!state[i].done &&
+          ucmp->Compare(keys[i]->user_key(), f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(keys[i]->user_key(), f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      MultiGetFromFile(vset_->table_cache_, options, 0, f, batch, keys,
+                       &state[0]);
+    }
+  }
+
+  // Search other levels.  Since the keys are sorted, the unresolved keys
+  // that map to a given file in a level form a contiguous run.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    FileMetaData* batch_file = nullptr;
+    batch.clear();
+    for (int i = 0; i < n; i++) {
+      if (state[i].done) continue;
+      FileMetaData* f = nullptr;
+      uint32_t index =
+          FindFile(vset_->icmp_, files_[level], keys[i]->internal_key());
+      if (index < num_files) {
+        f = files_[level][index];
+        if (ucmp->Compare(keys[i]->user_key(), f->smallest.user_key()) < 0) {
+          // All of "f" is past any data for this key
+          f = nullptr;
+        }
+      }
+      if (f != batch_file) {
+        if (!batch.empty()) {
+          MultiGetFromFile(vset_->table_cache_, options, level, batch_file,
+                           batch, keys, &state[0]);
+          batch.clear();
+        }
+        batch_file = f;
+      }
+      if (f != nullptr) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      MultiGetFromFile(vset_->table_cache_, options, level, batch_file, batch,
+                       keys, &state[0]);
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    statuses[i] = state[i].done ? state[i].s : Status::NotFound(Slice());
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -467,10 +855,25 @@ bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
                                smallest_user_key, largest_user_key);
 }
 
+void Version::AddFileNumbers(std::vector<uint64_t>* tables,
+                             std::vector<uint64_t>* value_logs) const {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData* f : files_[level]) {
+      tables->push_back(f->number);
+    }
+  }
+  for (const auto& value_log_kvp : value_logs_) {
+    value_logs->push_back(value_log_kvp.first);
+  }
+}
+
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
-  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+  if (vset_->options_->compaction_style == kLevelCompaction &&
+      vset_->options_->level_compaction_dynamic_level_bytes) {
+    // The levels above the base level must stay empty.
+  } else if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
@@ -592,10 +995,12 @@ class VersionSet::Builder {
   VersionSet* vset_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
+  std::map<uint64_t, uint64_t> value_logs_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  Builder(VersionSet* vset, Version* base)
+      : vset_(vset), base_(base), value_logs_(base->value_logs_) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
@@ -663,9 +1068,17 @@ class VersionSet::Builder {
       f->allowed_seeks = static_cast<int>((f->file_size / 16384U));
       if (f->allowed_seeks < 100) f->allowed_seeks = 100;
 
+      if (f->global_sequence != 0) {
+        vset_->table_cache_->SetGlobalSequence(f->number, f->global_sequence);
+      }
+
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
+
+    // Add new value logs
+    value_logs_.insert(edit->new_value_logs_.begin(),
+                       edit->new_value_logs_.end());
   }
 
   // Save the current state in *v.
@@ -712,6 +1125,19 @@ class VersionSet::Builder {
       }
 #endif
     }
+
+    // Keep the value logs that some file may still refer to: those from
+    // the oldest one referenced on.
+    uint64_t oldest_value_log = std::numeric_limits<uint64_t>::max();
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if (f->oldest_value_log != 0) {
+          oldest_value_log = std::min(oldest_value_log, f->oldest_value_log);
+        }
+      }
+    }
+    v->value_logs_.insert(value_logs_.lower_bound(oldest_value_log),
+                          value_logs_.end());
   }
 
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
@@ -775,6 +1201,24 @@ void VersionSet::AppendVersion(Version* v) {
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  // *mu is released while the MANIFEST is written, so wait until every
+  // edit that arrived earlier has been applied.
+  port::CondVar cv(mu);
+  manifest_writers_.push_back(&cv);
+  while (manifest_writers_.front() != &cv) {
+    cv.Wait();
+  }
+
+  Status s = DoLogAndApply(edit, mu);
+
+  manifest_writers_.pop_front();
+  if (!manifest_writers_.empty()) {
+    manifest_writers_.front()->Signal();
+  }
+  return s;
+}
+
+Status VersionSet::DoLogAndApply(VersionEdit* edit, port::Mutex* mu) {
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
     assert(edit->log_number_ < next_file_number_);
@@ -1033,6 +1477,18 @@ void VersionSet::Finalize(Version* v) {
   int best_level = -1;
   double best_score = -1;
 
+  // Size limit of every level above level-0
+  double max_bytes[config::kNumLevels];
+  v->base_level_ = 1;
+  if (options_->compaction_style == kLevelCompaction &&
+      options_->level_compaction_dynamic_level_bytes) {
+    v->base_level_ = DynamicMaxBytesForLevels(options_, v->files_, max_bytes);
+  } else {
+    for (int level = 1; level < config::kNumLevels; level++) {
+      max_bytes[level] = MaxBytesForLevel(options_, level);
+    }
+  }
+
   for (int level = 0; level < config::kNumLevels - 1; level++) {
     double score;
     if (level == 0) {
@@ -1052,9 +1508,9 @@ void VersionSet::Finalize(Version* v) {
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / max_bytes[level];
     }
+    v->compaction_scores_[level] = score;
 
     if (score > best_score) {
       best_level = level;
@@ -1062,23 +1518,81 @@ void VersionSet::Finalize(Version* v) {
     }
   }
 
+  if (options_->compaction_style == kUniversalCompaction) {
+    // Every level-0 file and every other non-empty level is a sorted run
+    // that reads have to search, so bound their number instead.
+    int runs = v->files_[0].size();
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (!v->files_[level].empty()) {
+        runs++;
+      }
+    }
+    best_level = 0;
+    best_score = runs / static_cast<double>(config::kL0_CompactionTrigger);
+  }
+
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Garbage collect the oldest value logs once too much of their space
+  // is taken by values that no file refers to any more.
+  uint64_t value_log_bytes = 0;
+  for (const auto& value_log_kvp : v->value_logs_) {
+    value_log_bytes += value_log_kvp.second;
+  }
+  uint64_t live_bytes = 0;
+  FileMetaData* oldest_file = nullptr;
+  int oldest_file_level = -1;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData* f : v->files_[level]) {
+      live_bytes += f->value_log_bytes;
+      if (f->oldest_value_log != 0 &&
+          (oldest_file == nullptr ||
+           f->oldest_value_log < oldest_file->oldest_value_log)) {
+        oldest_file = f;
+        oldest_file_level = level;
+      }
+    }
+  }
+  v->value_log_gc_cutoff_ = 0;
+  v->value_log_gc_file_ = nullptr;
+  v->value_log_gc_file_level_ = -1;
+  if (value_log_bytes > live_bytes &&
+      static_cast<double>(value_log_bytes - live_bytes) >
+          options_->value_log_gc_ratio * value_log_bytes) {
+    // Relocate the values of the oldest quarter of the value logs.
+    std::map<uint64_t, uint64_t>::const_iterator it = v->value_logs_.begin();
+    std::advance(it, std::max<size_t>(1, v->value_logs_.size() / 4));
+    v->value_log_gc_cutoff_ =
+        (it == v->value_logs_.end()) ? v->value_logs_.rbegin()->first + 1
+                                     : it->first;
+    if (oldest_file != nullptr &&
+        oldest_file->oldest_value_log < v->value_log_gc_cutoff_) {
+      v->value_log_gc_file_ = oldest_file;
+      v->value_log_gc_file_level_ = oldest_file_level;
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
+  VersionEdit edit;
+  SaveCurrentVersion(&edit);
+  std::string record;
+  edit.EncodeTo(&record);
+  return log->AddRecord(record);
+}
 
+void VersionSet::SaveCurrentVersion(VersionEdit* edit) {
   // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  edit->SetComparatorName(icmp_.user_comparator()->Name());
 
   // Save compaction pointers
   for (int level = 0; level < config::kNumLevels; level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
-      edit.SetCompactPointer(level, key);
+      edit->SetCompactPointer(level, key);
     }
   }
 
@@ -1087,13 +1601,16 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit->AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                    f->has_range_deletions, f->oldest_value_log,
+                    f->value_log_bytes, f->global_sequence);
     }
   }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+  // Save value logs
+  for (const auto& value_log_kvp : current_->value_logs_) {
+    edit->AddValueLog(value_log_kvp.first, value_log_kvp.second);
+  }
 }
 
 int VersionSet::NumLevelFiles(int level) const {
@@ -1120,8 +1637,9 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
-        // Entire file is before "ikey", so just add the file size
-        result += files[i]->file_size;
+        // Entire file is before "ikey", so just add the file size, and
+        // that of the value log records it refers to
+        result += files[i]->file_size + files[i]->value_log_bytes;
       } else if (icmp_.Compare(files[i]->smallest, ikey) > 0) {
         // Entire file is after "ikey", so ignore
         if (level > 0) {
@@ -1138,6 +1656,13 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
             ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
         if (tableptr != nullptr) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
+          // Prorate the value log records of the file over its data
+          // blocks, counting in the block that holds "ikey".
+          if (files[i]->value_log_bytes > 0) {
+            result += static_cast<uint64_t>(
+                files[i]->value_log_bytes *
+                tableptr->ApproximateFractionThrough(ikey.Encode()));
+          }
         }
         delete iter;
       }
@@ -1155,6 +1680,9 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
         live->insert(files[i]->number);
       }
     }
+    for (const auto& value_log_kvp : v->value_logs_) {
+      live->insert(value_log_kvp.first);
+    }
   }
 }
 
@@ -1224,22 +1752,23 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space = (c->level() == 0 ? c->inputs_[0].size() - 1 : 0) +
+                    c->num_input_levels();
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < c->num_input_levels(); which++) {
     if (!c->inputs_[which].empty()) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1250,59 +1779,321 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-
-  // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  // We prefer compactions triggered by too many sorted runs or too much
+  // data in a level over the compactions triggered by seeks.  Levels are
+  // tried in order of decreasing score, as the best one may be busy with
+  // compactions that are in progress.
+  if (options_->compaction_style == kUniversalCompaction) {
+    Compaction* c = PickUniversalCompaction();
+    if (c != nullptr) {
+      return c;
+    }
+  } else {
+    int levels[config::kNumLevels - 1];
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      levels[level] = level;
+    }
+    const double* scores = current_->compaction_scores_;
+    std::stable_sort(
+        levels, levels + config::kNumLevels - 1,
+        [scores](int a, int b) { return scores[a] > scores[b]; });
+    for (int i = 0; i < config::kNumLevels - 1; i++) {
+      if (scores[levels[i]] < 1) {
         break;
       }
+      Compaction* c = PickLevelCompaction(levels[i]);
+      if (c != nullptr) {
+        return c;
+      }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+
+  // Then the compactions triggered by seeks, and those that garbage
+  // collect value logs.
+  Compaction* c = PickFileCompaction(current_->file_to_compact_level_,
+                                     current_->file_to_compact_);
+  if (c == nullptr) {
+    c = PickFileCompaction(current_->value_log_gc_file_level_,
+                           current_->value_log_gc_file_);
+    if (c != nullptr && c->level() == c->output_level()) {
+      // Only the values of the oldest value logs would move otherwise,
+      // while the file still holds on to the logs after them.
+      c->relocate_all_values_ = true;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
+  return c;
+}
 
+Compaction* VersionSet::PickFileCompaction(int level, FileMetaData* f) {
+  if (f == nullptr || f->being_compacted) {
+    return nullptr;
+  }
+  Compaction* c = new Compaction(options_, level, OutputLevel(level));
   c->input_version_ = current_;
   c->input_version_->Ref();
-
-  // Files in level 0 may overlap each other, so pick up all overlapping ones
+  c->inputs_[0].push_back(f);
   if (level == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
-    // Note that the next call will discard the file we placed in
+    current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+  }
+  SetupOtherInputs(c);
+  if (ConflictsWithCompactionsInProgress(c)) {
+    delete c;
+    return nullptr;
+  }
+  RegisterCompaction(c);
+  return c;
+}
+
+Compaction* VersionSet::PickLevelCompaction(int level) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+
+  // Start with the first file that comes after compact_pointer_[level],
+  // wrapping around to the beginning of the key space.
+  size_t start = 0;
+  if (!compact_pointer_[level].empty()) {
+    while (start < files.size() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    if (start == files.size()) {
+      start = 0;
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = new Compaction(options_, level, OutputLevel(level));
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    c->inputs_[0].push_back(f);
+
+    // Files in level 0 may overlap each other, so pick up all overlapping
+    // ones.  Note that the next call will discard the file we placed in
     // c->inputs_[0] earlier and replace it with an overlapping set
     // which will include the picked file.
-    current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
-    assert(!c->inputs_[0].empty());
+    if (level == 0) {
+      InternalKey smallest, largest;
+      GetRange(c->inputs_[0], &smallest, &largest);
+      current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+      assert(!c->inputs_[0].empty());
+    }
+
+    SetupOtherInputs(c);
+    if (!ConflictsWithCompactionsInProgress(c)) {
+      RegisterCompaction(c);
+      return c;
+    }
+    delete c;
   }
+  return nullptr;
+}
 
-  SetupOtherInputs(c);
+namespace {
+// A sorted run of a kUniversalCompaction database: a level-0 file, or all
+// the files of another level.
+struct SortedRun {
+  int level;
+  FileMetaData* file;  // The level-0 file, or nullptr for a whole level
+  uint64_t size;
+  bool being_compacted;
+};
+}  // namespace
+
+Compaction* VersionSet::PickUniversalCompaction() {
+  Version* const v = current_;
+  if (v->compaction_score_ < 1) {
+    return nullptr;
+  }
 
+  // List the sorted runs from newest to oldest.
+  std::vector<SortedRun> runs;
+  std::vector<FileMetaData*> level0 = v->files_[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (FileMetaData* f : level0) {
+    runs.push_back(SortedRun{0, f, f->file_size, f->being_compacted});
+  }
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (!v->files_[level].empty()) {
+      SortedRun run{level, nullptr, 0, false};
+      for (FileMetaData* f : v->files_[level]) {
+        run.size += f->file_size;
+        run.being_compacted = run.being_compacted || f->being_compacted;
+      }
+      runs.push_back(run);
+    }
+  }
+  const size_t n = runs.size();
+
+  // Runs [first, last] are merged.  When the newer runs take too much space
+  // compared to the oldest one, all runs are merged to drop the entries
+  // they overwrite.
+  size_t first = n;
+  size_t last = n;
+  uint64_t newer_bytes = 0;
+  bool busy = false;
+  for (size_t i = 0; i < n; i++) {
+    busy = busy || runs[i].being_compacted;
+    if (i + 1 < n) {
+      newer_bytes += runs[i].size;
+    }
+  }
+  const uint64_t max_amplification =
+      options_->universal_max_size_amplification_percent;
+  if (!busy && newer_bytes * 100 > max_amplification * runs[n - 1].size) {
+    first = 0;
+    last = n - 1;
+  }
+
+  // Otherwise merge the newest runs of similar size: starting from a run,
+  // each older run is added as long as it is not much larger than the
+  // runs added before it.
+  const uint64_t size_ratio = 100 + options_->universal_size_ratio;
+  for (size_t i = 0; first == n && i < n; i++) {
+    if (runs[i].being_compacted) {
+      continue;
+    }
+    uint64_t bytes = runs[i].size;
+    size_t j = i + 1;
+    while (j < n && !runs[j].being_compacted &&
+           runs[j].size * 100 <= bytes * size_ratio) {
+      bytes += runs[j].size;
+      j++;
+    }
+    if (j - i >= 2) {
+      first = i;
+      last = j - 1;
+    }
+  }
+
+  // Otherwise merge just enough of the newest runs to bring their number
+  // below the compaction trigger.
+  if (first == n) {
+    first = 0;
+    while (first < n && runs[first].being_compacted) {
+      first++;
+    }
+    last = first + n + 1 - config::kL0_CompactionTrigger;
+    if (last >= n) {
+      return nullptr;
+    }
+  }
+
+  // Newer data must stay in higher levels than older data, and outputs
+  // cannot be written to level-0.  So a merge of level-0 files takes all
+  // the older level-0 files along, and the level-1 run too if there is no
+  // free level above the next run to write to.
+  if (runs[last].level == 0) {
+    while (last + 1 < n && runs[last + 1].level <= 1) {
+      last++;
+    }
+  }
+  for (size_t i = first; i <= last; i++) {
+    if (runs[i].being_compacted) {
+      return nullptr;
+    }
+  }
+  int output_level;
+  if (runs[last].level > 0) {
+    output_level = runs[last].level;
+  } else if (last + 1 < n) {
+    output_level = runs[last + 1].level - 1;
+  } else {
+    output_level = config::kNumLevels - 1;
+  }
+
+  const int level = runs[first].level;
+  Compaction* c = new Compaction(options_, level, output_level);
+  c->input_version_ = v;
+  c->input_version_->Ref();
+  for (size_t i = first; i <= last; i++) {
+    std::vector<FileMetaData*>* inputs = &c->inputs_[runs[i].level - level];
+    if (runs[i].file != nullptr) {
+      inputs->push_back(runs[i].file);
+    } else {
+      *inputs = v->files_[runs[i].level];
+    }
+  }
+  std::vector<FileMetaData*> all;
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    all.insert(all.end(), c->inputs_[which].begin(), c->inputs_[which].end());
+  }
+  GetRange(all, &c->smallest_, &c->largest_);
+  if (output_level + 1 < config::kNumLevels) {
+    v->GetOverlappingInputs(output_level + 1, &c->smallest_, &c->largest_,
+                            &c->grandparents_);
+  }
+
+  if (ConflictsWithCompactionsInProgress(c)) {
+    delete c;
+    return nullptr;
+  }
+  RegisterCompaction(c);
   return c;
 }
 
+bool VersionSet::ConflictsWithCompactionsInProgress(const Compaction* c) const {
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      if (c->inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+  }
+
+  // Outputs of two compactions into the same level must not overlap.
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (size_t i = 0; i < compactions_in_progress_.size(); i++) {
+    const Compaction* other = compactions_in_progress_[i];
+    if (other->output_level() == c->output_level() &&
+        user_cmp->Compare(other->smallest_.user_key(),
+                          c->largest_.user_key()) <= 0 &&
+        user_cmp->Compare(c->smallest_.user_key(),
+                          other->largest_.user_key()) <= 0) {
+      return true;
+    }
+  }
+  for (size_t i = 0; i < ingested_ranges_.size(); i++) {
+    const IngestedRange& r = ingested_ranges_[i];
+    if (r.level == c->output_level() &&
+        user_cmp->Compare(r.smallest.user_key(), c->largest_.user_key()) <=
+            0 &&
+        user_cmp->Compare(c->smallest_.user_key(), r.largest.user_key()) <=
+            0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  assert(!c->in_progress_);
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      assert(!c->inputs_[which][i]->being_compacted);
+      c->inputs_[which][i]->being_compacted = true;
+    }
+  }
+  c->in_progress_ = true;
+  compactions_in_progress_.push_back(c);
+
+  // Update the place where we will do the next compaction for this level.
+  // We update this immediately instead of waiting for the VersionEdit
+  // to be applied so that if the compaction fails, we will try a different
+  // key range next time.
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
+  compact_pointer_[c->level()] = largest.Encode().ToString();
+  c->edit_.SetCompactPointer(c->level(), largest);
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1384,27 +2175,29 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  const int output_level = c->output_level();
+  std::vector<FileMetaData*>* const inputs1 =
+      &c->inputs_[output_level - level];
   InternalKey smallest, largest;
 
   AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level + 1, &smallest, &largest,
-                                 &c->inputs_[1]);
-  AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+  current_->GetOverlappingInputs(output_level, &smallest, &largest, inputs1);
+  AddBoundaryInputs(icmp_, current_->files_[output_level], inputs1);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
-  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  GetRange2(c->inputs_[0], *inputs1, &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
-  if (!c->inputs_[1].empty()) {
+  // changing the number of "output_level" files we pick up.
+  if (!inputs1->empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
     AddBoundaryInputs(icmp_, current_->files_[level], &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
-    const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
+    const int64_t inputs1_size = TotalFileSize(*inputs1);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
@@ -1412,37 +2205,78 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
-      AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
-      if (expanded1.size() == c->inputs_[1].size()) {
+      AddBoundaryInputs(icmp_, current_->files_[output_level], &expanded1);
+      if (expanded1.size() == inputs1->size()) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
-            level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
+            level, int(c->inputs_[0].size()), int(inputs1->size()),
             long(inputs0_size), long(inputs1_size), int(expanded0.size()),
             int(expanded1.size()), long(expanded0_size), long(inputs1_size));
         smallest = new_start;
         largest = new_limit;
         c->inputs_[0] = expanded0;
-        c->inputs_[1] = expanded1;
-        GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+        *inputs1 = expanded1;
+        GetRange2(c->inputs_[0], *inputs1, &all_start, &all_limit);
       }
     }
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < config::kNumLevels) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
-  // Update the place where we will do the next compaction for this level.
-  // We update this immediately instead of waiting for the VersionEdit
-  // to be applied so that if the compaction fails, we will try a different
-  // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
-  c->edit_.SetCompactPointer(level, largest);
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+}
+
+int VersionSet::PickLevelForIngestedFile(const Slice& smallest_user_key,
+                                         const Slice& largest_user_key) {
+  Version* v = current_;
+  int level = 0;
+  if (!v->OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+    while (level + 1 < config::kNumLevels &&
+           !v->OverlapInLevel(level + 1, &smallest_user_key,
+                              &largest_user_key)) {
+      level++;
+    }
+  }
+
+  // The outputs of a compaction in progress were picked without the
+  // ingested file in view, so they must not land next to it.
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (size_t i = 0; i < compactions_in_progress_.size() && level > 0;) {
+    const Compaction* c = compactions_in_progress_[i];
+    if (c->output_level() == level &&
+        user_cmp->Compare(c->smallest_.user_key(), largest_user_key) <= 0 &&
+        user_cmp->Compare(smallest_user_key, c->largest_.user_key()) <= 0) {
+      level--;
+      i = 0;  // Check the compactions again against the level above
+    } else {
+      i++;
+    }
+  }
+
+  if (options_->compaction_style == kLevelCompaction &&
+      options_->level_compaction_dynamic_level_bytes &&
+      level < v->base_level_) {
+    // The levels above the base level must stay empty.
+    level = 0;
+  }
+  return level;
+}
+
+void VersionSet::ReserveIngestedRange(int level, const InternalKey& smallest,
+                                      const InternalKey& largest) {
+  IngestedRange r;
+  r.level = level;
+  r.smallest = smallest;
+  r.largest = largest;
+  ingested_ranges_.push_back(r);
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1456,8 +2290,9 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   // Avoid compacting too much in one shot in case the range is large.
   // But we cannot do this for level-0 since level-0 files can overlap
   // and we must not pick one file and drop another older file if the
-  // two files overlap.
-  if (level > 0) {
+  // two files overlap.  Nor for a compaction of the last level into
+  // itself, whose outputs land back in the range.
+  if (level > 0 && OutputLevel(level) != level) {
     const uint64_t limit = MaxFileSizeForLevel(options_, level);
     uint64_t total = 0;
     for (size_t i = 0; i < inputs.size(); i++) {
@@ -1470,57 +2305,96 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
     }
   }
 
-  Compaction* c = new Compaction(options_, level);
+  assert(compactions_in_progress_.empty());
+  assert(ingested_ranges_.empty());
+  Compaction* c = new Compaction(options_, level, OutputLevel(level));
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  RegisterCompaction(c);
   return c;
 }
 
-Compaction::Compaction(const Options* options, int level)
+Compaction::Compaction(const Options* options, int level, int output_level)
     : level_(level),
+      output_level_(output_level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      in_progress_(false),
+      relocate_all_values_(false) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  // Nor move a file whose values should be relocated, or a file of the
+  // last level into itself.
+  int num_files = 0;
+  for (int which = 0; which < num_input_levels(); which++) {
+    num_files += num_input_files(which);
+  }
+  return (level_ != output_level_ && num_input_files(0) == 1 &&
+          num_files == 1 &&
           TotalFileSize(grandparents_) <=
-              MaxGrandParentOverlapBytes(vset->options_));
+              MaxGrandParentOverlapBytes(vset->options_) &&
+          (inputs_[0][0]->oldest_value_log == 0 ||
+           inputs_[0][0]->oldest_value_log >= ValueLogGCCutoff()));
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < num_input_levels(); which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::HasRangeDeletions() const {
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->has_range_deletions) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint64_t Compaction::ValueLogGCCutoff() const {
+  if (relocate_all_values_) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return input_version_->value_log_gc_cutoff_;
+}
+
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1529,37 +2403,110 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+// Orders files by their largest key.
+struct ByLargestKey {
+  const InternalKeyComparator* icmp;
+
+  bool operator()(FileMetaData* a, FileMetaData* b) const {
+    return icmp->Compare(a->largest, b->largest) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (n <= 1 || HasRangeDeletions()) {
+    return;
+  }
+
+  // Candidate split points are the largest keys of the input files.
+  // Visiting the files in order of their largest key, the bytes of the
+  // files seen so far approximate the input data below each candidate.
+  std::vector<FileMetaData*> files;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      files.push_back(inputs_[which][i]);
+      total_bytes += inputs_[which][i]->file_size;
+    }
+  }
+  if (files.size() < 2) {
+    return;
+  }
+  ByLargestKey cmp;
+  cmp.icmp = &input_version_->vset_->icmp_;
+  std::sort(files.begin(), files.end(), cmp);
+  const Comparator* ucmp = cmp.icmp->user_comparator();
+  const Slice last_key = files.back()->largest.user_key();
+
+  const uint64_t bytes_per_range = total_bytes / n;
+  uint64_t bytes = 0;
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    bytes += files[i]->file_size;
+    if (bytes < bytes_per_range * (boundaries->size() + 1)) {
+      continue;
+    }
+    const Slice key = files[i]->largest.user_key();
+    if (ucmp->Compare(key, last_key) >= 0) {
+      break;
+    }
+    if (boundaries->empty() ||
+        ucmp->Compare(key, Slice(boundaries->back())) > 0) {
+      boundaries->push_back(key.ToString());
+      if (boundaries->size() == static_cast<size_t>(n - 1)) {
+        break;
+      }
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
+  if (in_progress_) {
+    for (int which = 0; which < num_input_levels(); which++) {
+      for (size_t i = 0; i < inputs_[which].size(); i++) {
+        inputs_[which][i]->being_compacted = false;
+      }
+    }
+    std::vector<Compaction*>* in_progress =
+        &input_version_->vset_->compactions_in_progress_;
+    in_progress->erase(
+        std::find(in_progress->begin(), in_progress->end(), this));
+    in_progress_ = false;
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
     input_version_ = nullptr;
@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -34,6 +35,7 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -66,15 +68,34 @@ class Version {
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  The
+  // iterate_lower_bound and iterate_upper_bound of the options, if set,
+  // are internal keys: the iterators leave out the files, and stop before
+  // the blocks, that only hold keys outside of them.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of every file of this Version to *list.
+  // REQUIRES: lock is not held
+  Status AddRangeTombstones(RangeTombstoneList* list);
+
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  Fills *stats.  The merge
+  // operands for key newer than the value (or than the deletion of key)
+  // are appended to *operands, newest first.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             std::vector<std::string>* operands, GetStats* stats);
+
+  // Batched form of Get().  "keys[0,n-1]" must be sorted by user key.
+  // For each i, stores the outcome of looking up keys[i] in statuses[i]
+  // (and the value, if found, in *vals[i], and the merge operands in
+  // *operands[i]) and fills stats[i].  Keys that map to the same table
+  // file are looked up together.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string** vals, std::vector<std::string>** operands,
+                Status* statuses, GetStats* stats);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -112,6 +133,11 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Append the numbers of the table files and of the value log files of
+  // this version to *tables and *value_logs.
+  void AddFileNumbers(std::vector<uint64_t>* tables,
+                      std::vector<uint64_t>* value_logs) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -128,8 +154,16 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        value_log_gc_cutoff_(0),
+        value_log_gc_file_(nullptr),
+        value_log_gc_file_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        base_level_(1) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -158,11 +192,33 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // Value log files by number, with their sizes.
+  std::map<uint64_t, uint64_t> value_logs_;
+
+  // Compactions relocate the values kept in value logs numbered below
+  // value_log_gc_cutoff_, so that those can be deleted, and the file
+  // holding the oldest such value should be compacted next.  Initialized
+  // by Finalize().
+  uint64_t value_log_gc_cutoff_;
+  FileMetaData* value_log_gc_file_;
+  int value_log_gc_file_level_;
+
   // Level that should be compacted next and its compaction score.
-  // Score < 1 means compaction is not strictly needed.  These fields
-  // are initialized by Finalize().
+  // Score < 1 means compaction is not strictly needed.  With
+  // kUniversalCompaction, the score compares the number of sorted runs
+  // to the number that triggers a compaction.  These fields are
+  // initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, also set by Finalize().  Used to
+  // find another level to compact when the best one is busy.
+  double compaction_scores_[config::kNumLevels];
+
+  // Level that level-0 files are compacted into: level-1, unless
+  // Options::level_compaction_dynamic_level_bytes keeps the levels above
+  // it empty.  Also set by Finalize().
+  int base_level_;
 };
 
 class VersionSet {
@@ -177,8 +233,8 @@ class VersionSet {
   // Apply *edit to the current version to form a new descriptor that
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
+  // Concurrent calls are applied one at a time, in arrival order.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -232,15 +288,51 @@ class VersionSet {
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  //
+  // Compactions stay in progress until they are deleted or their
+  // inputs are released.  A new compaction never shares an input file
+  // with one in progress, nor writes to the same level in an
+  // overlapping key range, so that both can run at the same time.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is in progress, and no range is kept
+  // by ReserveIngestedRange().
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Store in *edit the comparator, compaction pointers and files of the
+  // current version, as a description of the entire database.
+  void SaveCurrentVersion(VersionEdit* edit);
+
+  // Return the level at which an ingested table that covers the range
+  // [smallest_user_key,largest_user_key] should be added: the deepest
+  // level such that neither it nor any level above it holds a file
+  // overlapping the range, and no compaction in progress writes to it in
+  // an overlapping range.  Level-0 if there is no such level.
+  int PickLevelForIngestedFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
+  // Keep compactions from writing to "level" in the user key range of
+  // [smallest,largest], where a file being ingested is to be added,
+  // until ReleaseIngestedRanges() is called.
+  void ReserveIngestedRange(int level, const InternalKey& smallest,
+                            const InternalKey& largest);
+
+  // Drop the ranges kept by ReserveIngestedRange().
+  void ReleaseIngestedRanges() { ingested_ranges_.clear(); }
+
+  // Returns true iff some range is kept by ReserveIngestedRange().
+  bool HasIngestedRanges() const { return !ingested_ranges_.empty(); }
+
+  // Return the number of compactions in progress.
+  int NumCompactionsInProgress() const {
+    return static_cast<int>(compactions_in_progress_.size());
+  }
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -252,7 +344,8 @@ class VersionSet {
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           (v->value_log_gc_file_ != nullptr);
   }
 
   // Add all files listed in any live version to *live.
@@ -289,11 +382,45 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a compaction of "level" that can run alongside the compactions
+  // in progress, starting at compact_pointer_[level].  Returns nullptr if
+  // there is none.
+  Compaction* PickLevelCompaction(int level);
+
+  // Return the level that a compaction of "level" writes to.  The last
+  // level is rewritten in place.
+  int OutputLevel(int level) const {
+    if (level == 0) {
+      return current_->base_level_;
+    }
+    return (level + 1 < config::kNumLevels) ? level + 1 : level;
+  }
+
+  // Pick a compaction of file "f" of "level", or return nullptr if there
+  // is no such file or it cannot be compacted now.
+  Compaction* PickFileCompaction(int level, FileMetaData* f);
+
+  // Pick a kUniversalCompaction merge of adjacent sorted runs that can
+  // run alongside the compactions in progress, or return nullptr if
+  // there is none.
+  Compaction* PickUniversalCompaction();
+
+  // Returns true iff "c" shares an input file, or an output key range in
+  // the same level, with a compaction in progress or a file being ingested.
+  bool ConflictsWithCompactionsInProgress(const Compaction* c) const;
+
+  // Record "c" as in progress and mark its inputs as being compacted.
+  void RegisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
   void AppendVersion(Version* v);
 
+  // Body of LogAndApply(), run once it is the caller's turn.
+  Status DoLogAndApply(VersionEdit* edit, port::Mutex* mu)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
@@ -314,79 +441,145 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Compactions that have been picked and not yet released.
+  std::vector<Compaction*> compactions_in_progress_;
+
+  // Ranges of files being ingested, which compactions must not write to.
+  struct IngestedRange {
+    int level;
+    InternalKey smallest;
+    InternalKey largest;
+  };
+  std::vector<IngestedRange> ingested_ranges_;
+
+  // Threads waiting in LogAndApply(); the one at the front owns the
+  // MANIFEST.  Protected by the mutex passed to LogAndApply().
+  std::deque<port::CondVar*> manifest_writers_;
 };
 
 // A Compaction encapsulates information about a compaction.
 class Compaction {
  public:
+  // Position of a single in-order pass over (part of) the compaction's
+  // input.  IsBaseLevelForKey() and ShouldStopBefore() only ever move a
+  // cursor forward, so every pass needs its own; a freshly constructed
+  // cursor may be used to start a pass at any key.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == output_level_, grandparent == output_level_ + 1)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L > output_level_).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // through "output_level" will be merged to produce a set of
+  // "output_level" files.
   int level() const { return level_; }
 
+  // Return the level that receives the outputs: "level+1", unless
+  // level-0 files are compacted into a lower base level, sorted runs of
+  // several levels are merged by a universal compaction, or files of the
+  // last level are rewritten in place.
+  int output_level() const { return output_level_; }
+
+  // Return the number of levels that inputs are read from.
+  int num_input_levels() const { return output_level_ - level_ + 1; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
 
-  // "which" must be either 0 or 1
+  // "which" must be in [0, num_input_levels())
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()+which".
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
+  // Returns true iff some input file holds range tombstones.
+  bool HasRangeDeletions() const;
+
+  // Values kept in value logs numbered below this should be moved to a
+  // new value log by the compaction.  A compaction that rewrites a file
+  // of the last level to garbage collect value logs moves all of them, so
+  // that the file stops holding on to any older value log.
+  uint64_t ValueLogGCCutoff() const;
+
   // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
+  // moving a single input file to the output level (no merging or
+  // splitting)
   bool IsTrivialMove() const;
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
+  // "cursor" tracks the progress of the caller's pass over the input.
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor);
+
+  // Like IsBaseLevelForKey(), for every key in [begin, end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor);
+
+  // Split the key space of this compaction into at most "n" ranges that
+  // hold roughly equal amounts of input data, so that each range can be
+  // compacted independently.  Stores the n-1 (or fewer) user keys that
+  // separate the ranges in *boundaries, in increasing order; range i
+  // covers the user keys in ((*boundaries)[i-1], (*boundaries)[i]].
+  // Compactions with range tombstones are never split.
+  void GetSubcompactionBoundaries(int n,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Its inputs may then be picked by other compactions.
   void ReleaseInputs();
 
  private:
   friend class Version;
   friend class VersionSet;
 
-  Compaction(const Options* options, int level);
+  Compaction(const Options* options, int level, int output_level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
+  bool in_progress_;  // Registered with VersionSet::RegisterCompaction()
+  bool relocate_all_values_;
+
+  // Smallest and largest key of all inputs, which bound every output
+  InternalKey smallest_;
+  InternalKey largest_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
-  std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  // Each compaction reads inputs from "level_" through "output_level_":
+  // inputs_[i] holds the input files of "level_+i".
+  std::vector<FileMetaData*> inputs_[config::kNumLevels];
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files in output_level_ + 1 that overlap the compaction's key range
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
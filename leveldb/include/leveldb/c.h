@@ -86,6 +86,11 @@ LEVELDB_EXPORT void leveldb_delete(leveldb_t* db,
                                    const char* key, size_t keylen,
                                    char** errptr);
 
+LEVELDB_EXPORT void leveldb_delete_range(
+    leveldb_t* db, const leveldb_writeoptions_t* options,
+    const char* begin_key, size_t begin_keylen, const char* end_key,
+    size_t end_keylen, char** errptr);
+
 LEVELDB_EXPORT void leveldb_write(leveldb_t* db,
                                   const leveldb_writeoptions_t* options,
                                   leveldb_writebatch_t* batch, char** errptr);
@@ -155,6 +160,11 @@ LEVELDB_EXPORT void leveldb_writebatch_put(leveldb_writebatch_t*,
                                            const char* val, size_t vlen);
 LEVELDB_EXPORT void leveldb_writebatch_delete(leveldb_writebatch_t*,
                                               const char* key, size_t klen);
+LEVELDB_EXPORT void leveldb_writebatch_delete_range(leveldb_writebatch_t*,
+                                                    const char* begin_key,
+                                                    size_t begin_klen,
+                                                    const char* end_key,
+                                                    size_t end_klen);
 LEVELDB_EXPORT void leveldb_writebatch_iterate(
     const leveldb_writebatch_t*, void* state,
     void (*put)(void*, const char* k, size_t klen, const char* v, size_t vlen),
@@ -189,10 +199,22 @@ LEVELDB_EXPORT void leveldb_options_set_block_restart_interval(
     leveldb_options_t*, int);
 LEVELDB_EXPORT void leveldb_options_set_max_file_size(leveldb_options_t*,
                                                       size_t);
+LEVELDB_EXPORT void leveldb_options_set_max_subcompactions(leveldb_options_t*,
+                                                           int);
+LEVELDB_EXPORT void leveldb_options_set_max_background_compactions(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_allow_concurrent_memtable_write(
+    leveldb_options_t*, uint8_t);
+LEVELDB_EXPORT void leveldb_options_set_enable_pipelined_write(
+    leveldb_options_t*, uint8_t);
 
 enum { leveldb_no_compression = 0, leveldb_snappy_compression = 1 };
 LEVELDB_EXPORT void leveldb_options_set_compression(leveldb_options_t*, int);
 
+enum { leveldb_level_compaction = 0, leveldb_universal_compaction = 1 };
+LEVELDB_EXPORT void leveldb_options_set_compaction_style(leveldb_options_t*,
+                                                         int);
+
 /* Comparator */
 
 LEVELDB_EXPORT leveldb_comparator_t* leveldb_comparator_create(
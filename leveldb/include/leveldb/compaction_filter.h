@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets an application drop or rewrite entries while
+// compactions copy them, e.g. to expire old data without scanning the
+// database and deleting it.  A database opened with
+// Options::compaction_filter passes it the values compactions keep.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+// The methods of a CompactionFilter may be called concurrently from
+// multiple threads.
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // The name of this filter.
+  virtual const char* Name() const = 0;
+
+  // Called for each value that a compaction writing to "level" keeps,
+  // and that every snapshot sees.  Newer values are kept as they are.
+  // "is_bottommost" is true if no deeper level holds an entry for "key".
+  //
+  // Return true to remove the entry: "key" then reads as deleted.
+  // Otherwise, to replace the value, store the new one in *new_value and
+  // set *value_changed to true.
+  //
+  // Entries are only filtered when compactions reach them, so reads may
+  // still find the entries a filter would remove.  DB::CompactRange()
+  // passes the filter every entry in the range.
+  virtual bool Filter(int level, bool is_bottommost, const Slice& key,
+                      const Slice& existing_value, std::string* new_value,
+                      bool* value_changed) const = 0;
+};
+
+// Return a new filter that removes the values written more than
+// "ttl_seconds" seconds ago.  The last 8 bytes of the values must hold
+// the time they were written, as a little-endian count of seconds since
+// the Unix epoch (see Env::NowMicros()).  Shorter values are kept.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const CompactionFilter* NewTTLCompactionFilter(
+    uint64_t ttl_seconds);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
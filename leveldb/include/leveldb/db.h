@@ -9,6 +9,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 
 #include "leveldb/export.h"
@@ -108,6 +110,32 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for the keys in the range
+  // [begin_key, end_key).  Returns OK on success, and a non-OK status on
+  // error.  It is not an error if no keys exist in the range, and an
+  // empty range (begin_key >= end_key) deletes nothing.
+  //
+  // The deletion is recorded as a single range tombstone, so its cost
+  // does not depend on the number of keys in the range.
+  //
+  // The default implementation writes a batch holding only the range
+  // deletion.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key, const Slice& end_key);
+
+  // Record "operand" as an update of the entry for "key", to be combined
+  // with its current value by options.merge_operator when the key is
+  // read or compacted.  Unlike a Get() followed by a Put(), the current
+  // value is not read, and concurrent merges of the same key are never
+  // lost.  Returns NotSupported if the database was opened without a
+  // merge operator.
+  //
+  // The default implementation writes a batch holding only the merge.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& operand);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -123,6 +151,43 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Batched form of Get().  Looks up every key in "keys" against a single
+  // consistent view of the database.  On return, values->size() and
+  // statuses->size() equal keys.size(), and for each i (*statuses)[i]
+  // and (*values)[i] hold what Get(options, keys[i], ...) would have
+  // produced.  Keys may be given in any order and may repeat.
+  //
+  // The default implementation calls Get() once per key, under a snapshot
+  // it takes for the call if "options" does not name one.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
+  // Add the tables in "files", written by SstFileWriter, to the database
+  // without passing their entries through the log and the memtable.
+  // The files must not overlap each other.  Their entries become visible
+  // all at once, and take precedence over every entry written before the
+  // call.  Each table is placed at the deepest level where it overlaps
+  // nothing, so that data loaded into an empty key range is not
+  // compacted again.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::vector<std::string>& files);
+
+  // Create in the directory "checkpoint_dir", which must not exist yet, a
+  // database that holds everything written to this one before the call.
+  // It is built in "checkpoint_dir" + ".tmp", which must not exist either.
+  // The tables are hard linked where the Env supports that, and copied
+  // otherwise, so a checkpoint on the same file system takes little time
+  // or space however large the database is.  Writes may go on meanwhile.
+  // The checkpoint can be opened like any database, e.g. to back it up or
+  // to seed a replica.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -158,6 +223,11 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.statistics" - returns a multi-line string that describes the
+  //     tickers and histograms of Options::statistics, if it is set.
+  //  "leveldb.statistics-values" - returns the tickers of
+  //     Options::statistics and a summary of its histograms as one
+  //     "<name> <value>" pair per line, for consumption by programs.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
   /*
   {
@@ -117,6 +117,26 @@ class LEVELDB_EXPORT Env {
   // an Env that does not support appending.
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
+
+  // Like NewRandomAccessFile(), but the reads of the returned file bypass
+  // the operating system's page cache where possible, so that reading a
+  // large file once does not evict data that is read often.
+  //
+  // The default implementation calls NewRandomAccessFile().  EnvWrapper
+  // does not forward this call to its target, so that wrappers overriding
+  // NewRandomAccessFile() see every file that is opened.
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but the writes to the returned file bypass the
+  // operating system's page cache where possible.  Data appended to the
+  // file may not reach the file system until Sync() or Close(), even if
+  // Flush() is called.
+  //
+  // The default implementation calls NewWritableFile().  EnvWrapper does
+  // not forward this call to its target.
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
 // table cache. ->SST ->file handler; *result 在系统层面已经打开了，就没必要重复打开
 
   // Returns true iff the named file exists.
@@ -177,6 +197,13 @@ class LEVELDB_EXPORT Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Create target as a hard link to the existing file src, so that both
+  // names refer to the same contents.  Fails if target exists.
+  //
+  // The default implementation returns NotSupported; callers then copy
+  // the file instead.
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores nullptr in
   // *lock and returns non-OK.
@@ -198,6 +225,11 @@ class LEVELDB_EXPORT Env {
   // REQUIRES: lock has not already been unlocked.
   virtual Status UnlockFile(FileLock* lock) = 0;
 
+  // Background work is run by one pool of threads per priority, so that
+  // short, latency sensitive work (e.g. memtable flushes) does not have
+  // to wait behind long running work (e.g. compactions).
+  enum Priority { kLow = 0, kHigh = 1 };
+
   // Arrange to run "(*function)(arg)" once in a background thread.
   //
   // "function" may run in an unspecified thread.  Multiple functions
@@ -207,6 +239,27 @@ class LEVELDB_EXPORT Env {
   // 顺时针绕圈圈的读法
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(function, arg), but run "(*function)(arg)" in the pool
+  // of threads serving priority "pri".  Schedule(function, arg) is
+  // equivalent to Schedule(function, arg, kLow).
+  //
+  // The default implementation ignores "pri" and calls
+  // Schedule(function, arg).
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri);
+
+  // Set the number of threads in the pool serving priority "pri".  Pools
+  // start with one thread each.  The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
+  // Return the number of work items scheduled at priority "pri" that have
+  // not started running yet.  The default implementation returns 0.
+  virtual int GetThreadPoolQueueLen(Priority pri);
+
+  // Return the number of threads of the pool serving priority "pri" that
+  // are currently running a work item.  The default implementation
+  // returns 0.
+  virtual int GetThreadPoolActiveThreads(Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -258,6 +311,19 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// One read of a batch passed to RandomAccessFile::MultiRead().
+struct LEVELDB_EXPORT ReadRequest {
+  // Filled in by the caller.
+  uint64_t offset = 0;
+  size_t n = 0;
+  char* scratch = nullptr;  // Must hold at least "n" bytes
+
+  // Filled in by MultiRead(), with the same meaning as the "*result" and
+  // return value of RandomAccessFile::Read().
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
@@ -279,6 +345,22 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Hint that the bytes in [offset, offset + n) will be read soon, so that
+  // the implementation may start loading them in the background.
+  //
+  // Safe for concurrent use by multiple threads.  The default
+  // implementation does nothing.
+  virtual void Prefetch(uint64_t offset, size_t n) const;
+
+  // Perform the "n" reads described by "requests[0..n-1]", as if by calling
+  // Read() for each of them, and store the outcome of each read in its
+  // request.  Implementations may issue the reads concurrently so that
+  // their latencies overlap.
+  //
+  // Safe for concurrent use by multiple threads.  The default
+  // implementation calls Read() for each request in turn.
+  virtual void MultiRead(ReadRequest* requests, int n) const;
   /*
   scratch 为了释放内存用的
   RAII->constructor, deconstructor
@@ -400,6 +482,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) override {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) override {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) override {
     return target_->LockFile(f, l);
   }
@@ -407,6 +492,18 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    target_->SetBackgroundThreads(number, pri);
+  }
+  int GetThreadPoolQueueLen(Priority pri) override {
+    return target_->GetThreadPoolQueueLen(pri);
+  }
+  int GetThreadPoolActiveThreads(Priority pri) override {
+    return target_->GetThreadPoolActiveThreads(pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
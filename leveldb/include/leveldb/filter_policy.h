@@ -49,6 +49,15 @@ class LEVELDB_EXPORT FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // "filter" contains the data appended by a preceding call to
+  // CreateFilter() on this class.  Return false only if no key in the
+  // list passed to CreateFilter() shares the prefix of "key", as defined
+  // by the filter's own prefix scheme.
+  //
+  // The default implementation returns true: the filter knows of no
+  // prefixes.
+  virtual bool PrefixMayMatch(const Slice& key, const Slice& filter) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
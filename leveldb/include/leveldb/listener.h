@@ -0,0 +1,103 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An EventListener is told about the background work of a database as it
+// happens: the flushes of memtables, the compactions of tables, and the
+// changes in whether writes are being delayed or stopped.  It lets tools
+// react to that work, e.g. to throttle their own writes, without parsing
+// the info log.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+#define STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// A flush of the immutable memtable into a table.
+struct LEVELDB_EXPORT FlushJobInfo {
+  // The name the database was opened with.
+  std::string db_name;
+  // The number and size of the table written.  The size is zero, and no
+  // table was added, if the memtable held nothing to write.
+  uint64_t file_number = 0;
+  uint64_t file_size = 0;
+  // The level the table was added at.
+  int level = 0;
+  // Time spent writing the table.
+  uint64_t micros = 0;
+  // The result of the flush.
+  Status status;
+};
+
+// A compaction of tables into new tables.  Moves of a table to the next
+// level, which do not rewrite it, are not reported.
+struct LEVELDB_EXPORT CompactionJobInfo {
+  // The name the database was opened with.
+  std::string db_name;
+  // The level of the first input, and the level the outputs are added at.
+  int level = 0;
+  int output_level = 0;
+  // The numbers of the input tables, and the total of their sizes.
+  std::vector<uint64_t> input_files;
+  uint64_t bytes_read = 0;
+  // The numbers of the output tables, the total of their sizes, and the
+  // time spent compacting.  Not yet known when the compaction begins.
+  std::vector<uint64_t> output_files;
+  uint64_t bytes_written = 0;
+  uint64_t micros = 0;
+  // The result of the compaction.  OK when the compaction begins.
+  Status status;
+};
+
+// Whether writes are being slowed down or stopped to let the background
+// work catch up.
+enum WriteStallCondition {
+  // Writes proceed at full speed.
+  kWriteStallNone = 0,
+  // Each write is delayed by about a millisecond because level-0 has many
+  // tables.
+  kWriteStallDelayed = 1,
+  // Writes wait because both memtables are full, or because level-0 has
+  // too many tables.
+  kWriteStallStopped = 2
+};
+
+struct LEVELDB_EXPORT WriteStallInfo {
+  // The name the database was opened with.
+  std::string db_name;
+  WriteStallCondition previous = kWriteStallNone;
+  WriteStallCondition condition = kWriteStallNone;
+};
+
+// The callbacks are invoked from the background thread or from the writing
+// thread that did the work, without any lock of the database held, so they
+// may call the database (e.g. to read a property).  They delay that work
+// while they run, and so should return quickly.  A listener may be shared
+// by several databases, and must then be safe for concurrent use.
+class LEVELDB_EXPORT EventListener {
+ public:
+  virtual ~EventListener();
+
+  // Called after a flush of the immutable memtable finished or failed.
+  // Flushes that are part of opening the database are not reported.
+  virtual void OnFlushCompleted(const FlushJobInfo& /*info*/) {}
+
+  // Called before a compaction reads its inputs, and after it installed
+  // its outputs or failed.
+  virtual void OnCompactionBegin(const CompactionJobInfo& /*info*/) {}
+  virtual void OnCompactionCompleted(const CompactionJobInfo& /*info*/) {}
+
+  // Called when writes start or stop being delayed or stopped.
+  virtual void OnStallConditionChanged(const WriteStallInfo& /*info*/) {}
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_LISTENER_H_
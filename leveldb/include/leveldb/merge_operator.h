@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns read-modify-write updates into blind writes.  A
+// database opened with Options::merge_operator accepts DB::Merge(key,
+// operand), which records the operand without reading the current value
+// of key.  The operands are combined with that value, by the operator,
+// when the key is read and when it is compacted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Logger;
+class Slice;
+
+// The methods of a MergeOperator may be called concurrently from
+// multiple threads.
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of this operator.  It should change whenever the meaning
+  // of the operands does.
+  virtual const char* Name() const = 0;
+
+  // Store in *new_value the value of "key" after applying "operands",
+  // ordered from oldest to newest, to "existing_value", which is null if
+  // the key has no value (it was never written, or was deleted).  Return
+  // false if the operands cannot be applied; the read or compaction that
+  // needed the value then fails with a Corruption status.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value, Logger* logger) const = 0;
+
+  // Store in *new_value a single operand with the effect of applying
+  // "left_operand" and then "right_operand", and return true.  Return
+  // false if the two cannot be combined without the value they apply
+  // to.  Compactions use it to shrink runs of operands whose value lives
+  // in a deeper level.
+  //
+  // The default implementation returns false.
+  virtual bool PartialMerge(const Slice& key, const Slice& left_operand,
+                            const Slice& right_operand, std::string* new_value,
+                            Logger* logger) const;
+};
+
+// Return a new operator for counters held as 64-bit unsigned integers,
+// encoded as 8 little-endian bytes (see PutFixed64() in util/coding.h).
+// Each operand, in the same encoding, is added to the value; a key
+// without a value counts from zero.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewUInt64AddOperator();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
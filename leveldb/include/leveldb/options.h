@@ -12,11 +12,18 @@
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
+class EventListener;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
+class Statistics;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -30,6 +37,16 @@ enum CompressionType {
   kSnappyCompression = 0x1
   // 为什么16进制？ 因为可能会出现与或非这样的operator
 };
+
+// The compaction style decides how the tables of a database are merged
+// over time.
+enum CompactionStyle {
+  // NOTE: do not change the values of existing entries, as these are
+  // part of the C API.
+  kLevelCompaction = 0x0,
+  kUniversalCompaction = 0x1
+};
+
 // meta-knowledge
 // debugger -> edits -> re-build -> fail/success
 
@@ -114,6 +131,14 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, data blocks are cut before they would outgrow block_size,
+  // counting their trailer, and each one starts at a multiple of 4KB, the
+  // gaps being filled with zeros.  A block of at most 4KB is then read
+  // with a single aligned page, which suits direct I/O (see
+  // use_direct_io_for_flush_and_compaction).  Works best with a
+  // block_size that is a multiple of 4KB and without compression.
+  bool block_align = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -124,6 +149,86 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Maximum number of threads that may work on a single compaction.  A
+  // compaction whose inputs span several files is split into up to this
+  // many disjoint key ranges that are merged concurrently, and whose
+  // outputs are installed together.  The thread running the compaction
+  // takes the first range, and the others are scheduled in the Env::kLow
+  // pool, which runs them alongside only while it has idle threads; the
+  // ranges that do not get one are merged by the compaction's own thread.
+  // A value of 1 disables this.
+  int max_subcompactions = 1;
+
+  // Maximum number of compactions that may run at the same time, as long
+  // as their inputs and outputs do not overlap.  Each compaction runs in
+  // a thread of the Env::kLow pool, so that pool needs at least this many
+  // threads (see Env::SetBackgroundThreads) for this to take effect.
+  int max_background_compactions = 1;
+
+  // How tables are merged.  kLevelCompaction keeps each level above
+  // level-0 a single sorted run ten times larger than the previous one,
+  // which bounds read and space amplification.  kUniversalCompaction
+  // treats every level-0 file and every other non-empty level as a sorted
+  // run, and merges runs of similar size once there are too many of them.
+  // Each entry is then rewritten far fewer times, at the cost of more runs
+  // to search and of up to twice the space while all runs are merged.
+  // The style may be changed when the database is reopened.
+  CompactionStyle compaction_style = kLevelCompaction;
+
+  // kUniversalCompaction only: a sorted run is merged with the newer runs
+  // before it if it is at most this percentage larger than their combined
+  // size.
+  int universal_size_ratio = 1;
+
+  // kUniversalCompaction only: all sorted runs are merged together once
+  // the newer runs take more than this percentage of the size of the
+  // oldest one, which bounds the space held by overwritten entries.
+  int universal_max_size_amplification_percent = 200;
+
+  // kLevelCompaction only: if true, the size limit of each level is a
+  // tenth of the size of the next one, working back from the actual size
+  // of the largest level, rather than 10MB for level-1, 100MB for level-2,
+  // and so on.  Level-0 files are then compacted into the first level that
+  // needs to hold data, and the levels above it stay empty.  This bounds
+  // the space taken by overwritten entries to about a tenth of the
+  // database, and spares reads of small databases from searching levels
+  // that hold little data.
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // If true, once a group of concurrent writes has been appended to the
+  // log, every writer in the group inserts its own batch into the
+  // memtable, in parallel with the others, instead of the first writer
+  // inserting all of them.  Speeds up small writes issued by many threads.
+  bool allow_concurrent_memtable_write = false;
+
+  // If true, a group of writes is appended to the log while the previous
+  // group is still being inserted into the memtable, rather than after
+  // it.  Sequence numbers still become visible to readers in order.
+  // Improves write throughput when many threads write at once.
+  bool enable_pipelined_write = false;
+
+  // If non-null, the tables and value logs written by flushes and
+  // compactions are written no faster than the limiter allows, flushes
+  // taking precedence over compactions, so that background work leaves
+  // disk bandwidth to the reads of the application.  The limiter may be
+  // shared by several databases, and its rate changed while they are open.
+  RateLimiter* rate_limiter = nullptr;
+
+  // If true, compactions read their input tables, and flushes and
+  // compactions write their output files, with direct I/O (see
+  // Env::NewDirectWritableFile), bypassing the operating system's page
+  // cache, so that they do not evict the data that reads of the
+  // application depend on.  Compaction inputs are then opened separately
+  // from the table cache.  Falls back to buffered I/O where the Env or
+  // the file system lacks direct I/O.
+  bool use_direct_io_for_flush_and_compaction = false;
+
+  // If non-zero, compactions read their input tables this many bytes at a
+  // time, rather than one block at a time, and the input tables are then
+  // opened separately from the table cache.  A few megabytes make
+  // compactions much faster on spinning disks and network block devices.
+  size_t compaction_readahead_size = 0;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -150,6 +255,70 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-null, and filter_policy is non-null too, the prefix of every
+  // key is added to the filters, so that iterators created with
+  // ReadOptions::prefix_same_as_start skip the tables and blocks that
+  // hold no key with the prefix of their Seek() target.  Applies to the
+  // tables written after it is set.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If false, and prefix_extractor is non-null, the filters only hold
+  // prefixes.  They are smaller, but Get() of a missing key can then
+  // only be avoided when no key shares its prefix.
+  bool whole_key_filtering = true;
+
+  // If true, the index and filter of each table are split into partitions
+  // of about metadata_block_size bytes, under a small top-level index
+  // that stays in memory while the table is open.  The partitions are
+  // read on demand and kept in the block cache, so very large tables do
+  // not pin their whole index and filter in memory.  Applies to the
+  // tables written after it is set; tables written with it cannot be
+  // read by versions of leveldb that do not support it.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of the index and filter partitions written when
+  // partition_index_and_filters is true.
+  size_t metadata_block_size = 4 * 1024;
+
+  // If non-zero, values of at least this many bytes are moved out of the
+  // tables into value log files when the memtable is written to a table,
+  // and the tables only keep a small handle to them.  Compactions then
+  // rewrite the keys without copying large values around, which greatly
+  // reduces write amplification for large values, at the cost of one
+  // more read per Get() of such a value.  Databases holding value log
+  // files cannot be read by versions of leveldb that do not support them.
+  size_t value_log_threshold = 0;
+
+  // Value log files are garbage collected once more than this fraction
+  // of their bytes belongs to values that were overwritten or deleted:
+  // compactions then copy the live values out of the oldest value log
+  // files so that those can be removed.
+  double value_log_gc_ratio = 0.5;
+
+  // If non-null, the database counts the block cache and filter lookups,
+  // the bytes read and written and the latencies of its operations in the
+  // specified object (see NewStatistics()), and reports them through the
+  // "leveldb.statistics" property.  The object may be shared by several
+  // databases.
+  Statistics* statistics = nullptr;
+
+  // If non-null, the database tells the specified object about its
+  // flushes, its compactions and the stalls of its writes as they happen
+  // (see leveldb/listener.h).  The object may be shared by several
+  // databases.
+  EventListener* listener = nullptr;
+
+  // If non-null, DB::Merge() is supported, and the merge operands it
+  // writes are combined with the values of their keys by the specified
+  // operator (see leveldb/merge_operator.h).  A database holding merge
+  // operands must always be opened with an operator of the same meaning.
+  const MergeOperator* merge_operator = nullptr;
+
+  // If non-null, compactions pass the values they keep to the specified
+  // filter, which may remove them or change them (see
+  // leveldb/compaction_filter.h).
+  const CompactionFilter* compaction_filter = nullptr;
 };
 
 // Options that control read operations
@@ -167,6 +336,26 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true, and the database has a prefix_extractor, an iterator
+  // positioned by Seek() only yields the keys that have the same prefix
+  // as the Seek() target, and uses the prefix filters to skip the data
+  // that cannot hold any.  Prev() is not supported after such a Seek().
+  // Targets without a prefix are sought as usual.
+  bool prefix_same_as_start = false;
+
+  // If non-null, iterators only yield the keys at or after
+  // "*iterate_lower_bound": Seek() and SeekToFirst() skip the smaller
+  // keys, and Prev() stops before them.  The tables and blocks that only
+  // hold smaller keys are not read.  The bound must outlive the iterator.
+  const Slice* iterate_lower_bound = nullptr;
+
+  // If non-null, iterators only yield the keys before
+  // "*iterate_upper_bound": Next() stops at the first key at or after
+  // it, and SeekToLast() starts before it.  The tables and blocks that
+  // only hold larger keys are not read.  The bound must outlive the
+  // iterator.
+  const Slice* iterate_upper_bound = nullptr;
 };
 
 // Options that control write operations
@@ -190,6 +379,17 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the files are hard linked into the database where the Env
+  // supports that, and copied otherwise, and are removed from their
+  // original place once ingested.  If false, the files are copied and
+  // left as they are.
+  bool move_files = false;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down the work done by the operations of the calling
+// thread, so that the cost of one slow Get() or Seek() can be attributed
+// to the stage that caused it.  It is off by default:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   ... inspect *leveldb::GetPerfContext() ...
+//   leveldb::SetPerfLevel(leveldb::kDisable);
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+// How much of the PerfContext is collected.
+enum PerfLevel {
+  // Collect nothing.
+  kDisable = 0,
+  // Collect the counters, which costs an increment per event.
+  kEnableCount = 1,
+  // Collect the counters and the timers, which costs two clock reads per
+  // timed stage.
+  kEnableTime = 2
+};
+
+// Set or get the perf level of the calling thread.
+LEVELDB_EXPORT void SetPerfLevel(PerfLevel level);
+LEVELDB_EXPORT PerfLevel GetPerfLevel();
+
+// Counters and timers of the work done by the calling thread.  The values
+// accumulate until Reset() is called.  The timers are in nanoseconds.
+struct LEVELDB_EXPORT PerfContext {
+  PerfContext() { Reset(); }
+
+  // Set every counter and timer to zero.
+  void Reset();
+
+  // Return the counters and timers as "name = value" pairs.  Omits the
+  // values that are zero if "exclude_zero_counters" is true.
+  std::string ToString(bool exclude_zero_counters = false) const;
+
+  // Memtables searched by Get(), and the time spent searching them.
+  uint64_t get_from_memtable_count;
+  uint64_t get_from_memtable_nanos;
+  // Time that Get() spent searching the tables, including the stages
+  // below.
+  uint64_t get_from_output_files_nanos;
+  // Time that Get() spent waiting to acquire the database mutex.
+  uint64_t db_mutex_lock_nanos;
+
+  // Table files searched by Get(), and the time spent finding them in the
+  // table cache, which includes opening the ones that were not there.
+  uint64_t get_from_table_count;
+  uint64_t find_table_nanos;
+  uint64_t table_open_count;
+
+  // Filter probes that ruled out a data block, and those that did not,
+  // and the time spent probing.
+  uint64_t bloom_filter_useful_count;
+  uint64_t bloom_filter_may_match_count;
+  uint64_t filter_probe_nanos;
+
+  // Lookups of data blocks in the block cache.
+  uint64_t block_cache_hit_count;
+  uint64_t block_cache_miss_count;
+
+  // Blocks read from table files, their bytes, and the time spent reading,
+  // checksumming and decompressing them.
+  uint64_t block_read_count;
+  uint64_t block_read_bytes;
+  uint64_t block_read_nanos;
+  uint64_t block_checksum_nanos;
+  uint64_t block_decompress_nanos;
+
+  // Time that iterators spent seeking the memtables and tables, and the
+  // entries they stepped over because they were overwritten or deleted.
+  uint64_t seek_internal_nanos;
+  uint64_t internal_key_skipped_count;
+  uint64_t internal_delete_skipped_count;
+};
+
+// Return the PerfContext of the calling thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which a database writes in the
+// background.  A database opened with Options::rate_limiter asks it for
+// permission before every write of the tables and value logs produced by
+// flushes and compactions, so that those writes leave enough disk
+// bandwidth to the reads of the application.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Env;
+
+// A RateLimiter may be shared by several databases, and is safe for
+// concurrent use from multiple threads.
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  enum Priority {
+    // Compactions
+    kLow = 0,
+    // Flushes of the memtable, which writes wait for
+    kHigh = 1
+  };
+
+  virtual ~RateLimiter();
+
+  // Block until "bytes" may be written at the specified priority.
+  // Requests of high priority go before the waiting requests of low
+  // priority.
+  virtual void Request(int64_t bytes, Priority priority) = 0;
+
+  // Change the rate limit.  Takes effect for the requests that are
+  // waiting too.
+  // REQUIRES: bytes_per_second > 0
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the current rate limit.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the number of bytes requested so far at the specified priority.
+  virtual int64_t GetTotalBytesThrough(Priority priority) const = 0;
+
+  // Return the total time that requests of the specified priority spent
+  // waiting for the rate limit, in microseconds.
+  virtual uint64_t GetTotalThrottledMicros(Priority priority) const = 0;
+};
+
+// Return a new token bucket rate limiter that lets through at most
+// "bytes_per_second" bytes per second.  Tokens are added every 100
+// milliseconds, and at most 100 milliseconds worth of them may be
+// accumulated, so writes cannot burst past the limit for long.  Uses
+// "env" (Env::Default() if null) to measure and wait for time.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT RateLimiter* NewRateLimiter(int64_t bytes_per_second,
+                                           Env* env = nullptr);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to its prefix.  A database opened with
+// Options::prefix_extractor adds the prefix of every key to its table
+// filters, so that a Seek() limited to one prefix (see
+// ReadOptions::prefix_same_as_start) can skip the tables and blocks
+// that hold no key with that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+// The prefixes returned by Transform() must be prefixes of the keys
+// themselves, in the sense that all keys with the same prefix sort next
+// to each other under the comparator of the database, and a prefix
+// must be its own prefix: Transform(Transform(key)) == Transform(key).
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // The name of this transform.  Filters built with one transform are
+  // never consulted for another, so the name must change whenever the
+  // prefixes returned for the same keys change.
+  virtual const char* Name() const = 0;
+
+  // Return true iff "key" has a prefix.  Keys without one are always
+  // looked up as a whole.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Return the prefix of "key".  The result refers to the memory of
+  // "key".
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// keys.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+// Return a new transform whose prefix runs up to and including the
+// "num_fields"-th occurrence of "delimiter" in keys.  Keys with fewer
+// delimiters have no prefix.  For example, with delimiter '|' and two
+// fields the prefix of "tenant|entity|ts" is "tenant|entity|".
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewDelimitedPrefixTransform(
+    char delimiter, int num_fields);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table outside of any database, for handing over
+// to DB::IngestExternalFile().  This lets bulk loads skip the log and the
+// memtable, and the compactions that would push their data down the
+// levels.
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // "options" must match those of the database the file will be ingested
+  // into in its comparator, filter policy, prefix extractor and
+  // whole_key_filtering, as those shape the contents of the file.  Its
+  // block and compression settings apply to the file.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Deletes the file being written if Finish() was not called.
+  ~SstFileWriter();
+
+  // Create the file named "fname" and start writing to it, replacing any
+  // file in progress.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value", or that deletes "key".
+  // REQUIRES: key is after any previously added key according to the
+  // comparator.  Returns InvalidArgument otherwise.
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Finish writing the file, and sync and close it.  Returns
+  // InvalidArgument, and deletes the file, if no entry was added.
+  Status Finish();
+
+  // Size of the file written so far.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* const rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -0,0 +1,147 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object collects counters ("tickers") and latency histograms
+// for the operations of the databases that use it.  A database opened with
+// Options::statistics updates it as it serves reads and writes and runs
+// flushes and compactions, and reports it through the "leveldb.statistics"
+// and "leveldb.statistics-values" properties of DB::GetProperty().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum Ticker : uint32_t {
+  // Lookups of data blocks in Options::block_cache.
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+  // Data blocks added to Options::block_cache.
+  kBlockCacheAdd,
+  // Lookups of open tables in the table cache.
+  kTableCacheHit,
+  kTableCacheMiss,
+  // Lookups for which the filter of a data block ruled out the key, so
+  // that the block was not read.
+  kBloomFilterUseful,
+  // Lookups for which the filter of a data block said the key may be
+  // present, so that the block was read.
+  kBloomFilterMayMatch,
+  // Point lookups answered by the memtables, and those that were not.
+  kMemtableHit,
+  kMemtableMiss,
+  // Keys looked up by Get() and MultiGet(), and the bytes of the values
+  // found.
+  kNumberKeysRead,
+  kBytesRead,
+  // Entries written by Write(), and the bytes of their batches.
+  kNumberKeysWritten,
+  kBytesWritten,
+  // Bytes appended to the write-ahead log, and syncs of the log.
+  kWalBytes,
+  kWalSyncs,
+  // Bytes of the tables written by flushes of the memtable.
+  kFlushBytesWritten,
+  // Bytes of the tables read and written by compactions.
+  kCompactionBytesRead,
+  kCompactionBytesWritten,
+  // Time that writes spent delayed or stopped waiting for flushes and
+  // compactions to catch up, in microseconds.
+  kStallMicros,
+  kTickerMax
+};
+
+enum HistogramType : uint32_t {
+  // Latency of the operations of a DB, in microseconds.
+  kDBGetMicros = 0,
+  kDBMultiGetMicros,
+  kDBWriteMicros,
+  // Latency of the syncs of the write-ahead log.
+  kWalSyncMicros,
+  // Time spent opening a table file and reading its index.
+  kTableOpenMicros,
+  // Duration of flushes and compactions.
+  kFlushMicros,
+  kCompactionMicros,
+  kHistogramMax
+};
+
+// Counters that are kept for each level of the LSM tree.
+enum LevelTicker : uint32_t {
+  // Bytes of the tables read from the level by compactions.
+  kLevelBytesRead = 0,
+  // Bytes of the tables written to the level by flushes and compactions.
+  kLevelBytesWritten,
+  kLevelTickerMax
+};
+
+// A summary of the values recorded in a histogram.
+struct LEVELDB_EXPORT HistogramData {
+  double count;
+  double sum;
+  double min;
+  double max;
+  double average;
+  double median;
+  double percentile95;
+  double percentile99;
+  double standard_deviation;
+};
+
+// A Statistics object may be shared by several databases, and is safe for
+// concurrent use from multiple threads.
+class LEVELDB_EXPORT Statistics {
+ public:
+  // Levels at or past this one are counted with it by the level tickers.
+  static const int kMaxLevel = 6;
+
+  virtual ~Statistics();
+
+  // Add "count" to the specified ticker.
+  virtual void RecordTick(Ticker ticker, uint64_t count) = 0;
+
+  // Add "count" to the specified ticker of "level".
+  virtual void RecordLevelTick(LevelTicker ticker, int level,
+                               uint64_t count) = 0;
+
+  // Add "value" to the specified histogram.
+  virtual void MeasureTime(HistogramType histogram, uint64_t value) = 0;
+
+  virtual uint64_t GetTickerCount(Ticker ticker) const = 0;
+  virtual uint64_t GetLevelTickerCount(LevelTicker ticker,
+                                       int level) const = 0;
+  virtual void GetHistogramData(HistogramType histogram,
+                                HistogramData* data) const = 0;
+
+  // Reset every ticker and histogram to zero.
+  virtual void Reset() = 0;
+
+  // Return a human-readable report of every ticker and histogram.
+  virtual std::string ToString() const = 0;
+
+  // Return every ticker and a summary of every histogram as one
+  // "<name> <value>" pair per line, for consumption by programs.
+  virtual std::string ToValues() const = 0;
+};
+
+// Return the name of a ticker or histogram, such as "block.cache.hit".
+LEVELDB_EXPORT const char* TickerName(Ticker ticker);
+LEVELDB_EXPORT const char* LevelTickerName(LevelTicker ticker);
+LEVELDB_EXPORT const char* HistogramName(HistogramType histogram);
+
+// Return a new Statistics object that keeps its tickers in atomic
+// counters.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT Statistics* NewStatistics();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
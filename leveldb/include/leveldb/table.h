@@ -50,6 +50,10 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the entries the table was given through
+  // TableBuilder::AddRangeTombstone(), or nullptr if there are none.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -58,11 +62,23 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Given a key, return the approximate fraction of the table's data, in
+  // [0,1], that lies in the data blocks up to and including the one
+  // where the data for that key is.  Used to prorate what the entries
+  // refer to outside the file, such as value log records.
+  double ApproximateFractionThrough(const Slice& key) const;
+
  private:
   friend class TableCache;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // Like BlockReader(), for a table iterator that reads ahead.
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static bool BlockMayMatchPrefix(void*, const ReadOptions&,
+                                  const Slice& index_value,
+                                  const Slice& target);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
@@ -73,8 +89,41 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
-  void ReadMeta(const Footer& footer);
+  // Batched form of InternalGet().  "keys[0,n-1]" must be sorted in
+  // increasing order.  For each i, calls (*handle_result)(args[i], ...)
+  // with the entry found after a Seek(keys[i]) and stores the outcome of
+  // that lookup in statuses[i].  Keys that fall into the same data block
+  // share a single read and decode of that block.
+  void InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                        void* const* args, Status* statuses,
+                        void (*handle_result)(void* arg, const Slice& k,
+                                              const Slice& v));
+
+  // Returns false if the filter says that no key at or after "key" in
+  // the table shares the prefix of "key".
+  bool PrefixMayMatch(const Slice& key) const;
+
+  // Returns a new iterator over the index entries of the data blocks,
+  // reading the index partitions if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  bool HasFilter() const;
+
+  // Returns false if the filter of the block at "block_offset" says that
+  // it holds no "key" or, if "prefix" is true, no key with the prefix of
+  // "key".  Loads the filter partition covering the block if needed.
+  bool FilterMayMatch(const ReadOptions&, uint64_t block_offset,
+                      const Slice& key, bool prefix) const;
+
+  // FilterMayMatch() for a point lookup of "key", counted in the
+  // statistics of the table's options.
+  bool KeyMayMatch(const ReadOptions&, uint64_t block_offset,
+                   const Slice& key) const;
+
+  Status ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilterIndex(const Slice& filter_index_handle_value);
+  Status ReadRangeDelBlock(const Slice& range_del_handle_value);
 
   Rep* const rep_;
 };
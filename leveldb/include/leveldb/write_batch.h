@@ -37,6 +37,10 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin_key, const Slice& end_key);
+    // The default implementation ignores merges.
+    virtual void Merge(const Slice& key, const Slice& operand);
   };
 
   WriteBatch();
@@ -53,6 +57,14 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in [begin_key, end_key).  Does
+  // nothing if begin_key >= end_key.
+  void DeleteRange(const Slice& begin_key, const Slice& end_key);
+
+  // Combine "operand" with the value of "key" using the merge operator
+  // of the database (see DB::Merge()).
+  void Merge(const Slice& key, const Slice& operand);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
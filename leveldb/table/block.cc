@@ -88,6 +88,18 @@ class Block::Iter : public Iterator {
   Slice value_;
   Status status_;
 
+  // The entries of a restart interval decoded by Prev() or SeekToLast(),
+  // so that moving back within the interval need not decode it again.
+  struct CachedEntry {
+    uint32_t offset;      // Offset of the entry in data_
+    uint32_t key_offset;  // Offset of its key in prev_entry_keys_
+    uint32_t key_size;
+    Slice value;
+  };
+  std::vector<CachedEntry> prev_entries_;
+  std::string prev_entry_keys_;
+  int prev_entries_index_;  // Of the current entry in prev_entries_, or -1
+
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
   }
@@ -112,6 +124,25 @@ class Block::Iter : public Iterator {
     value_ = Slice(data_ + offset, 0);
   }
 
+  // Move to the last entry of restart interval "index" that starts before
+  // offset "limit", caching the entries of the interval up to it.
+  void DecodeRestartInterval(uint32_t index, uint32_t limit) {
+    SeekToRestartPoint(index);
+    prev_entries_.clear();
+    prev_entry_keys_.clear();
+    while (ParseNextKey()) {
+      prev_entries_.push_back({current_,
+                               static_cast<uint32_t>(prev_entry_keys_.size()),
+                               static_cast<uint32_t>(key_.size()), value_});
+      prev_entry_keys_.append(key_);
+      if (NextEntryOffset() >= limit) {
+        break;
+      }
+    }
+    prev_entries_index_ =
+        Valid() ? static_cast<int>(prev_entries_.size()) - 1 : -1;
+  }
+
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
        uint32_t num_restarts)
@@ -120,7 +151,8 @@ class Block::Iter : public Iterator {
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        prev_entries_index_(-1) {
     assert(num_restarts_ > 0);
   }
 
@@ -137,12 +169,23 @@ class Block::Iter : public Iterator {
 
   void Next() override {
     assert(Valid());
+    prev_entries_index_ = -1;
     ParseNextKey();
   }
 
   void Prev() override {
     assert(Valid());
 
+    if (prev_entries_index_ > 0) {
+      // The previous entry is in the same restart interval, which an
+      // earlier call decoded
+      const CachedEntry& entry = prev_entries_[--prev_entries_index_];
+      current_ = entry.offset;
+      key_.assign(prev_entry_keys_.data() + entry.key_offset, entry.key_size);
+      value_ = entry.value;
+      return;
+    }
+
     // Scan backwards to a restart point before current_
     const uint32_t original = current_;
     while (GetRestartPoint(restart_index_) >= original) {
@@ -150,18 +193,18 @@ class Block::Iter : public Iterator {
         // No more entries
         current_ = restarts_;
         restart_index_ = num_restarts_;
+        prev_entries_index_ = -1;
         return;
       }
       restart_index_--;
     }
 
-    SeekToRestartPoint(restart_index_);
-    do {
-      // Loop until end of current entry hits the start of original entry
-    } while (ParseNextKey() && NextEntryOffset() < original);
+    // Decode the interval up to the entry before the original one
+    DecodeRestartInterval(restart_index_, original);
   }
 
   void Seek(const Slice& target) override {
+    prev_entries_index_ = -1;
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -227,15 +270,13 @@ class Block::Iter : public Iterator {
   }
 
   void SeekToFirst() override {
+    prev_entries_index_ = -1;
     SeekToRestartPoint(0);
     ParseNextKey();
   }
 
   void SeekToLast() override {
-    SeekToRestartPoint(num_restarts_ - 1);
-    while (ParseNextKey() && NextEntryOffset() < restarts_) {
-      // Keep skipping
-    }
+    DecodeRestartInterval(num_restarts_ - 1, restarts_);
   }
 
  private:
@@ -245,6 +286,7 @@ class Block::Iter : public Iterator {
     status_ = Status::Corruption("bad entry in block");
     key_.clear();
     value_.clear();
+    prev_entries_index_ = -1;
   }
 
   bool ParseNextKey() {
@@ -48,6 +48,10 @@ Slice FilterBlockBuilder::Finish() {
   return Slice(result_);
 }
 
+size_t FilterBlockBuilder::CurrentSizeEstimate() const {
+  return result_.size() + filter_offsets_.size() * 4 + 5;
+}
+
 void FilterBlockBuilder::GenerateFilter() {
   const size_t num_keys = start_.size();
   if (num_keys == 0) {
@@ -74,6 +78,15 @@ void FilterBlockBuilder::GenerateFilter() {
   start_.clear();
 }
 
+std::string FilterPartitionIndexKey(uint64_t limit) {
+  // Big-endian, so that the keys sort bytewise in the order of the limits
+  char buf[sizeof(limit)];
+  for (size_t i = 0; i < sizeof(limit); i++) {
+    buf[i] = static_cast<char>(limit >> (8 * (sizeof(limit) - 1 - i)));
+  }
+  return std::string(buf, sizeof(buf));
+}
+
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
                                      const Slice& contents)
     : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
@@ -87,20 +100,39 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
   num_ = (n - 5 - last_word) / 4;
 }
 
-bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+bool FilterBlockReader::FindFilter(uint64_t block_offset,
+                                   Slice* filter) const {
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
     uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
     if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
-      Slice filter = Slice(data_ + start, limit - start);
-      return policy_->KeyMayMatch(key, filter);
+      *filter = Slice(data_ + start, limit - start);
+      return true;
     } else if (start == limit) {
       // Empty filters do not match any keys
-      return false;
+      *filter = Slice();
+      return true;
     }
   }
-  return true;  // Errors are treated as potential matches
+  return false;
+}
+
+bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  Slice filter;
+  if (!FindFilter(block_offset, &filter)) {
+    return true;  // Errors are treated as potential matches
+  }
+  return policy_->KeyMayMatch(key, filter);
+}
+
+bool FilterBlockReader::PrefixMayMatch(uint64_t block_offset,
+                                       const Slice& key) {
+  Slice filter;
+  if (!FindFilter(block_offset, &filter)) {
+    return true;  // Errors are treated as potential matches
+  }
+  return policy_->PrefixMayMatch(key, filter);
 }
 
 }  // namespace leveldb
@@ -38,6 +38,9 @@ class FilterBlockBuilder {
   void AddKey(const Slice& key);
   Slice Finish();
 
+  // Returns an estimate of the size of the filters generated so far.
+  size_t CurrentSizeEstimate() const;
+
  private:
   void GenerateFilter();
 
@@ -49,13 +52,29 @@ class FilterBlockBuilder {
   std::vector<uint32_t> filter_offsets_;
 };
 
+// A partitioned filter splits the filters of a table into several filter
+// blocks, each covering the data blocks in [base, limit) and built with
+// offsets relative to base.  A top-level index maps
+// FilterPartitionIndexKey(limit) to the handle of the partition followed
+// by its varint64 base, so that the partition covering a data block is
+// the first entry at or after FilterPartitionIndexKey(offset + 1).
+std::string FilterPartitionIndexKey(uint64_t limit);
+
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Return false only if no key of the block at "block_offset" shares
+  // the prefix of "key" (see FilterPolicy::PrefixMayMatch).
+  bool PrefixMayMatch(uint64_t block_offset, const Slice& key);
+
  private:
+  // If the filter of the block at "block_offset" can be found, store it
+  // in *filter and return true.
+  bool FindFilter(uint64_t block_offset, Slice* filter) const;
+
   const FilterPolicy* policy_;
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
@@ -4,11 +4,14 @@
 
 #include "table/format.h"
 
+#include <vector>
+
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_timer.h"
 
 namespace leveldb {
 
@@ -33,8 +36,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_index_ ? kPartitionedTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -45,9 +50,10 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber && magic != kPartitionedTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  partitioned_index_ = (magic == kPartitionedTableMagicNumber);
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -61,22 +67,13 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
+// Check the type/crc trailer of the block that was read into "contents"
+// and decode the block into *result.  "buf" is the scratch buffer that was
+// passed to the read; takes ownership of it.
+static Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                          const Slice& contents, char* buf,
+                          BlockContents* result) {
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -85,12 +82,12 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   // Check the crc of the type and the block contents
   const char* data = contents.data();  // Pointer to where Read put the data
   if (options.verify_checksums) {
+    PerfTimer checksum_timer(&PerfContext::block_checksum_nanos);
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -113,6 +110,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
       // Ok
       break;
     case kSnappyCompression: {
+      PerfTimer decompress_timer(&PerfContext::block_decompress_nanos);
       size_t ulength = 0;
       if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
         delete[] buf;
@@ -138,4 +136,56 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  PerfTimer read_timer(&PerfContext::block_read_nanos);
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  read_timer.Stop();
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_bytes, contents.size());
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  return DecodeBlock(options, handle, contents, buf, result);
+}
+
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, int n, BlockContents* results,
+                Status* statuses) {
+  std::vector<ReadRequest> requests(n);
+  for (int i = 0; i < n; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    requests[i].offset = handles[i].offset();
+    requests[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    requests[i].scratch = new char[requests[i].n];
+  }
+  PerfTimer read_timer(&PerfContext::block_read_nanos);
+  file->MultiRead(requests.data(), n);
+  read_timer.Stop();
+  PerfCount(&PerfContext::block_read_count, n);
+  for (int i = 0; i < n; i++) {
+    const ReadRequest& r = requests[i];
+    PerfCount(&PerfContext::block_read_bytes, r.result.size());
+    if (!r.status.ok()) {
+      delete[] r.scratch;
+      statuses[i] = r.status;
+    } else {
+      statuses[i] =
+          DecodeBlock(options, handles[i], r.result, r.scratch, &results[i]);
+    }
+  }
+}
+
 }  // namespace leveldb
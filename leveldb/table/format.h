@@ -52,7 +52,7 @@ class Footer {
   // of two block handles and a magic number.
   enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
 
-  Footer() = default;
+  Footer() : partitioned_index_(false) {}
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -62,12 +62,19 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // True iff the index block is a top-level index whose entries point to
+  // index partitions rather than to data blocks.  Such tables carry a
+  // different magic number so that older readers reject them.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,9 +82,20 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// kPartitionedTableMagicNumber was picked the same way from
+//    echo -n http://code.google.com/p/leveldb/partitioned | sha1sum
+static const uint64_t kPartitionedTableMagicNumber = 0xef8b5644ba1d6a1bull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Key of the metaindex entry that locates the range tombstone block.
+static const char kRangeDelBlockName[] = "rangedel";
+
+// Prefix of the metaindex key that locates the top-level index of a
+// partitioned filter; the filter policy name follows it.
+static const char kPartitionedFilterBlockPrefix[] = "partitionedfilter.";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -89,6 +107,14 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Read the blocks identified by "handles[0,n-1]" from "file" with a single
+// RandomAccessFile::MultiRead() call, so that the reads may be in flight at
+// the same time.  Stores the outcome of each read as ReadBlock() would in
+// results[i] and statuses[i].
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, int n, BlockContents* results,
+                Status* statuses);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
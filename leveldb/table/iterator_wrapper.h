@@ -33,6 +33,15 @@ class IteratorWrapper {
     }
   }
 
+  // Returns the wrapped iterator, which the caller then owns, and
+  // leaves the wrapper empty.
+  Iterator* Release() {
+    Iterator* iter = iter_;
+    iter_ = nullptr;
+    valid_ = false;
+    return iter;
+  }
+
   // Iterator interface methods
   bool Valid() const { return valid_; }
   Slice key() const {
@@ -4,6 +4,9 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -14,6 +17,8 @@
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_timer.h"
+#include "util/stop_watch.h"
 
 namespace leveldb {
 
@@ -21,6 +26,8 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
+    delete filter_index;
+    delete range_del_block;
     delete index_block;
   }
 
@@ -30,11 +37,29 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  Block* filter_index;     // Top-level index of a partitioned filter, if any
+  Block* range_del_block;  // nullptr if the table has no range tombstones
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  bool partitioned_index;  // index_block points to index partitions
 };
 
+namespace {
+// A partition of a partitioned filter, as kept in the block cache.
+struct FilterPartition {
+  FilterPartition(const FilterPolicy* policy, const BlockContents& contents)
+      : data(contents.heap_allocated ? contents.data.data() : nullptr),
+        size(contents.data.size()),
+        reader(policy, contents.data) {}
+  ~FilterPartition() { delete[] data; }
+
+  const char* data;  // nullptr if the contents are not owned
+  size_t size;
+  FilterBlockReader reader;
+};
+}  // namespace
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -69,23 +94,30 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->partitioned_index = footer.partitioned_index();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->filter_index = nullptr;
+    rep->range_del_block = nullptr;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+Status Table::ReadMeta(const Footer& footer) {
+  // An empty block holds nothing but its restart array: one restart point
+  // and the number of restart points.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return Status::OK();  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -93,19 +125,34 @@ void Table::ReadMeta(const Footer& footer) {
   BlockContents contents;
   if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
     // Do not propagate errors since meta info is not needed for operation
-    return;
+    return Status::OK();
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+    key = kPartitionedFilterBlockPrefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilterIndex(iter->value());
+    }
+  }
+  // Unlike the filter, the range tombstones are needed for correct reads.
+  Status s;
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    s = ReadRangeDelBlock(iter->value());
   }
   delete iter;
   delete meta;
+  return s;
 }
 
 void Table::ReadFilter(const Slice& filter_handle_value) {
@@ -131,6 +178,45 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadFilterIndex(const Slice& filter_index_handle_value) {
+  Slice v = filter_index_handle_value;
+  BlockHandle filter_index_handle;
+  if (!filter_index_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // The partitions themselves are read on demand (see FilterMayMatch)
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_index_handle, &block).ok()) {
+    return;
+  }
+  rep_->filter_index = new Block(block);
+}
+
+Status Table::ReadRangeDelBlock(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle range_del_handle;
+  Status s = range_del_handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Range tombstones are consulted by every read of the table, so keep
+  // them in memory for the lifetime of the table.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, range_del_handle, &block);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(block);
+  }
+  return s;
+}
+
 Table::~Table() { delete rep_; }
 
 static void DeleteBlock(void* arg, void* ignored) {
@@ -142,6 +228,10 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCachedFilterPartition(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
@@ -154,6 +244,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
   Cache* block_cache = table->rep_->options.block_cache;
+  Statistics* statistics = table->rep_->options.statistics;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -172,14 +263,19 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
+        RecordTick(statistics, kBlockCacheHit);
+        PerfCount(&PerfContext::block_cache_hit_count);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
+        RecordTick(statistics, kBlockCacheMiss);
+        PerfCount(&PerfContext::block_cache_miss_count);
         s = ReadBlock(table->rep_->file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(key, block, block->size(),
                                                &DeleteCachedBlock);
+            RecordTick(statistics, kBlockCacheAdd);
           }
         }
       }
@@ -205,24 +301,224 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+// Once an iterator reads data blocks one after the other, the blocks
+// ahead of it are prefetched, in windows that start at this size and
+// double with each window up to the maximum.
+static const size_t kInitialReadaheadSize = 8 * 1024;
+static const size_t kMaxReadaheadSize = 256 * 1024;
+
+// Data blocks are at most this far apart, with Options::block_align.
+static const uint64_t kMaxBlockGap = 4096;
+
+namespace {
+// Tracks the data blocks read by a table iterator.
+struct ReadaheadState {
+  explicit ReadaheadState(const Table* t)
+      : table(t),
+        prev_block_end(0),
+        num_sequential_reads(0),
+        readahead_size(kInitialReadaheadSize),
+        readahead_limit(0) {}
+
+  const Table* const table;
+  uint64_t prev_block_end;  // End of the last block read, trailer included
+  int num_sequential_reads;
+  size_t readahead_size;     // Size of the next window
+  uint64_t readahead_limit;  // End of the last window prefetched
+};
+}  // namespace
+
+static void DeleteReadaheadState(void* arg, void* /*ignored*/) {
+  delete reinterpret_cast<ReadaheadState*>(arg);
+}
+
+Iterator* Table::ReadaheadBlockReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  ReadaheadState* state = reinterpret_cast<ReadaheadState*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  if (handle.DecodeFrom(&input).ok()) {
+    if (handle.offset() >= state->prev_block_end &&
+        handle.offset() - state->prev_block_end < kMaxBlockGap) {
+      state->num_sequential_reads++;
+    } else {
+      state->num_sequential_reads = 0;
+      state->readahead_size = kInitialReadaheadSize;
+      state->readahead_limit = 0;
+    }
+    state->prev_block_end =
+        handle.offset() + handle.size() + kBlockTrailerSize;
+
+    // A couple of blocks read in a row make a scan likely; prefetch the
+    // next window once the previous one is used up.
+    if (state->num_sequential_reads >= 2 &&
+        state->prev_block_end >= state->readahead_limit) {
+      state->table->rep_->file->Prefetch(state->prev_block_end,
+                                         state->readahead_size);
+      state->readahead_limit = state->prev_block_end + state->readahead_size;
+      state->readahead_size =
+          std::min(2 * state->readahead_size, kMaxReadaheadSize);
+    }
+  }
+  return BlockReader(const_cast<Table*>(state->table), options, index_value);
+}
+
+bool Table::BlockMayMatchPrefix(void* arg, const ReadOptions& options,
+                                const Slice& index_value,
+                                const Slice& target) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  return !handle.DecodeFrom(&input).ok() ||
+         table->FilterMayMatch(options, handle.offset(), target, true);
+}
+
+bool Table::HasFilter() const {
+  return rep_->filter != nullptr || rep_->filter_index != nullptr;
+}
+
+bool Table::KeyMayMatch(const ReadOptions& options, uint64_t block_offset,
+                        const Slice& key) const {
+  if (!HasFilter()) {
+    return true;
+  }
+  PerfTimer filter_timer(&PerfContext::filter_probe_nanos);
+  const bool may_match = FilterMayMatch(options, block_offset, key, false);
+  filter_timer.Stop();
+  RecordTick(rep_->options.statistics,
+             may_match ? kBloomFilterMayMatch : kBloomFilterUseful);
+  PerfCount(may_match ? &PerfContext::bloom_filter_may_match_count
+                      : &PerfContext::bloom_filter_useful_count);
+  return may_match;
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options, uint64_t block_offset,
+                           const Slice& key, bool prefix) const {
+  if (rep_->filter != nullptr) {
+    return prefix ? rep_->filter->PrefixMayMatch(block_offset, key)
+                  : rep_->filter->KeyMayMatch(block_offset, key);
+  }
+  if (rep_->filter_index == nullptr) {
+    return true;
+  }
+
+  // Find the partition covering the block, then look it up in, or load
+  // it into, the block cache.  Errors are treated as potential matches.
+  Iterator* iter = rep_->filter_index->NewIterator(BytewiseComparator());
+  iter->Seek(FilterPartitionIndexKey(block_offset + 1));
+  BlockHandle handle;
+  uint64_t base;
+  Slice input;
+  bool found = false;
+  if (iter->Valid()) {
+    input = iter->value();
+    found = handle.DecodeFrom(&input).ok() && GetVarint64(&input, &base) &&
+            base <= block_offset;
+  }
+  delete iter;
+  if (!found) {
+    return true;
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  FilterPartition* partition = nullptr;
+  Cache::Handle* cache_handle = nullptr;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      partition =
+          reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+    }
+  }
+  if (partition == nullptr) {
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+      return true;
+    }
+    partition = new FilterPartition(rep_->options.filter_policy, contents);
+    if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+      cache_handle = block_cache->Insert(cache_key, partition, partition->size,
+                                         &DeleteCachedFilterPartition);
+    }
+  }
+
+  const uint64_t offset = block_offset - base;
+  bool may_match = prefix ? partition->reader.PrefixMayMatch(offset, key)
+                          : partition->reader.KeyMayMatch(offset, key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete partition;
+  }
+  return may_match;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* index_iter =
+      rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->partitioned_index) {
+    // The index partitions are read through the block cache, just like
+    // data blocks.
+    return NewTwoLevelIterator(index_iter, &Table::BlockReader,
+                               const_cast<Table*>(this), options);
+  }
+  return index_iter;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Iterator* index_iter = NewIndexIterator(options);
+  if (options.prefix_same_as_start && HasFilter()) {
+    return NewTwoLevelIterator(index_iter, &Table::BlockReader,
+                               &Table::BlockMayMatchPrefix,
+                               rep_->options.comparator,
+                               const_cast<Table*>(this), options);
+  }
+  // Prefix scans are short, so only full scans read ahead.
+  ReadaheadState* state = new ReadaheadState(this);
+  Iterator* iter =
+      NewTwoLevelIterator(index_iter, &Table::ReadaheadBlockReader, nullptr,
+                          rep_->options.comparator, state, options);
+  iter->RegisterCleanup(&DeleteReadaheadState, state, nullptr);
+  return iter;
+}
+
+bool Table::PrefixMayMatch(const Slice& key) const {
+  if (!HasFilter()) {
+    return true;
+  }
+  bool may_match = true;
+  Iterator* iiter = NewIndexIterator(ReadOptions());
+  iiter->Seek(key);
+  if (iiter->Valid()) {
+    may_match = BlockMayMatchPrefix(const_cast<Table*>(this), ReadOptions(),
+                                    iiter->value(), key);
+  }
+  delete iiter;
+  return may_match;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (HasFilter() && handle.DecodeFrom(&handle_value).ok() &&
+        !KeyMayMatch(options, handle.offset(), k)) {
       // Not found
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
@@ -241,9 +537,165 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+namespace {
+// The data block that a key of a MultiGet must be searched in.
+struct MultiGetLookup {
+  MultiGetLookup() : search_block(false) {}
+
+  Status status;
+  bool search_block;  // False if the key is known to be absent
+  BlockHandle handle;
+};
+
+// A data block read ahead of the searches of a MultiGet.
+struct MultiGetBlock {
+  uint64_t offset;
+  Block* block;
+  Cache::Handle* cache_handle;  // nullptr if "block" is owned
+};
+}  // namespace
+
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void* const* args,
+                             Status* statuses,
+                             void (*handle_result)(void*, const Slice&,
+                                                   const Slice&)) {
+  const Comparator* cmp = rep_->options.comparator;
+  Cache* block_cache = rep_->options.block_cache;
+
+  // Find the data block of every key, and collect the blocks that are not
+  // in the block cache.
+  std::vector<MultiGetLookup> lookups(n);
+  std::vector<BlockHandle> misses;
+  uint64_t last_offset = ~static_cast<uint64_t>(0);
+  Iterator* iiter = NewIndexIterator(options);
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    assert(i == 0 || cmp->Compare(keys[i - 1], k) <= 0);
+    // Keys arrive in sorted order, so the index entry found for the
+    // previous key is still the right one unless it lies before "k".
+    if (i == 0 || (iiter->Valid() && cmp->Compare(iiter->key(), k) < 0)) {
+      iiter->Seek(k);
+    }
+    MultiGetLookup* lookup = &lookups[i];
+    if (iiter->Valid()) {
+      Slice handle_value = iiter->value();
+      if (!lookup->handle.DecodeFrom(&handle_value).ok()) {
+        lookup->status = Status::Corruption("bad block handle");
+      } else if (KeyMayMatch(options, lookup->handle.offset(), k)) {
+        lookup->search_block = true;
+        const uint64_t offset = lookup->handle.offset();
+        if (offset != last_offset) {
+          last_offset = offset;
+          bool cached = false;
+          if (block_cache != nullptr) {
+            char cache_key_buffer[16];
+            EncodeFixed64(cache_key_buffer, rep_->cache_id);
+            EncodeFixed64(cache_key_buffer + 8, offset);
+            Cache::Handle* h = block_cache->Lookup(
+                Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+            if (h != nullptr) {
+              cached = true;
+              block_cache->Release(h);
+            }
+          }
+          if (!cached) {
+            misses.push_back(lookup->handle);
+          }
+        }
+      }
+    }
+    if (lookup->status.ok()) {
+      lookup->status = iiter->status();
+    }
+  }
+  delete iiter;
+
+  // Read the missing blocks together so that their reads overlap.  A
+  // block whose read fails is read again, and its error reported, by
+  // BlockReader() below.
+  std::vector<MultiGetBlock> blocks;
+  if (misses.size() > 1) {
+    // The other lookups in the block cache are counted by BlockReader().
+    if (block_cache != nullptr) {
+      RecordTick(rep_->options.statistics, kBlockCacheMiss, misses.size());
+      PerfCount(&PerfContext::block_cache_miss_count, misses.size());
+    }
+    std::vector<BlockContents> contents(misses.size());
+    std::vector<Status> read_statuses(misses.size());
+    ReadBlocks(rep_->file, options, misses.data(),
+               static_cast<int>(misses.size()), contents.data(),
+               read_statuses.data());
+    for (size_t j = 0; j < misses.size(); j++) {
+      if (!read_statuses[j].ok()) {
+        continue;
+      }
+      MultiGetBlock b;
+      b.offset = misses[j].offset();
+      b.block = new Block(contents[j]);
+      b.cache_handle = nullptr;
+      if (block_cache != nullptr && contents[j].cachable &&
+          options.fill_cache) {
+        char cache_key_buffer[16];
+        EncodeFixed64(cache_key_buffer, rep_->cache_id);
+        EncodeFixed64(cache_key_buffer + 8, b.offset);
+        b.cache_handle = block_cache->Insert(
+            Slice(cache_key_buffer, sizeof(cache_key_buffer)), b.block,
+            b.block->size(), &DeleteCachedBlock);
+        RecordTick(rep_->options.statistics, kBlockCacheAdd);
+      }
+      blocks.push_back(b);
+    }
+  }
+
+  // Search the blocks.  Both the keys and "blocks" are in file order.
+  Iterator* block_iter = nullptr;
+  uint64_t block_offset = 0;
+  size_t next_block = 0;
+  for (int i = 0; i < n; i++) {
+    const MultiGetLookup& lookup = lookups[i];
+    Status s = lookup.status;
+    if (lookup.search_block) {
+      const uint64_t offset = lookup.handle.offset();
+      if (block_iter == nullptr || offset != block_offset) {
+        delete block_iter;
+        while (next_block < blocks.size() &&
+               blocks[next_block].offset < offset) {
+          next_block++;
+        }
+        if (next_block < blocks.size() &&
+            blocks[next_block].offset == offset) {
+          block_iter = blocks[next_block].block->NewIterator(cmp);
+        } else {
+          std::string handle_value;
+          lookup.handle.EncodeTo(&handle_value);
+          block_iter = BlockReader(this, options, handle_value);
+        }
+        block_offset = offset;
+      }
+      block_iter->Seek(keys[i]);
+      if (block_iter->Valid()) {
+        (*handle_result)(args[i], block_iter->key(), block_iter->value());
+      }
+      if (s.ok()) {
+        s = block_iter->status();
+      }
+    }
+    statuses[i] = s;
+  }
+  delete block_iter;
+
+  for (const MultiGetBlock& b : blocks) {
+    if (b.cache_handle != nullptr) {
+      block_cache->Release(b.cache_handle);
+    } else {
+      delete b.block;
+    }
+  }
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -268,4 +720,23 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+double Table::ApproximateFractionThrough(const Slice& key) const {
+  const uint64_t data_size = rep_->metaindex_handle.offset();
+  if (data_size == 0) {
+    return 1.0;
+  }
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
+  index_iter->Seek(key);
+  uint64_t end = data_size;
+  if (index_iter->Valid()) {
+    BlockHandle handle;
+    Slice input = index_iter->value();
+    if (handle.DecodeFrom(&input).ok()) {
+      end = handle.offset() + handle.size() + kBlockTrailerSize;
+    }
+  }
+  delete index_iter;
+  return end >= data_size ? 1.0 : static_cast<double>(end) / data_size;
+}
+
 }  // namespace leveldb
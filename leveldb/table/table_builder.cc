@@ -5,6 +5,9 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -18,6 +21,13 @@
 
 namespace leveldb {
 
+// With options.block_align, data blocks start at multiples of this.
+static const size_t kBlockAlignment = 4096;
+
+// Upper bound on the bytes that BlockBuilder::Add() adds to a block beyond
+// the key and value: three varint32 lengths and a restart point.
+static const size_t kMaxEntryOverhead = 3 * 5 + sizeof(uint32_t);
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
@@ -26,11 +36,14 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
+        num_range_tombstones(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
+        filter_partition_base(0),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -42,11 +55,28 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
+  std::string last_range_del_key;
   int64_t num_entries;
+  int64_t num_range_tombstones;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
+  // With options.partition_index_and_filters, the finished index and
+  // filter partitions are kept here and written by Finish(), after all
+  // data blocks.  Each index partition is kept with the last key added to
+  // it.  The current filter_block covers the data blocks from
+  // filter_partition_base on (see table/filter_block.h).
+  struct FilterPartition {
+    uint64_t base;
+    uint64_t limit;
+    std::string contents;
+  };
+  std::vector<std::pair<std::string, std::string>> index_partitions;
+  std::vector<FilterPartition> filter_partitions;
+  uint64_t filter_partition_base;
+
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
   // keys in the index block.  For example, consider a block boundary
@@ -82,6 +112,11 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing partitioning while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -99,6 +134,15 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
 
+  // Keep aligned blocks, trailer included, within block_size.
+  if (r->options.block_align && !r->data_block.empty() &&
+      r->data_block.CurrentSizeEstimate() + key.size() + value.size() +
+              kMaxEntryOverhead + kBlockTrailerSize >
+          r->options.block_size) {
+    Flush();
+    if (!ok()) return;
+  }
+
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
@@ -106,6 +150,10 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.partition_index_and_filters &&
+        r->index_block.CurrentSizeEstimate() >= r->options.metadata_block_size) {
+      FinishIndexPartition();
+    }
   }
 
   if (r->filter_block != nullptr) {
@@ -122,6 +170,19 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  if (r->num_range_tombstones > 0) {
+    assert(r->options.comparator->Compare(key, Slice(r->last_range_del_key)) >
+           0);
+  }
+  r->last_range_del_key.assign(key.data(), key.size());
+  r->num_range_tombstones++;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -129,24 +190,62 @@ void TableBuilder::Flush() {
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
+  if (ok() && r->options.block_align &&
+      r->offset % kBlockAlignment != 0) {
+    const size_t padding = kBlockAlignment - r->offset % kBlockAlignment;
+    r->status = r->file->Append(std::string(padding, '\0'));
+    if (ok()) {
+      r->offset += padding;
+    }
+  }
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
   if (r->filter_block != nullptr) {
-    r->filter_block->StartBlock(r->offset);
+    r->filter_block->StartBlock(r->offset - r->filter_partition_base);
+    if (r->options.partition_index_and_filters &&
+        r->filter_block->CurrentSizeEstimate() >=
+            r->options.metadata_block_size) {
+      FinishFilterPartition();
+    }
   }
 }
 
+void TableBuilder::FinishIndexPartition() {
+  Rep* r = rep_;
+  // The last key added is >= every key of the partition's data blocks
+  // and < every key of the following ones, so it serves as the key of
+  // the partition in the top-level index.
+  r->index_partitions.emplace_back(r->last_key,
+                                   r->index_block.Finish().ToString());
+  r->index_block.Reset();
+}
+
+void TableBuilder::FinishFilterPartition() {
+  Rep* r = rep_;
+  Rep::FilterPartition partition;
+  partition.base = r->filter_partition_base;
+  partition.limit = r->offset;
+  partition.contents = r->filter_block->Finish().ToString();
+  r->filter_partitions.push_back(std::move(partition));
+  delete r->filter_block;
+  r->filter_block = new FilterBlockBuilder(r->options.filter_policy);
+  r->filter_partition_base = r->offset;
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
-  Rep* r = rep_;
-  Slice raw = block->Finish();
+  WriteBlockContents(block->Finish(), handle);
+  block->Reset();
+}
 
+void TableBuilder::WriteBlockContents(const Slice& raw, BlockHandle* handle) {
+  Rep* r = rep_;
   Slice block_contents;
   CompressionType type = r->options.compression;
   // TODO(postrelease): Support more compression options: zlib?
@@ -171,7 +270,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -201,25 +299,66 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle,
+      metaindex_block_handle, index_block_handle;
+
+  // Meta block names and filter partition keys are ordered bytewise,
+  // whatever the key comparator
+  Options meta_index_options = r->options;
+  meta_index_options.comparator = BytewiseComparator();
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
-    WriteRawBlock(r->filter_block->Finish(), kNoCompression,
-                  &filter_block_handle);
+    if (r->options.partition_index_and_filters) {
+      // The last partition covers every block from its base on
+      r->filter_partitions.push_back(
+          {r->filter_partition_base, ~static_cast<uint64_t>(0),
+           r->filter_block->Finish().ToString()});
+      BlockBuilder filter_index_block(&meta_index_options);
+      for (const Rep::FilterPartition& partition : r->filter_partitions) {
+        BlockHandle partition_handle;
+        WriteRawBlock(partition.contents, kNoCompression, &partition_handle);
+        if (!ok()) break;
+        std::string value;
+        partition_handle.EncodeTo(&value);
+        PutVarint64(&value, partition.base);
+        filter_index_block.Add(FilterPartitionIndexKey(partition.limit),
+                               value);
+      }
+      if (ok()) {
+        WriteBlock(&filter_index_block, &filter_block_handle);
+      }
+    } else {
+      WriteRawBlock(r->filter_block->Finish(), kNoCompression,
+                    &filter_block_handle);
+    }
+  }
+
+  // Write range tombstone block
+  if (ok() && r->num_range_tombstones > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+      // Add mapping from "filter.Name" (or "partitionedfilter.Name") to
+      // location of filter data
+      std::string key = r->options.partition_index_and_filters
+                            ? kPartitionedFilterBlockPrefix
+                            : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->num_range_tombstones > 0) {
+      // Add mapping from "rangedel" to location of range tombstones
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -234,7 +373,25 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (r->options.partition_index_and_filters) {
+      if (!r->index_block.empty()) {
+        FinishIndexPartition();
+      }
+      BlockBuilder top_index_block(&r->index_block_options);
+      for (const auto& partition : r->index_partitions) {
+        BlockHandle partition_handle;
+        WriteBlockContents(partition.second, &partition_handle);
+        if (!ok()) break;
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        top_index_block.Add(partition.first, handle_encoding);
+      }
+      if (ok()) {
+        WriteBlock(&top_index_block, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -242,6 +399,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->options.partition_index_and_filters);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -260,6 +418,10 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
@@ -241,6 +241,10 @@ class TableConstructor : public Constructor {
     return table_->ApproximateOffsetOf(key);
   }
 
+  double ApproximateFractionThrough(const Slice& key) const {
+    return table_->ApproximateFractionThrough(key);
+  }
+
  private:
   void Reset() {
     delete table_;
@@ -376,30 +380,33 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partitioned;  // Only for tables
 };
 
 static const TestArgs kTestArgList[] = {
-    {TABLE_TEST, false, 16},
-    {TABLE_TEST, false, 1},
-    {TABLE_TEST, false, 1024},
-    {TABLE_TEST, true, 16},
-    {TABLE_TEST, true, 1},
-    {TABLE_TEST, true, 1024},
-
-    {BLOCK_TEST, false, 16},
-    {BLOCK_TEST, false, 1},
-    {BLOCK_TEST, false, 1024},
-    {BLOCK_TEST, true, 16},
-    {BLOCK_TEST, true, 1},
-    {BLOCK_TEST, true, 1024},
+    {TABLE_TEST, false, 16, false},
+    {TABLE_TEST, false, 1, false},
+    {TABLE_TEST, false, 1024, false},
+    {TABLE_TEST, true, 16, false},
+    {TABLE_TEST, true, 1, false},
+    {TABLE_TEST, true, 1024, false},
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
+
+    {BLOCK_TEST, false, 16, false},
+    {BLOCK_TEST, false, 1, false},
+    {BLOCK_TEST, false, 1024, false},
+    {BLOCK_TEST, true, 16, false},
+    {BLOCK_TEST, true, 1, false},
+    {BLOCK_TEST, true, 1024, false},
 
     // Restart interval does not matter for memtables
-    {MEMTABLE_TEST, false, 16},
-    {MEMTABLE_TEST, true, 16},
+    {MEMTABLE_TEST, false, 16, false},
+    {MEMTABLE_TEST, true, 16, false},
 
     // Do not bother with restart interval variations for DB
-    {DB_TEST, false, 16},
-    {DB_TEST, true, 16},
+    {DB_TEST, false, 16, false},
+    {DB_TEST, true, 16, false},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -416,6 +423,10 @@ class Harness : public testing::Test {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    if (args.partitioned) {
+      options_.partition_index_and_filters = true;
+      options_.metadata_block_size = 64;
+    }
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -699,7 +710,7 @@ TEST_F(Harness, Randomized) {
 
 TEST_F(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = {DB_TEST, false, 16};
+  TestArgs args = {DB_TEST, false, 16, false};
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -782,6 +793,124 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"), 510000, 511000));
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"), 510000, 511000));
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+
+  ASSERT_NEAR(10000.0 / 610000, c.ApproximateFractionThrough("abc"), 0.01);
+  ASSERT_NEAR(10000.0 / 610000, c.ApproximateFractionThrough("k03"), 0.01);
+  ASSERT_NEAR(210000.0 / 610000, c.ApproximateFractionThrough("k04"), 0.01);
+  ASSERT_NEAR(510000.0 / 610000, c.ApproximateFractionThrough("k05"), 0.01);
+  ASSERT_EQ(1.0, c.ApproximateFractionThrough("k07"));
+  ASSERT_EQ(1.0, c.ApproximateFractionThrough("xyz"));
+}
+
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  char buf[10];
+  for (int i = 0; i < 1000; i++) {
+    std::snprintf(buf, sizeof(buf), "k%04d", i);
+    c.Add(buf, std::string(1000, 'x'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 128;
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k0000"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k0500"), 500000, 520000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k0999"), 999000, 1020000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 1000000, 1030000));
+}
+
+TEST(TableTest, BlockAlign) {
+  TableConstructor c(BytewiseComparator());
+  char buf[10];
+  for (int i = 0; i < 100; i++) {
+    std::snprintf(buf, sizeof(buf), "k%04d", i);
+    c.Add(buf, std::string(1500, 'a' + i % 26));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 4096;
+  options.compression = kNoCompression;
+  options.block_align = true;
+  c.Finish(options, &keys, &kvmap);
+
+  // Two values fit in each page-sized block.
+  for (int i = 0; i < 100; i++) {
+    std::snprintf(buf, sizeof(buf), "k%04d", i);
+    ASSERT_EQ(i / 2 * 4096, c.ApproximateOffsetOf(buf)) << buf;
+  }
+
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  for (KVMap::const_iterator it = kvmap.begin(); it != kvmap.end(); ++it) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(it->first, iter->key().ToString());
+    ASSERT_EQ(it->second, iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+// A StringSource that records the calls to Prefetch().
+class PrefetchRecordingSource : public StringSource {
+ public:
+  explicit PrefetchRecordingSource(const Slice& contents)
+      : StringSource(contents) {}
+
+  void Prefetch(uint64_t offset, size_t n) const override {
+    prefetches_.emplace_back(offset, n);
+  }
+
+  mutable std::vector<std::pair<uint64_t, size_t>> prefetches_;
+};
+
+TEST(TableTest, IteratorReadahead) {
+  StringSink sink;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  TableBuilder builder(options, &sink);
+  char buf[10];
+  for (int i = 0; i < 1000; i++) {
+    std::snprintf(buf, sizeof(buf), "k%04d", i);
+    builder.Add(buf, std::string(1000, 'x'));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  PrefetchRecordingSource source(sink.contents());
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(Options(), &source, sink.contents().size(), &table));
+
+  // Point lookups do not read ahead.
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->Seek("k0500");
+  ASSERT_TRUE(iter->Valid());
+  iter->Seek("k0100");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_TRUE(source.prefetches_.empty());
+
+  // A scan prefetches ever larger windows, each after the previous one.
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(1000, count);
+  delete iter;
+  ASSERT_GE(source.prefetches_.size(), 4);
+  ASSERT_EQ(8 * 1024, source.prefetches_[0].second);
+  for (size_t i = 1; i < source.prefetches_.size(); i++) {
+    const std::pair<uint64_t, size_t>& prev = source.prefetches_[i - 1];
+    ASSERT_EQ(std::min<size_t>(256 * 1024, 2 * prev.second),
+              source.prefetches_[i].second);
+    ASSERT_GE(source.prefetches_[i].first, prev.first + prev.second);
+  }
+  delete table;
 }
 
 static bool SnappyCompressionSupported() {
@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -14,11 +15,15 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef bool (*SeekFilterFunction)(void*, const ReadOptions&, const Slice&,
+                                   const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   SeekFilterFunction seek_filter_function,
+                   const Comparator* comparator, void* arg,
+                   const ReadOptions& options);
 
   ~TwoLevelIterator() override;
 
@@ -52,48 +57,88 @@ class TwoLevelIterator : public Iterator {
   void SaveError(const Status& s) {
     if (status_.ok() && !s.ok()) status_ = s;
   }
-  void SkipEmptyDataBlocksForward();
+  // Return true if the blocks after the one at index_iter_ only hold
+  // keys >= options_.iterate_upper_bound.
+  bool NextBlocksAfterUpperBound() const {
+    return comparator_ != nullptr && options_.iterate_upper_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_upper_bound) >= 0;
+  }
+  // Return true if the block at index_iter_ only holds keys
+  // < options_.iterate_lower_bound.
+  bool BlockBeforeLowerBound() const {
+    return comparator_ != nullptr && options_.iterate_lower_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_lower_bound) < 0;
+  }
+  void SkipEmptyDataBlocksForward(bool stop_at_upper_bound);
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
 
   BlockFunction block_function_;
+  SeekFilterFunction seek_filter_function_;  // May be nullptr
+  const Comparator* const comparator_;       // May be nullptr
   void* arg_;
   const ReadOptions options_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
+  // The data_iter_ that the last move of the iterator started in, which
+  // holds the value of the entry it was at.  May be nullptr.
+  Iterator* prev_data_iter_;
+  // True once the current move has stored prev_data_iter_.  The blocks it
+  // skips after that are dropped, since no value of theirs was returned.
+  bool prev_data_iter_saved_;
   // If data_iter_ is non-null, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
 };
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
-                                   BlockFunction block_function, void* arg,
+                                   BlockFunction block_function,
+                                   SeekFilterFunction seek_filter_function,
+                                   const Comparator* comparator, void* arg,
                                    const ReadOptions& options)
     : block_function_(block_function),
+      seek_filter_function_(seek_filter_function),
+      comparator_(comparator),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
-      data_iter_(nullptr) {}
+      data_iter_(nullptr),
+      prev_data_iter_(nullptr),
+      prev_data_iter_saved_(false) {}
 
-TwoLevelIterator::~TwoLevelIterator() = default;
+TwoLevelIterator::~TwoLevelIterator() { delete prev_data_iter_; }
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  prev_data_iter_saved_ = false;
   index_iter_.Seek(target);
+  if (seek_filter_function_ != nullptr && index_iter_.Valid() &&
+      !(*seek_filter_function_)(arg_, options_, index_iter_.value(), target)) {
+    // Neither this block nor the following ones hold what the caller
+    // seeks, so do not read any of them.
+    SetDataIterator(nullptr);
+    return;
+  }
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
-  SkipEmptyDataBlocksForward();
+  // Seek() must find any entry >= target, since merging iterators that
+  // change direction rely on it.
+  SkipEmptyDataBlocksForward(false);
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  prev_data_iter_saved_ = false;
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
-  SkipEmptyDataBlocksForward();
+  SkipEmptyDataBlocksForward(true);
 }
 
 void TwoLevelIterator::SeekToLast() {
+  prev_data_iter_saved_ = false;
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
@@ -102,20 +147,23 @@ void TwoLevelIterator::SeekToLast() {
 
 void TwoLevelIterator::Next() {
   assert(Valid());
+  prev_data_iter_saved_ = false;
   data_iter_.Next();
-  SkipEmptyDataBlocksForward();
+  SkipEmptyDataBlocksForward(true);
 }
 
 void TwoLevelIterator::Prev() {
   assert(Valid());
+  prev_data_iter_saved_ = false;
   data_iter_.Prev();
   SkipEmptyDataBlocksBackward();
 }
 
-void TwoLevelIterator::SkipEmptyDataBlocksForward() {
+void TwoLevelIterator::SkipEmptyDataBlocksForward(bool stop_at_upper_bound) {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() ||
+        (stop_at_upper_bound && NextBlocksAfterUpperBound())) {
       SetDataIterator(nullptr);
       return;
     }
@@ -133,6 +181,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (index_iter_.Valid() && BlockBeforeLowerBound()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -140,6 +192,13 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
 
 void TwoLevelIterator::SetDataIterator(Iterator* data_iter) {
   if (data_iter_.iter() != nullptr) SaveError(data_iter_.status());
+  if (prev_data_iter_saved_) {
+    delete data_iter_.Release();
+  } else {
+    delete prev_data_iter_;
+    prev_data_iter_ = data_iter_.Release();
+    prev_data_iter_saved_ = true;
+  }
   data_iter_.Set(data_iter);
 }
 
@@ -165,7 +224,17 @@ void TwoLevelIterator::InitDataBlock() {
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
                               const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+  return new TwoLevelIterator(index_iter, block_function, nullptr, nullptr,
+                              arg, options);
+}
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter,
+                              BlockFunction block_function,
+                              SeekFilterFunction seek_filter_function,
+                              const Comparator* comparator, void* arg,
+                              const ReadOptions& options) {
+  return new TwoLevelIterator(index_iter, block_function, seek_filter_function,
+                              comparator, arg, options);
 }
 
 }  // namespace leveldb
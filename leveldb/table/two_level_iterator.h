@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,12 +21,40 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// The iterator keeps the block it last left alive, so if the block
+// iterators' values stay valid for as long as they live, the value() of
+// an entry stays valid until the iterator has moved twice (or has moved
+// past an empty block).
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
     void* arg, const ReadOptions& options);
 
+// Like the above, but:
+//
+// If "seek_filter_function" is non-null, Seek(target) first passes the
+// index_iter value of the block that would hold "target" to it.  If that
+// returns false, the iterator becomes invalid without reading the block,
+// so it must only do so when no entry the caller is after can be found
+// in this block or any later one.
+//
+// If "comparator" is non-null, it orders the keys of the blocks and of
+// index_iter, whose key for a block must be >= the keys in the block and
+// < the keys in the following blocks.  The iterator then becomes invalid,
+// rather than read a block, when Next() moves to a block whose keys are
+// all >= options.iterate_upper_bound or Prev() to one whose keys are all
+// < options.iterate_lower_bound.
+Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* (*block_function)(void* arg, const ReadOptions& options,
+                                const Slice& index_value),
+    bool (*seek_filter_function)(void* arg, const ReadOptions& options,
+                                 const Slice& index_value,
+                                 const Slice& target),
+    const Comparator* comparator, void* arg, const ReadOptions& options);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
@@ -4,14 +4,25 @@
 
 #include "util/arena.h"
 
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
 
+// Return the index of the shard used by the calling thread.  Threads are
+// assigned to shards round-robin on first use.
+static int ThreadShardIndex() {
+  static std::atomic<int> next_index(0);
+  thread_local int index = next_index.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
 Arena::Arena()
     : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
 
 Arena::~Arena() {
+  MutexLock l(&blocks_mutex_);
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
@@ -55,9 +66,47 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  return AllocateFromShard(bytes, 1);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  char* result = AllocateFromShard(bytes, align);
+  assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+  return result;
+}
+
+char* Arena::AllocateFromShard(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // Allocate large objects separately, as AllocateFallback() does.
+    return AllocateNewBlock(bytes);
+  }
+
+  Shard* shard = &shards_[ThreadShardIndex() % kNumShards];
+  MutexLock l(&shard->mu);
+  size_t current_mod =
+      reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align - 1);
+  size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+  if (bytes + slop > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the shard's block.
+    shard->alloc_ptr = AllocateNewBlock(kBlockSize);
+    shard->alloc_bytes_remaining = kBlockSize;
+    slop = 0;
+  }
+  char* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += bytes + slop;
+  shard->alloc_bytes_remaining -= bytes + slop;
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  {
+    MutexLock l(&blocks_mutex_);
+    blocks_.push_back(result);
+  }
   memory_usage_.fetch_add(block_bytes + sizeof(char*),
                           std::memory_order_relaxed);
   return result;
@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 class Arena {
@@ -28,6 +31,12 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe variants of Allocate() and AllocateAligned().  They may
+  // be called by several threads at once, but not while another thread
+  // is in Allocate() or AllocateAligned().
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -35,20 +44,34 @@ class Arena {
   }
 
  private:
+  // Allocation state of the thread-safe variants.  Threads are spread
+  // over several shards so that they rarely wait for each other.
+  struct Shard {
+    Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+
+    port::Mutex mu;
+    char* alloc_ptr GUARDED_BY(mu);
+    size_t alloc_bytes_remaining GUARDED_BY(mu);
+  };
+
+  enum { kNumShards = 8 };
+
   char* AllocateFallback(size_t bytes);
+  char* AllocateFromShard(size_t bytes, size_t align);
   char* AllocateNewBlock(size_t block_bytes);
 
   // Allocation state
   char* alloc_ptr_;
   size_t alloc_bytes_remaining_;
 
+  Shard shards_[kNumShards];
+
   // Array of new[] allocated memory blocks
-  std::vector<char*> blocks_;
+  port::Mutex blocks_mutex_;
+  std::vector<char*> blocks_ GUARDED_BY(blocks_mutex_);
 
-  // Total memory usage of the arena.
-  //
-  // TODO(costan): This member is accessed via atomics, but the others are
-  //               accessed without any locking. Is this OK?
+  // Total memory usage of the arena.  Atomic, as it is read while
+  // another thread may be allocating.
   std::atomic<size_t> memory_usage_;
 };
 
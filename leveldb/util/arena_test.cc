@@ -4,6 +4,9 @@
 
 #include "util/arena.h"
 
+#include <cstring>
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,4 +61,40 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Concurrent) {
+  const int kNumThreads = 4;
+  const int N = 20000;
+  Arena arena;
+  std::vector<std::pair<size_t, char*>> allocated[kNumThreads];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&arena, &allocated, t]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < N; i++) {
+        size_t s = 1 + (rnd.OneIn(1000) ? rnd.Uniform(6000) : rnd.Uniform(100));
+        char* r = rnd.OneIn(2) ? arena.AllocateAlignedConcurrently(s)
+                               : arena.AllocateConcurrently(s);
+        std::memset(r, t, s);
+        allocated[t].push_back(std::make_pair(s, r));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // No allocation was handed out twice.
+  size_t bytes = 0;
+  for (int t = 0; t < kNumThreads; t++) {
+    for (size_t i = 0; i < allocated[t].size(); i++) {
+      const char* p = allocated[t][i].second;
+      for (size_t b = 0; b < allocated[t][i].first; b++) {
+        ASSERT_EQ(t, p[b]);
+      }
+      bytes += allocated[t][i].first;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
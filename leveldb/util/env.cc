@@ -22,16 +22,51 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
+Status Env::LinkFile(const std::string& src,
+                     const std::string& /*target*/) {
+  return Status::NotSupported("LinkFile", src);
+}
+
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::Schedule(void (*function)(void* arg), void* arg,
+                   Priority /*pri*/) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int /*number*/, Priority /*pri*/) {}
+
+int Env::GetThreadPoolQueueLen(Priority /*pri*/) { return 0; }
+
+int Env::GetThreadPoolActiveThreads(Priority /*pri*/) { return 0; }
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+void RandomAccessFile::Prefetch(uint64_t /*offset*/, size_t /*n*/) const {}
+
+void RandomAccessFile::MultiRead(ReadRequest* requests, int n) const {
+  for (int i = 0; i < n; i++) {
+    ReadRequest* r = &requests[i];
+    r->status = Read(r->offset, r->n, &r->result, r->scratch);
+  }
+}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -37,6 +38,12 @@
 #include "util/posix_logger.h"
 #include "port/port_stdcxx.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -130,6 +137,203 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+#if HAVE_IO_URING
+// Reads are submitted to an io_uring in batches of at most this many.
+constexpr const unsigned kIoUringEntries = 64;
+
+// Issues a batch of reads through a Linux io_uring so that all of them are
+// in flight at once.  The ring is driven with raw system calls, and each
+// thread has its own ring, so that rings need no locking.
+//
+// Instances of this class are not thread-safe.
+class IoUring {
+ public:
+  // Returns the ring of the calling thread, or nullptr if the kernel does
+  // not support io_uring.
+  static IoUring* ForCurrentThread() {
+    thread_local IoUring ring;
+    return ring.ok() ? &ring : nullptr;
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // Reads requests[0, n-1] from |fd|, reporting errors against |filename|.
+  // Returns the number of leading requests that were completed, which is
+  // less than |n| only if the ring stopped working.  The caller must then
+  // perform the remaining requests some other way.
+  int Read(int fd, const std::string& filename, ReadRequest* requests,
+           int n) {
+    int done = 0;
+    while (done < n) {
+      const unsigned count =
+          std::min(static_cast<unsigned>(n - done), sq_entries_);
+      if (!ReadBatch(fd, filename, requests + done, count)) {
+        break;
+      }
+      done += count;
+    }
+    return done;
+  }
+
+ private:
+  IoUring()
+      : ring_fd_(-1),
+        sq_entries_(0),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<::io_uring_sqe*>(MAP_FAILED)) {
+    ::io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const int fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kIoUringEntries, &params));
+    if (fd < 0) {
+      return;
+    }
+    ring_fd_ = fd;
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        return;
+      }
+    }
+    sqes_ = static_cast<::io_uring_sqe*>(
+        ::mmap(nullptr, params.sq_entries * sizeof(::io_uring_sqe),
+               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+               IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUring() {
+    if (sqes_ != MAP_FAILED) {
+      ::munmap(sqes_, sq_entries_ * sizeof(::io_uring_sqe));
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ != -1) {
+      ::close(ring_fd_);
+    }
+  }
+
+  bool ok() const { return sqes_ != MAP_FAILED; }
+
+  // REQUIRES: count <= sq_entries_
+  bool ReadBatch(int fd, const std::string& filename, ReadRequest* requests,
+                 unsigned count) {
+    // This thread is the only producer, so the tail can be read plainly.
+    unsigned tail = *sq_tail_;
+    for (unsigned i = 0; i < count; i++) {
+      const unsigned index = tail & sq_mask_;
+      iovecs_[i].iov_base = requests[i].scratch;
+      iovecs_[i].iov_len = requests[i].n;
+      ::io_uring_sqe* sqe = &sqes_[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&iovecs_[i]);
+      sqe->len = 1;
+      sqe->off = requests[i].offset;
+      sqe->user_data = i;
+      sq_array_[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    while (completed < count) {
+      const long result =
+          ::syscall(__NR_io_uring_enter, ring_fd_, count - submitted,
+                    count - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (result < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;  // Retry
+        }
+        if (submitted == completed) {
+          // Nothing is in flight, so the buffers may be handed back.  The
+          // entries that were not submitted are withdrawn.
+          __atomic_store_n(sq_tail_, tail - (count - submitted),
+                           __ATOMIC_RELEASE);
+          return false;
+        }
+        continue;  // Wait for the reads in flight.
+      }
+      submitted += static_cast<unsigned>(result);
+
+      // This thread is the only consumer, so the head can be read plainly.
+      unsigned head = *cq_head_;
+      const unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      while (head != cq_tail) {
+        const ::io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+        ReadRequest* r = &requests[cqe->user_data];
+        if (cqe->res < 0) {
+          r->result = Slice(r->scratch, 0);
+          r->status = PosixError(filename, -cqe->res);
+        } else {
+          r->result = Slice(r->scratch, cqe->res);
+          r->status = Status::OK();
+        }
+        head++;
+        completed++;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+
+  int ring_fd_;
+  unsigned sq_entries_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  void* sq_ring_;
+  void* cq_ring_;
+  ::io_uring_sqe* sqes_;
+
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  ::io_uring_cqe* cqes_;
+
+  ::iovec iovecs_[kIoUringEntries];
+};
+#endif  // HAVE_IO_URING
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -209,6 +413,64 @@ class PosixRandomAccessFile final : public RandomAccessFile {
 
     assert(fd != -1);
 
+    Status status = ReadFromFd(fd, offset, n, result, scratch);
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    return status;
+  }
+
+  void MultiRead(ReadRequest* requests, int n) const override {
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      if (fd < 0) {
+        const Status status = PosixError(filename_, errno);
+        for (int i = 0; i < n; i++) {
+          requests[i].result = Slice();
+          requests[i].status = status;
+        }
+        return;
+      }
+    }
+
+    assert(fd != -1);
+
+    int done = 0;
+#if HAVE_IO_URING
+    if (n > 1) {
+      IoUring* ring = IoUring::ForCurrentThread();
+      if (ring != nullptr) {
+        done = ring->Read(fd, filename_, requests, n);
+      }
+    }
+#endif  // HAVE_IO_URING
+    // Without io_uring, the reads are issued one at a time.
+    for (int i = done; i < n; i++) {
+      ReadRequest* r = &requests[i];
+      r->status = ReadFromFd(fd, r->offset, r->n, &r->result, r->scratch);
+    }
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+  }
+
+  void Prefetch(uint64_t offset, size_t n) const override {
+#if HAVE_POSIX_FADVISE
+    if (has_permanent_fd_) {
+      ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                      POSIX_FADV_WILLNEED);
+    }
+#endif  // HAVE_POSIX_FADVISE
+  }
+
+ private:
+  Status ReadFromFd(int fd, uint64_t offset, size_t n, Slice* result,
+                    char* scratch) const {
     Status status;
     // 注意这个pread：read+lseek 打包成一个原子操作
     ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
@@ -217,15 +479,9 @@ class PosixRandomAccessFile final : public RandomAccessFile {
       // An error: return a non-ok status.
       status = PosixError(filename_, errno);
     }
-    if (!has_permanent_fd_) {
-      // Close the temporary file descriptor opened earlier.
-      assert(fd != fd_);
-      ::close(fd);
-    }
     return status;
   }
 
- private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
@@ -269,6 +525,19 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  void Prefetch(uint64_t offset, size_t n) const override {
+#if defined(MADV_WILLNEED)
+    if (offset >= length_) {
+      return;
+    }
+    // madvise() needs a page-aligned address; mmap_base_ is page-aligned.
+    static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    const size_t start = offset - offset % page_size;
+    const size_t end = std::min<uint64_t>(length_, offset + n);
+    ::madvise(mmap_base_ + start, end - start, MADV_WILLNEED);
+#endif  // defined(MADV_WILLNEED)
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -466,6 +735,209 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+#if HAVE_O_DIRECT
+// The offsets, sizes and buffers of reads and writes of files opened with
+// O_DIRECT must be multiples of this.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+size_t RoundUpToAlignment(size_t n) {
+  return (n + kDirectIOAlignment - 1) / kDirectIOAlignment *
+         kDirectIOAlignment;
+}
+
+// Returns a buffer of |size| bytes suitable for direct I/O, to be released
+// with std::free(), or nullptr if it cannot be allocated.
+char* NewAlignedBuffer(size_t size) {
+  void* buffer;
+  if (::posix_memalign(&buffer, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return static_cast<char*>(buffer);
+}
+
+// Implements random read access in a file opened with O_DIRECT, which
+// bypasses the page cache. Every read is widened to aligned boundaries and
+// goes through a temporary aligned buffer.
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API. Instances are immutable and Read() only calls thread-safe library
+// functions.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. Unlike PosixRandomAccessFile,
+  // it does not count against the read-only file descriptor limit, as these
+  // files are only kept open for the duration of a compaction.
+  PosixDirectRandomAccessFile(std::string filename, int fd)
+      : fd_(fd), filename_(std::move(filename)) {}
+  ~PosixDirectRandomAccessFile() override { ::close(fd_); }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const size_t skip = offset % kDirectIOAlignment;
+    const uint64_t aligned_offset = offset - skip;
+    const size_t aligned_size = RoundUpToAlignment(skip + n);
+    char* buffer = NewAlignedBuffer(aligned_size);
+    if (buffer == nullptr) {
+      *result = Slice();
+      return PosixError(filename_, ENOMEM);
+    }
+
+    Status status;
+    size_t read_size = 0;
+    while (read_size < aligned_size) {
+      ::ssize_t result_size =
+          ::pread(fd_, buffer + read_size, aligned_size - read_size,
+                  static_cast<off_t>(aligned_offset + read_size));
+      if (result_size < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      read_size += result_size;
+      // A short read means the end of the file was reached.
+      if (result_size == 0 || read_size % kDirectIOAlignment != 0) {
+        break;
+      }
+    }
+
+    if (status.ok()) {
+      n = std::min(n, read_size > skip ? read_size - skip : 0);
+      std::memcpy(scratch, buffer + skip, n);
+      *result = Slice(scratch, n);
+    } else {
+      *result = Slice();
+    }
+    std::free(buffer);
+    return status;
+  }
+
+ private:
+  const int fd_;
+  const std::string filename_;
+};
+
+// Implements writes to a file opened with O_DIRECT, which bypasses the page
+// cache. Data is collected in an aligned buffer that is written whenever it
+// fills up. Sync() and Close() write the data left in the buffer padded to
+// a whole number of pages, and then cut the file back to its actual size.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // The new instance takes ownership of |fd| and of |buffer|, which must
+  // hold kWritableFileBufferSize bytes and be allocated by NewAlignedBuffer().
+  PosixDirectWritableFile(std::string filename, int fd, char* buffer)
+      : buf_(buffer),
+        pos_(0),
+        buf_file_offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kWritableFileBufferSize) {
+        Status status = WriteBuffer(kWritableFileBufferSize);
+        if (!status.ok()) {
+          return status;
+        }
+        buf_file_offset_ += kWritableFileBufferSize;
+        pos_ = 0;
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteTail();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  // A partially filled page can only be written padded, so the buffered data
+  // is left for Sync() or Close() to write.
+  Status Flush() override { return Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteTail();
+    if (!status.ok()) {
+      return status;
+    }
+#if HAVE_FDATASYNC
+    bool sync_success = ::fdatasync(fd_) == 0;
+#else
+    bool sync_success = ::fsync(fd_) == 0;
+#endif  // HAVE_FDATASYNC
+    if (!sync_success) {
+      return PosixError(filename_, errno);
+    }
+    return Status::OK();
+  }
+
+ private:
+  // Writes buf_[0, size - 1] at buf_file_offset_. |size| must be aligned.
+  Status WriteBuffer(size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      ::ssize_t write_result =
+          ::pwrite(fd_, buf_ + written, size - written,
+                   static_cast<off_t>(buf_file_offset_ + written));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      written += write_result;
+    }
+    return Status::OK();
+  }
+
+  // Writes the buffered data, which stays in the buffer to be written again
+  // along with the data appended after it.
+  Status WriteTail() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    const size_t padded_size = RoundUpToAlignment(pos_);
+    std::memset(buf_ + pos_, 0, padded_size - pos_);
+    Status status = WriteBuffer(padded_size);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(buf_file_offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  // buf_[0, pos_ - 1] contains data to be written at buf_file_offset_, which
+  // is a multiple of kWritableFileBufferSize.
+  char* const buf_;
+  size_t pos_;
+  uint64_t buf_file_offset_;
+  int fd_;
+
+  const std::string filename_;
+};
+#endif  // HAVE_O_DIRECT
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -586,6 +1058,38 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+#if HAVE_O_DIRECT
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+    if (fd >= 0) {
+      *result = new PosixDirectRandomAccessFile(filename, fd);
+      return Status::OK();
+    }
+    // Some file systems do not support O_DIRECT. Fall back to buffered reads.
+#endif  // HAVE_O_DIRECT
+    return NewRandomAccessFile(filename, result);
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if HAVE_O_DIRECT
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd >= 0) {
+      char* buffer = NewAlignedBuffer(kWritableFileBufferSize);
+      if (buffer != nullptr) {
+        *result = new PosixDirectWritableFile(filename, fd, buffer);
+        return Status::OK();
+      }
+      ::close(fd);
+    }
+    // Some file systems do not support O_DIRECT. Fall back to buffered writes.
+#endif  // HAVE_O_DIRECT
+    return NewWritableFile(filename, result);
+  }
+
   Status NewAppendableFile(const std::string& filename,
                            WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -656,6 +1160,13 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status LinkFile(const std::string& from, const std::string& to) override {
+    if (::link(from.c_str(), to.c_str()) != 0) {
+      return PosixError(from, errno);
+    }
+    return Status::OK();
+  }
+
   Status LockFile(const std::string& filename, FileLock** lock) override {
     *lock = nullptr;
 
@@ -692,7 +1203,28 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    Schedule(background_work_function, background_work_arg, kLow);
+  }
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg, Priority pri) override;
+
+  void SetBackgroundThreads(int number, Priority pri) override;
+
+  int GetThreadPoolQueueLen(Priority pri) override {
+    background_work_mutex_.Lock();
+    int queue_len = static_cast<int>(pool(pri)->work_queue.size());
+    background_work_mutex_.Unlock();
+    return queue_len;
+  }
+
+  int GetThreadPoolActiveThreads(Priority pri) override {
+    background_work_mutex_.Lock();
+    int active_threads = pool(pri)->active_threads;
+    background_work_mutex_.Unlock();
+    return active_threads;
+  }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -748,10 +1280,10 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
+  void BackgroundThreadMain(Priority pri);
 
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+  static void BackgroundThreadEntryPoint(PosixEnv* env, Priority pri) {
+    env->BackgroundThreadMain(pri);
   }
 
   // Stores the work item data in a Schedule() call.
@@ -768,12 +1300,30 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The threads and pending work items of one priority.  All fields are
+  // protected by background_work_mutex_.
+  struct ThreadPool {
+    explicit ThreadPool(port::Mutex* mu)
+        : work_cv(mu), max_threads(1), num_threads(0), active_threads(0) {}
+
+    port::CondVar work_cv;  // Signalled when work is queued or threads exit
+    int max_threads;        // Number of threads the pool should have
+    int num_threads;        // Number of threads started and not yet exited
+    int active_threads;     // Number of threads running a work item
+    std::queue<BackgroundWorkItem> work_queue;
+  };
+
+  ThreadPool* pool(Priority pri) {
+    return (pri == kHigh) ? &high_pool_ : &low_pool_;
+  }
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  // Start threads until the pool for "pri" has its configured size.
+  void StartPoolThreads(Priority pri)
+      EXCLUSIVE_LOCKS_REQUIRED(background_work_mutex_);
+
+  port::Mutex background_work_mutex_;
+  ThreadPool low_pool_ GUARDED_BY(background_work_mutex_);
+  ThreadPool high_pool_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -809,52 +1359,80 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : low_pool_(&background_work_mutex_),
+      high_pool_(&background_work_mutex_),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
 // 在c++中，要表示对象的多态，只能用void*
-void PosixEnv::Schedule( 
+void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
+    void* background_work_arg, Priority pri) {
   background_work_mutex_.Lock();
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
-  }
+  // Start the pool's background threads, if we haven't done so already.
+  StartPoolThreads(pri);
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  ThreadPool* p = pool(pri);
+  p->work_queue.emplace(background_work_function, background_work_arg);
+  p->work_cv.Signal();
+  background_work_mutex_.Unlock();
+}
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  background_work_mutex_.Lock();
+  ThreadPool* p = pool(pri);
+  p->max_threads = std::max(number, 1);
+  if (p->num_threads > 0) {
+    // The pool is in use: add threads now; surplus threads exit once idle.
+    StartPoolThreads(pri);
+    p->work_cv.SignalAll();
+  }
   background_work_mutex_.Unlock();
 }
 
+void PosixEnv::StartPoolThreads(Priority pri) {
+  ThreadPool* p = pool(pri);
+  while (p->num_threads < p->max_threads) {
+    p->num_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  pri);
+    background_thread.detach();
+  }
+}
+
 // 回调函数
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadMain(Priority pri) {
+  ThreadPool* p = pool(pri);
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done. 如果工作队列为空，说明没有任务， 已经创建好得线程先等待
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (p->work_queue.empty() && p->num_threads <= p->max_threads) {
+      p->work_cv.Wait();
       //background_work_cv_： background thread 
     }
 
-    assert(!background_work_queue_.empty());
+    if (p->num_threads > p->max_threads) {
+      // The pool has been shrunk; this thread is no longer needed.
+      p->num_threads--;
+      background_work_mutex_.Unlock();
+      return;
+    }
+
+    assert(!p->work_queue.empty());
     // 如果队列不为空的话，就按照FIFO的策略
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    auto background_work_function = p->work_queue.front().function;
+    void* background_work_arg = p->work_queue.front().arg;
+    p->work_queue.pop();
+    p->active_threads++;
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
+
+    background_work_mutex_.Lock();
+    p->active_threads--;
+    background_work_mutex_.Unlock();
   }
 }
 
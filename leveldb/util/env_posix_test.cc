@@ -6,6 +6,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -212,6 +213,119 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestLinkFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  const std::string src = test_dir + "/link_src.txt";
+  const std::string target = test_dir + "/link_target.txt";
+  env_->RemoveFile(target);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "contents", src));
+
+  ASSERT_LEVELDB_OK(env_->LinkFile(src, target));
+  // Both names stay valid after the other is removed.
+  ASSERT_LEVELDB_OK(env_->RemoveFile(src));
+  std::string data;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, target, &data));
+  ASSERT_EQ("contents", data);
+
+  // The target must not exist, and the source must.
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "other", src));
+  ASSERT_FALSE(env_->LinkFile(src, target).ok());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(src));
+  ASSERT_FALSE(env_->LinkFile(src, test_dir + "/link_other.txt").ok());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(target));
+}
+
+TEST_F(EnvPosixTest, TestDirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Sizes that are not multiples of any alignment, with a Sync() between
+  // appends, which must not leave padding in the file.
+  std::string data;
+  for (int i = 0; data.size() < 200000; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  leveldb::WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  ASSERT_LEVELDB_OK(writable_file->Append(Slice(data.data(), 1000)));
+  ASSERT_LEVELDB_OK(writable_file->Sync());
+  ASSERT_LEVELDB_OK(writable_file->Append(Slice(data.data() + 1000, 100000)));
+  ASSERT_LEVELDB_OK(writable_file->Flush());
+  ASSERT_LEVELDB_OK(writable_file->Append(
+      Slice(data.data() + 101000, data.size() - 101000)));
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+  ASSERT_EQ(data.size(), file_size);
+
+  leveldb::RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  std::string scratch(data.size(), '\0');
+  Slice read_result;
+  ASSERT_LEVELDB_OK(file->Read(0, data.size(), &read_result, &scratch[0]));
+  ASSERT_EQ(data, read_result.ToString());
+  ASSERT_LEVELDB_OK(file->Read(4095, 5000, &read_result, &scratch[0]));
+  ASSERT_EQ(data.substr(4095, 5000), read_result.ToString());
+  // Reads past the end of the file are cut short.
+  ASSERT_LEVELDB_OK(
+      file->Read(data.size() - 10, 100, &read_result, &scratch[0]));
+  ASSERT_EQ(data.substr(data.size() - 10), read_result.ToString());
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, TestMultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Open more files than the limits allow, so that the batch is read both
+  // from permanent file descriptors and from file descriptors opened for
+  // the read.  The first files are memory-mapped and not read below, as
+  // mmap-backed reads fail past the end of the file.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 1;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+
+  // More requests than fit in one batch of the io_uring, including one that
+  // is cut short by the end of the file and one that starts past it.
+  const int kNumRequests = 100;
+  std::vector<std::string> scratch(kNumRequests, std::string(1000, '\0'));
+  for (int i = kMMapLimit; i < kNumFiles; i++) {
+    std::vector<ReadRequest> requests(kNumRequests);
+    for (int j = 0; j < kNumRequests; j++) {
+      requests[j].offset = (j * 7919) % (data.size() - 1000);
+      requests[j].n = 1000;
+      requests[j].scratch = &scratch[j][0];
+    }
+    requests[1].offset = data.size() - 10;
+    requests[2].offset = data.size();
+    files[i]->MultiRead(requests.data(), kNumRequests);
+    for (int j = 0; j < kNumRequests; j++) {
+      ASSERT_LEVELDB_OK(requests[j].status);
+      const uint64_t offset = std::min<uint64_t>(requests[j].offset,
+                                                 data.size());
+      ASSERT_EQ(data.substr(offset, 1000), requests[j].result.ToString());
+    }
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
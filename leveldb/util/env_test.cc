@@ -133,6 +133,95 @@ TEST_F(EnvTest, RunMany) {
   }
 }
 
+TEST_F(EnvTest, RunPriorities) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int low_started = 0;
+    bool high_done = false;
+    int low_done = 0;
+  };
+
+  struct Callback {
+    // Low priority work blocks until high priority work has run, which
+    // only happens if the two are served by different threads.
+    static void RunLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->low_started++;
+      state->cvar.SignalAll();
+      while (!state->high_done) {
+        state->cvar.Wait();
+      }
+      state->low_done++;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_done = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->Schedule(&Callback::RunLow, &state, Env::kLow);
+  {
+    MutexLock l(&state.mu);
+    while (state.low_started == 0) {
+      state.cvar.Wait();
+    }
+  }
+  ASSERT_GE(env_->GetThreadPoolActiveThreads(Env::kLow), 1);
+
+  // The single low priority thread is busy, so this one has to wait.
+  env_->Schedule(&Callback::RunLow, &state);
+  ASSERT_EQ(1, env_->GetThreadPoolQueueLen(Env::kLow));
+
+  env_->Schedule(&Callback::RunHigh, &state, Env::kHigh);
+  MutexLock l(&state.mu);
+  while (state.low_done != 2) {
+    state.cvar.Wait();
+  }
+  ASSERT_TRUE(state.high_done);
+}
+
+TEST_F(EnvTest, SetBackgroundThreads) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int started = 0;
+    int done = 0;
+
+    // Each work item waits for the other to start, so both have to run
+    // at the same time.
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->started++;
+      state->cvar.SignalAll();
+      while (state->started < 2) {
+        state->cvar.Wait();
+      }
+      state->done++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  env_->SetBackgroundThreads(2, Env::kHigh);
+  RunState state;
+  env_->Schedule(&RunState::Run, &state, Env::kHigh);
+  env_->Schedule(&RunState::Run, &state, Env::kHigh);
+  {
+    MutexLock l(&state.mu);
+    while (state.done != 2) {
+      state.cvar.Wait();
+    }
+  }
+  env_->SetBackgroundThreads(1, Env::kHigh);
+}
+
 struct State {
   port::Mutex mu;
   port::CondVar cvar{&mu};
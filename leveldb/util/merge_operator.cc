@@ -0,0 +1,77 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include "leveldb/env.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() {}
+
+bool MergeOperator::PartialMerge(const Slice& /*key*/,
+                                 const Slice& /*left_operand*/,
+                                 const Slice& /*right_operand*/,
+                                 std::string* /*new_value*/,
+                                 Logger* /*logger*/) const {
+  return false;
+}
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.UInt64AddOperator"; }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands, std::string* new_value,
+                 Logger* logger) const override {
+    uint64_t sum = 0;
+    if (existing_value != nullptr && !Decode(*existing_value, &sum, logger)) {
+      return false;
+    }
+    for (const Slice& operand : operands) {
+      uint64_t n;
+      if (!Decode(operand, &n, logger)) {
+        return false;
+      }
+      sum += n;
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+
+  bool PartialMerge(const Slice& /*key*/, const Slice& left_operand,
+                    const Slice& right_operand, std::string* new_value,
+                    Logger* logger) const override {
+    uint64_t left, right;
+    if (!Decode(left_operand, &left, logger) ||
+        !Decode(right_operand, &right, logger)) {
+      return false;
+    }
+    new_value->clear();
+    PutFixed64(new_value, left + right);
+    return true;
+  }
+
+ private:
+  static bool Decode(const Slice& s, uint64_t* n, Logger* logger) {
+    if (s.size() != sizeof(uint64_t)) {
+      Log(logger, "UInt64AddOperator: malformed value of %d bytes",
+          static_cast<int>(s.size()));
+      return false;
+    }
+    *n = DecodeFixed64(s.data());
+    return true;
+  }
+};
+
+}  // namespace
+
+const MergeOperator* NewUInt64AddOperator() { return new UInt64AddOperator; }
+
+}  // namespace leveldb
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <cstdio>
+
+#include "util/perf_timer.h"
+
+namespace leveldb {
+
+thread_local PerfLevel perf_level = kDisable;
+thread_local PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) { perf_level = level; }
+
+PerfLevel GetPerfLevel() { return perf_level; }
+
+PerfContext* GetPerfContext() { return &perf_context; }
+
+void PerfContext::Reset() {
+  get_from_memtable_count = 0;
+  get_from_memtable_nanos = 0;
+  get_from_output_files_nanos = 0;
+  db_mutex_lock_nanos = 0;
+  get_from_table_count = 0;
+  find_table_nanos = 0;
+  table_open_count = 0;
+  bloom_filter_useful_count = 0;
+  bloom_filter_may_match_count = 0;
+  filter_probe_nanos = 0;
+  block_cache_hit_count = 0;
+  block_cache_miss_count = 0;
+  block_read_count = 0;
+  block_read_bytes = 0;
+  block_read_nanos = 0;
+  block_checksum_nanos = 0;
+  block_decompress_nanos = 0;
+  seek_internal_nanos = 0;
+  internal_key_skipped_count = 0;
+  internal_delete_skipped_count = 0;
+}
+
+std::string PerfContext::ToString(bool exclude_zero_counters) const {
+  const struct {
+    const char* name;
+    uint64_t value;
+  } fields[] = {
+      {"get_from_memtable_count", get_from_memtable_count},
+      {"get_from_memtable_nanos", get_from_memtable_nanos},
+      {"get_from_output_files_nanos", get_from_output_files_nanos},
+      {"db_mutex_lock_nanos", db_mutex_lock_nanos},
+      {"get_from_table_count", get_from_table_count},
+      {"find_table_nanos", find_table_nanos},
+      {"table_open_count", table_open_count},
+      {"bloom_filter_useful_count", bloom_filter_useful_count},
+      {"bloom_filter_may_match_count", bloom_filter_may_match_count},
+      {"filter_probe_nanos", filter_probe_nanos},
+      {"block_cache_hit_count", block_cache_hit_count},
+      {"block_cache_miss_count", block_cache_miss_count},
+      {"block_read_count", block_read_count},
+      {"block_read_bytes", block_read_bytes},
+      {"block_read_nanos", block_read_nanos},
+      {"block_checksum_nanos", block_checksum_nanos},
+      {"block_decompress_nanos", block_decompress_nanos},
+      {"seek_internal_nanos", seek_internal_nanos},
+      {"internal_key_skipped_count", internal_key_skipped_count},
+      {"internal_delete_skipped_count", internal_delete_skipped_count},
+  };
+  std::string r;
+  char buf[100];
+  for (const auto& field : fields) {
+    if (exclude_zero_counters && field.value == 0) {
+      continue;
+    }
+    std::snprintf(buf, sizeof(buf), "%s%s = %llu", r.empty() ? "" : ", ",
+                  field.name, static_cast<unsigned long long>(field.value));
+    r.append(buf);
+  }
+  return r;
+}
+
+}  // namespace leveldb
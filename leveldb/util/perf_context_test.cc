@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "util/perf_timer.h"
+
+namespace leveldb {
+
+class PerfContextTest : public testing::Test {
+ public:
+  PerfContextTest() { GetPerfContext()->Reset(); }
+  ~PerfContextTest() { SetPerfLevel(kDisable); }
+};
+
+TEST_F(PerfContextTest, Disabled) {
+  SetPerfLevel(kDisable);
+  PerfCount(&PerfContext::block_read_count);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+  }
+  ASSERT_EQ(0, GetPerfContext()->block_read_count);
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+}
+
+TEST_F(PerfContextTest, Levels) {
+  SetPerfLevel(kEnableCount);
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_bytes, 4096);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+  }
+  ASSERT_EQ(1, GetPerfContext()->block_read_count);
+  ASSERT_EQ(4096, GetPerfContext()->block_read_bytes);
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+
+  SetPerfLevel(kEnableTime);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_GE(GetPerfContext()->block_read_nanos, 1000000);
+
+  GetPerfContext()->Reset();
+  ASSERT_EQ(0, GetPerfContext()->block_read_count);
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+}
+
+TEST_F(PerfContextTest, TimerStopAndRestart) {
+  SetPerfLevel(kEnableTime);
+  PerfTimer timer(&PerfContext::seek_internal_nanos);
+  timer.Stop();
+  const uint64_t stopped = GetPerfContext()->seek_internal_nanos;
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  timer.Stop();
+  ASSERT_EQ(stopped, GetPerfContext()->seek_internal_nanos);
+
+  timer.Restart();
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  timer.Stop();
+  ASSERT_GE(GetPerfContext()->seek_internal_nanos, stopped + 1000000);
+}
+
+TEST_F(PerfContextTest, PerThread) {
+  SetPerfLevel(kEnableCount);
+  PerfCount(&PerfContext::table_open_count, 3);
+  std::thread other([]() {
+    // Each thread starts with collection disabled and an empty context.
+    ASSERT_EQ(kDisable, GetPerfLevel());
+    ASSERT_EQ(0, GetPerfContext()->table_open_count);
+    SetPerfLevel(kEnableCount);
+    PerfCount(&PerfContext::table_open_count, 5);
+    ASSERT_EQ(5, GetPerfContext()->table_open_count);
+  });
+  other.join();
+  ASSERT_EQ(3, GetPerfContext()->table_open_count);
+}
+
+TEST_F(PerfContextTest, ToString) {
+  SetPerfLevel(kEnableCount);
+  PerfCount(&PerfContext::block_cache_hit_count, 7);
+  PerfCount(&PerfContext::internal_delete_skipped_count, 2);
+
+  const std::string all = GetPerfContext()->ToString();
+  ASSERT_EQ(0, all.find("get_from_memtable_count = 0, "));
+  ASSERT_NE(std::string::npos, all.find("block_cache_hit_count = 7"));
+
+  ASSERT_EQ("block_cache_hit_count = 7, internal_delete_skipped_count = 2",
+            GetPerfContext()->ToString(true));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_TIMER_H_
+#define STORAGE_LEVELDB_UTIL_PERF_TIMER_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "leveldb/perf_context.h"
+
+namespace leveldb {
+
+// The perf level and context of each thread (see perf_context.cc).  Read
+// directly, rather than through GetPerfLevel(), so that checking whether
+// collection is enabled stays cheap.
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+// Add "value" to a counter of the calling thread's PerfContext.
+inline void PerfCount(uint64_t PerfContext::*counter, uint64_t value = 1) {
+  if (perf_level >= kEnableCount) {
+    perf_context.*counter += value;
+  }
+}
+
+// Helper class that adds the time from its construction to the end of its
+// scope, or to the call of Stop(), to a timer of the calling thread's
+// PerfContext.  Restart() begins timing again after a Stop().  Does not read
+// the clock unless timing is enabled.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*timer)
+      : timer_(timer), running_(false), start_nanos_(0) {
+    Restart();
+  }
+
+  PerfTimer(const PerfTimer&) = delete;
+  PerfTimer& operator=(const PerfTimer&) = delete;
+
+  ~PerfTimer() { Stop(); }
+
+  void Restart() {
+    running_ = perf_level >= kEnableTime;
+    if (running_) {
+      start_nanos_ = NowNanos();
+    }
+  }
+
+  void Stop() {
+    if (running_) {
+      perf_context.*timer_ += NowNanos() - start_nanos_;
+      running_ = false;
+    }
+  }
+
+ private:
+  static uint64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  uint64_t PerfContext::*const timer_;
+  bool running_;
+  uint64_t start_nanos_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_TIMER_H_
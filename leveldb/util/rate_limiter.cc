@@ -0,0 +1,186 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {}
+
+namespace {
+
+// Tokens are added to the bucket once per period.
+static const uint64_t kRefillPeriodMicros = 100 * 1000;
+
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(int64_t bytes_per_second, Env* env)
+      : env_(env),
+        cv_(&mu_),
+        bytes_per_second_(0),
+        refill_bytes_(0),
+        available_(0),
+        next_refill_micros_(0),
+        timer_waiting_(false) {
+    SetBytesPerSecondLocked(bytes_per_second);
+    for (int i = 0; i < 2; i++) {
+      total_bytes_[i] = 0;
+      throttled_micros_[i] = 0;
+    }
+  }
+
+  ~TokenBucketRateLimiter() override {
+    assert(queue_[kLow].empty());
+    assert(queue_[kHigh].empty());
+  }
+
+  void Request(int64_t bytes, Priority priority) override {
+    MutexLock l(&mu_);
+    total_bytes_[priority] += bytes;
+    while (bytes > 0) {
+      // Larger requests are split so that every piece fits in the bucket.
+      const int64_t chunk = std::min(bytes, refill_bytes_);
+      bytes -= chunk;
+
+      Refill();
+      if (NothingQueuedBefore(priority) && available_ >= chunk) {
+        available_ -= chunk;
+        continue;
+      }
+
+      // Wait in line.  Whoever is first to wait sleeps until the next
+      // refill and hands the new tokens out; the others wait on cv_.
+      const uint64_t start_micros = env_->NowMicros();
+      Waiter w;
+      w.bytes = chunk;
+      w.granted = false;
+      queue_[priority].push_back(&w);
+      while (!w.granted) {
+        if (!timer_waiting_) {
+          timer_waiting_ = true;
+          const uint64_t now = env_->NowMicros();
+          if (now < next_refill_micros_) {
+            mu_.Unlock();
+            env_->SleepForMicroseconds(
+                static_cast<int>(next_refill_micros_ - now));
+            mu_.Lock();
+          }
+          timer_waiting_ = false;
+          Refill();
+          // Wake the others even if nothing was granted so that one of
+          // them takes over the timer.
+          cv_.SignalAll();
+        } else {
+          cv_.Wait();
+        }
+      }
+      throttled_micros_[priority] += env_->NowMicros() - start_micros;
+    }
+  }
+
+  void SetBytesPerSecond(int64_t bytes_per_second) override {
+    MutexLock l(&mu_);
+    SetBytesPerSecondLocked(bytes_per_second);
+    cv_.SignalAll();
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+  int64_t GetTotalBytesThrough(Priority priority) const override {
+    MutexLock l(&mu_);
+    return total_bytes_[priority];
+  }
+
+  uint64_t GetTotalThrottledMicros(Priority priority) const override {
+    MutexLock l(&mu_);
+    return throttled_micros_[priority];
+  }
+
+ private:
+  struct Waiter {
+    int64_t bytes;
+    bool granted;
+  };
+
+  void SetBytesPerSecondLocked(int64_t bytes_per_second)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    assert(bytes_per_second > 0);
+    bytes_per_second_ = bytes_per_second;
+    refill_bytes_ = std::max<int64_t>(
+        1, bytes_per_second * kRefillPeriodMicros / 1000000);
+    available_ = std::min(available_, refill_bytes_);
+  }
+
+  // Return true iff no request of "priority" or higher is waiting.
+  bool NothingQueuedBefore(Priority priority) const
+      EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return queue_[kHigh].empty() &&
+           (priority == kHigh || queue_[kLow].empty());
+  }
+
+  // If a refill period has passed, fill the bucket and hand its tokens
+  // to the waiting requests in order, high priority first.
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const uint64_t now = env_->NowMicros();
+    if (now < next_refill_micros_) {
+      return;
+    }
+    next_refill_micros_ = now + kRefillPeriodMicros;
+    // Unused tokens do not accumulate past one period so that an idle
+    // limiter does not allow a long burst.
+    available_ = refill_bytes_;
+
+    for (std::deque<Waiter*>* queue : {&queue_[kHigh], &queue_[kLow]}) {
+      while (!queue->empty()) {
+        Waiter* w = queue->front();
+        // A request queued before the rate was lowered may be larger than
+        // a full bucket; let it through rather than starve it.
+        if (w->bytes > available_ && available_ < refill_bytes_) {
+          return;
+        }
+        available_ = std::max<int64_t>(0, available_ - w->bytes);
+        w->granted = true;
+        queue->pop_front();
+      }
+    }
+  }
+
+  Env* const env_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+
+  int64_t bytes_per_second_ GUARDED_BY(mu_);
+  int64_t refill_bytes_ GUARDED_BY(mu_);  // Bucket size
+  int64_t available_ GUARDED_BY(mu_);     // Tokens left in the bucket
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+
+  // True if a waiter is sleeping until the next refill.
+  bool timer_waiting_ GUARDED_BY(mu_);
+  std::deque<Waiter*> queue_[2] GUARDED_BY(mu_);
+
+  int64_t total_bytes_[2] GUARDED_BY(mu_);
+  uint64_t throttled_micros_[2] GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(int64_t bytes_per_second, Env* env) {
+  return new TokenBucketRateLimiter(bytes_per_second,
+                                    env != nullptr ? env : Env::Default());
+}
+
+}  // namespace leveldb
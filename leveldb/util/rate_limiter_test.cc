@@ -0,0 +1,88 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <atomic>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+TEST(RateLimiterTest, Throughput) {
+  RateLimiter* limiter = NewRateLimiter(1 << 20);
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 30; i++) {
+    limiter->Request(10 << 10, RateLimiter::kLow);
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+
+  // 300KB at 1MB/s, less the first period's worth of tokens.
+  ASSERT_GE(elapsed, 150000);
+  ASSERT_EQ(300 << 10, limiter->GetTotalBytesThrough(RateLimiter::kLow));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+  ASSERT_GT(limiter->GetTotalThrottledMicros(RateLimiter::kLow), 0);
+  ASSERT_EQ(0, limiter->GetTotalThrottledMicros(RateLimiter::kHigh));
+  delete limiter;
+}
+
+TEST(RateLimiterTest, LargeRequest) {
+  RateLimiter* limiter = NewRateLimiter(1 << 20);
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  // Larger than a full bucket.
+  limiter->Request(300 << 10, RateLimiter::kHigh);
+  ASSERT_GE(env->NowMicros() - start, 150000);
+  ASSERT_EQ(300 << 10, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+  delete limiter;
+}
+
+TEST(RateLimiterTest, SetBytesPerSecond) {
+  RateLimiter* limiter = NewRateLimiter(1 << 10);
+  limiter->SetBytesPerSecond(100 << 20);
+  ASSERT_EQ(100 << 20, limiter->GetBytesPerSecond());
+
+  // 20MB at the new rate would take days at the old one.
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 20; i++) {
+    limiter->Request(1 << 20, RateLimiter::kLow);
+  }
+  ASSERT_LT(env->NowMicros() - start, 10 * 1000000);
+  delete limiter;
+}
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  RateLimiter* limiter = NewRateLimiter(1 << 20);
+  std::atomic<bool> low_done(false);
+  std::atomic<bool> high_done_before_low(false);
+
+  // Drain the bucket so that both threads have to wait.
+  limiter->Request(100 << 10, RateLimiter::kLow);
+
+  std::thread low([&]() {
+    limiter->Request(500 << 10, RateLimiter::kLow);
+    low_done.store(true);
+  });
+  Env::Default()->SleepForMicroseconds(50000);
+  std::thread high([&]() {
+    limiter->Request(200 << 10, RateLimiter::kHigh);
+    high_done_before_low.store(!low_done.load());
+  });
+  high.join();
+  low.join();
+
+  ASSERT_TRUE(high_done_before_low.load());
+  ASSERT_EQ(600 << 10, limiter->GetTotalBytesThrough(RateLimiter::kLow));
+  ASSERT_EQ(200 << 10, limiter->GetTotalBytesThrough(RateLimiter::kHigh));
+  ASSERT_GT(limiter->GetTotalThrottledMicros(RateLimiter::kHigh), 0);
+  delete limiter;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/readahead_file.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  ReadaheadRandomAccessFile(RandomAccessFile* file, uint64_t file_size,
+                            size_t readahead_size)
+      : file_(file),
+        file_size_(file_size),
+        readahead_size_(readahead_size),
+        buffer_(new char[readahead_size]),
+        buffer_offset_(0),
+        buffer_size_(0) {
+    assert(readahead_size > 0);
+  }
+
+  ~ReadaheadRandomAccessFile() override {
+    delete[] buffer_;
+    delete file_;
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (n > readahead_size_) {
+      return file_->Read(offset, n, result, scratch);
+    }
+
+    MutexLock l(&mu_);
+    if (offset < buffer_offset_ || offset + n > buffer_offset_ + buffer_size_) {
+      // Some files fail reads past their end rather than cut them short.
+      const size_t chunk_size =
+          offset < file_size_ ? std::min<uint64_t>(readahead_size_,
+                                                   file_size_ - offset)
+                              : 0;
+      Slice chunk;
+      Status s = file_->Read(offset, chunk_size, &chunk, buffer_);
+      if (!s.ok()) {
+        buffer_size_ = 0;
+        *result = Slice();
+        return s;
+      }
+      if (chunk.data() != buffer_) {
+        std::memcpy(buffer_, chunk.data(), chunk.size());
+      }
+      buffer_offset_ = offset;
+      buffer_size_ = chunk.size();
+      if (offset + buffer_size_ < file_size_) {
+        file_->Prefetch(offset + buffer_size_, readahead_size_);
+      }
+    }
+
+    // The buffer is overwritten by later reads, so copy out of it.
+    const size_t skip = offset - buffer_offset_;
+    n = std::min(n, buffer_size_ > skip ? buffer_size_ - skip : 0);
+    std::memcpy(scratch, buffer_ + skip, n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  void Prefetch(uint64_t offset, size_t n) const override {
+    file_->Prefetch(offset, n);
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  const uint64_t file_size_;
+  const size_t readahead_size_;
+
+  mutable port::Mutex mu_;
+  // buffer_[0, buffer_size_ - 1] holds the file's bytes from buffer_offset_
+  char* const buffer_ GUARDED_BY(mu_);
+  mutable uint64_t buffer_offset_ GUARDED_BY(mu_);
+  mutable size_t buffer_size_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                               uint64_t file_size,
+                                               size_t readahead_size) {
+  return new ReadaheadRandomAccessFile(file, file_size, readahead_size);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,31 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace leveldb {
+
+class RandomAccessFile;
+
+// Return a file that reads "file", which holds "file_size" bytes, in
+// chunks of "readahead_size" bytes, keeping the last chunk read in a
+// buffer, so that a sequence of small reads at increasing offsets, such as
+// a compaction makes, turns into few large reads.  Once a chunk has been
+// read, the next one is prefetched in the background (see
+// RandomAccessFile::Prefetch).  Reads larger than "readahead_size" go
+// straight to "file".
+//
+// The result takes ownership of "file".
+// REQUIRES: readahead_size > 0
+RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                               uint64_t file_size,
+                                               size_t readahead_size);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/readahead_file.h"
+
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+// A file held in memory that counts the calls made to it.
+class CountingFile : public RandomAccessFile {
+ public:
+  CountingFile(const std::string& contents, int* reads, int* prefetches)
+      : contents_(contents), reads_(reads), prefetches_(prefetches) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    ++*reads_;
+    if (offset + n > contents_.size()) {
+      return Status::InvalidArgument("invalid Read offset");
+    }
+    std::memcpy(scratch, contents_.data() + offset, n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  void Prefetch(uint64_t /*offset*/, size_t /*n*/) const override {
+    ++*prefetches_;
+  }
+
+ private:
+  const std::string contents_;
+  int* const reads_;
+  int* const prefetches_;
+};
+
+class ReadaheadFileTest : public testing::Test {
+ public:
+  ReadaheadFileTest() : reads_(0), prefetches_(0) {
+    for (int i = 0; i < 10000; i++) {
+      contents_.push_back(static_cast<char>(i % 251));
+    }
+    file_ = NewReadaheadRandomAccessFile(
+        new CountingFile(contents_, &reads_, &prefetches_), contents_.size(),
+        1000);
+  }
+
+  ~ReadaheadFileTest() override { delete file_; }
+
+  std::string Read(uint64_t offset, size_t n) {
+    std::string scratch(n, '\0');
+    Slice result;
+    EXPECT_TRUE(file_->Read(offset, n, &result, &scratch[0]).ok());
+    return result.ToString();
+  }
+
+  std::string contents_;
+  int reads_;
+  int prefetches_;
+  RandomAccessFile* file_;
+};
+
+TEST_F(ReadaheadFileTest, Sequential) {
+  for (int offset = 0; offset < 10000; offset += 100) {
+    ASSERT_EQ(contents_.substr(offset, 100), Read(offset, 100));
+  }
+  ASSERT_EQ(10, reads_);
+  // All but the last chunk prefetch the next one.
+  ASSERT_EQ(9, prefetches_);
+}
+
+TEST_F(ReadaheadFileTest, Random) {
+  ASSERT_EQ(contents_.substr(5000, 10), Read(5000, 10));
+  ASSERT_EQ(contents_.substr(5500, 500), Read(5500, 500));
+  ASSERT_EQ(1, reads_);
+  // Before the buffer, and straddling its end.
+  ASSERT_EQ(contents_.substr(4000, 10), Read(4000, 10));
+  ASSERT_EQ(contents_.substr(4990, 20), Read(4990, 20));
+  ASSERT_EQ(3, reads_);
+}
+
+TEST_F(ReadaheadFileTest, LargeRead) {
+  ASSERT_EQ(contents_.substr(100, 5000), Read(100, 5000));
+  ASSERT_EQ(1, reads_);
+  ASSERT_EQ(0, prefetches_);
+}
+
+TEST_F(ReadaheadFileTest, EndOfFile) {
+  ASSERT_EQ(contents_.substr(9500), Read(9500, 600));
+  ASSERT_EQ("", Read(10000, 10));
+  // No prefetch past the end of the file.
+  ASSERT_EQ(0, prefetches_);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,85 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <string>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+SliceTransform::~SliceTransform() {}
+
+namespace {
+
+class FixedPrefixTransform : public SliceTransform {
+ public:
+  explicit FixedPrefixTransform(size_t prefix_len)
+      : prefix_len_(prefix_len),
+        name_("leveldb.FixedPrefix." + std::to_string(prefix_len)) {}
+
+  const char* Name() const override { return name_.c_str(); }
+
+  bool InDomain(const Slice& key) const override {
+    return key.size() >= prefix_len_;
+  }
+
+  Slice Transform(const Slice& key) const override {
+    return Slice(key.data(), prefix_len_);
+  }
+
+ private:
+  const size_t prefix_len_;
+  const std::string name_;
+};
+
+class DelimitedPrefixTransform : public SliceTransform {
+ public:
+  DelimitedPrefixTransform(char delimiter, int num_fields)
+      : delimiter_(delimiter),
+        num_fields_(num_fields),
+        name_("leveldb.DelimitedPrefix." +
+              std::to_string(static_cast<unsigned char>(delimiter)) + "." +
+              std::to_string(num_fields)) {}
+
+  const char* Name() const override { return name_.c_str(); }
+
+  bool InDomain(const Slice& key) const override {
+    return PrefixLength(key) > 0;
+  }
+
+  Slice Transform(const Slice& key) const override {
+    return Slice(key.data(), PrefixLength(key));
+  }
+
+ private:
+  // Return the length of the prefix of "key", or 0 if it has none.
+  size_t PrefixLength(const Slice& key) const {
+    int fields = 0;
+    for (size_t i = 0; i < key.size(); i++) {
+      if (key[i] == delimiter_ && ++fields == num_fields_) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+  const char delimiter_;
+  const int num_fields_;
+  const std::string name_;
+};
+
+}  // namespace
+
+const SliceTransform* NewFixedPrefixTransform(size_t prefix_len) {
+  return new FixedPrefixTransform(prefix_len);
+}
+
+const SliceTransform* NewDelimitedPrefixTransform(char delimiter,
+                                                  int num_fields) {
+  return new DelimitedPrefixTransform(delimiter, num_fields);
+}
+
+}  // namespace leveldb
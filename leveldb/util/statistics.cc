@@ -0,0 +1,271 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+const int Statistics::kMaxLevel;
+
+Statistics::~Statistics() {}
+
+const char* TickerName(Ticker ticker) {
+  switch (ticker) {
+    case kBlockCacheHit:
+      return "block.cache.hit";
+    case kBlockCacheMiss:
+      return "block.cache.miss";
+    case kBlockCacheAdd:
+      return "block.cache.add";
+    case kTableCacheHit:
+      return "table.cache.hit";
+    case kTableCacheMiss:
+      return "table.cache.miss";
+    case kBloomFilterUseful:
+      return "bloom.filter.useful";
+    case kBloomFilterMayMatch:
+      return "bloom.filter.may.match";
+    case kMemtableHit:
+      return "memtable.hit";
+    case kMemtableMiss:
+      return "memtable.miss";
+    case kNumberKeysRead:
+      return "number.keys.read";
+    case kBytesRead:
+      return "bytes.read";
+    case kNumberKeysWritten:
+      return "number.keys.written";
+    case kBytesWritten:
+      return "bytes.written";
+    case kWalBytes:
+      return "wal.bytes";
+    case kWalSyncs:
+      return "wal.syncs";
+    case kFlushBytesWritten:
+      return "flush.bytes.written";
+    case kCompactionBytesRead:
+      return "compaction.bytes.read";
+    case kCompactionBytesWritten:
+      return "compaction.bytes.written";
+    case kStallMicros:
+      return "stall.micros";
+    case kTickerMax:
+      break;
+  }
+  assert(false);
+  return "unknown";
+}
+
+const char* LevelTickerName(LevelTicker ticker) {
+  switch (ticker) {
+    case kLevelBytesRead:
+      return "bytes.read";
+    case kLevelBytesWritten:
+      return "bytes.written";
+    case kLevelTickerMax:
+      break;
+  }
+  assert(false);
+  return "unknown";
+}
+
+const char* HistogramName(HistogramType histogram) {
+  switch (histogram) {
+    case kDBGetMicros:
+      return "db.get.micros";
+    case kDBMultiGetMicros:
+      return "db.multiget.micros";
+    case kDBWriteMicros:
+      return "db.write.micros";
+    case kWalSyncMicros:
+      return "wal.sync.micros";
+    case kTableOpenMicros:
+      return "table.open.micros";
+    case kFlushMicros:
+      return "flush.micros";
+    case kCompactionMicros:
+      return "compaction.micros";
+    case kHistogramMax:
+      break;
+  }
+  assert(false);
+  return "unknown";
+}
+
+namespace {
+
+class StatisticsImpl : public Statistics {
+ public:
+  StatisticsImpl() { Reset(); }
+
+  void RecordTick(Ticker ticker, uint64_t count) override {
+    assert(ticker < kTickerMax);
+    tickers_[ticker].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void RecordLevelTick(LevelTicker ticker, int level,
+                       uint64_t count) override {
+    assert(ticker < kLevelTickerMax);
+    level_tickers_[ticker][ClampLevel(level)].fetch_add(
+        count, std::memory_order_relaxed);
+  }
+
+  void MeasureTime(HistogramType histogram, uint64_t value) override {
+    assert(histogram < kHistogramMax);
+    MutexLock l(&histograms_[histogram].mu);
+    histograms_[histogram].histogram.Add(static_cast<double>(value));
+  }
+
+  uint64_t GetTickerCount(Ticker ticker) const override {
+    assert(ticker < kTickerMax);
+    return tickers_[ticker].load(std::memory_order_relaxed);
+  }
+
+  uint64_t GetLevelTickerCount(LevelTicker ticker, int level) const override {
+    assert(ticker < kLevelTickerMax);
+    return level_tickers_[ticker][ClampLevel(level)].load(
+        std::memory_order_relaxed);
+  }
+
+  void GetHistogramData(HistogramType histogram,
+                        HistogramData* data) const override {
+    assert(histogram < kHistogramMax);
+    MutexLock l(&histograms_[histogram].mu);
+    const Histogram& h = histograms_[histogram].histogram;
+    data->count = h.Count();
+    if (data->count == 0) {
+      data->sum = data->min = data->max = data->average = data->median =
+          data->percentile95 = data->percentile99 = data->standard_deviation =
+              0;
+      return;
+    }
+    data->sum = h.Sum();
+    data->min = h.Min();
+    data->max = h.Max();
+    data->average = h.Average();
+    data->median = h.Median();
+    data->percentile95 = h.Percentile(95);
+    data->percentile99 = h.Percentile(99);
+    data->standard_deviation = h.StandardDeviation();
+  }
+
+  void Reset() override {
+    for (uint32_t i = 0; i < kTickerMax; i++) {
+      tickers_[i].store(0, std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < kLevelTickerMax; i++) {
+      for (int level = 0; level <= kMaxLevel; level++) {
+        level_tickers_[i][level].store(0, std::memory_order_relaxed);
+      }
+    }
+    for (uint32_t i = 0; i < kHistogramMax; i++) {
+      MutexLock l(&histograms_[i].mu);
+      histograms_[i].histogram.Clear();
+    }
+  }
+
+  std::string ToString() const override {
+    std::string r;
+    char buf[200];
+    for (uint32_t i = 0; i < kTickerMax; i++) {
+      std::snprintf(buf, sizeof(buf), "%s: %llu\n",
+                    TickerName(static_cast<Ticker>(i)),
+                    static_cast<unsigned long long>(
+                        GetTickerCount(static_cast<Ticker>(i))));
+      r.append(buf);
+    }
+    for (uint32_t i = 0; i < kLevelTickerMax; i++) {
+      std::snprintf(buf, sizeof(buf), "level.%s:",
+                    LevelTickerName(static_cast<LevelTicker>(i)));
+      r.append(buf);
+      for (int level = 0; level <= kMaxLevel; level++) {
+        std::snprintf(buf, sizeof(buf), " %llu",
+                      static_cast<unsigned long long>(GetLevelTickerCount(
+                          static_cast<LevelTicker>(i), level)));
+        r.append(buf);
+      }
+      r.append("\n");
+    }
+    for (uint32_t i = 0; i < kHistogramMax; i++) {
+      r.append(HistogramName(static_cast<HistogramType>(i)));
+      r.append(":\n");
+      MutexLock l(&histograms_[i].mu);
+      r.append(histograms_[i].histogram.ToString());
+    }
+    return r;
+  }
+
+  std::string ToValues() const override {
+    std::string r;
+    char buf[200];
+    for (uint32_t i = 0; i < kTickerMax; i++) {
+      std::snprintf(buf, sizeof(buf), "%s %llu\n",
+                    TickerName(static_cast<Ticker>(i)),
+                    static_cast<unsigned long long>(
+                        GetTickerCount(static_cast<Ticker>(i))));
+      r.append(buf);
+    }
+    for (uint32_t i = 0; i < kLevelTickerMax; i++) {
+      for (int level = 0; level <= kMaxLevel; level++) {
+        std::snprintf(buf, sizeof(buf), "level%d.%s %llu\n", level,
+                      LevelTickerName(static_cast<LevelTicker>(i)),
+                      static_cast<unsigned long long>(GetLevelTickerCount(
+                          static_cast<LevelTicker>(i), level)));
+        r.append(buf);
+      }
+    }
+    for (uint32_t i = 0; i < kHistogramMax; i++) {
+      const char* name = HistogramName(static_cast<HistogramType>(i));
+      HistogramData data;
+      GetHistogramData(static_cast<HistogramType>(i), &data);
+      const struct {
+        const char* suffix;
+        double value;
+      } fields[] = {{"count", data.count},
+                    {"sum", data.sum},
+                    {"min", data.min},
+                    {"max", data.max},
+                    {"average", data.average},
+                    {"p50", data.median},
+                    {"p95", data.percentile95},
+                    {"p99", data.percentile99}};
+      for (const auto& field : fields) {
+        std::snprintf(buf, sizeof(buf), "%s.%s %.4f\n", name, field.suffix,
+                      field.value);
+        r.append(buf);
+      }
+    }
+    return r;
+  }
+
+ private:
+  struct LockedHistogram {
+    mutable port::Mutex mu;
+    Histogram histogram GUARDED_BY(mu);
+  };
+
+  static int ClampLevel(int level) {
+    assert(level >= 0);
+    return level < kMaxLevel ? level : kMaxLevel;
+  }
+
+  std::atomic<uint64_t> tickers_[kTickerMax];
+  std::atomic<uint64_t> level_tickers_[kLevelTickerMax][kMaxLevel + 1];
+  LockedHistogram histograms_[kHistogramMax];
+};
+
+}  // namespace
+
+Statistics* NewStatistics() { return new StatisticsImpl(); }
+
+}  // namespace leveldb
@@ -0,0 +1,113 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(StatisticsTest, Tickers) {
+  Statistics* statistics = NewStatistics();
+  for (uint32_t i = 0; i < kTickerMax; i++) {
+    ASSERT_EQ(0, statistics->GetTickerCount(static_cast<Ticker>(i)));
+  }
+  statistics->RecordTick(kBlockCacheHit, 3);
+  statistics->RecordTick(kBlockCacheHit, 4);
+  statistics->RecordTick(kWalSyncs, 1);
+  ASSERT_EQ(7, statistics->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(1, statistics->GetTickerCount(kWalSyncs));
+  ASSERT_EQ(0, statistics->GetTickerCount(kBlockCacheMiss));
+
+  statistics->Reset();
+  ASSERT_EQ(0, statistics->GetTickerCount(kBlockCacheHit));
+  delete statistics;
+}
+
+TEST(StatisticsTest, LevelTickers) {
+  Statistics* statistics = NewStatistics();
+  statistics->RecordLevelTick(kLevelBytesWritten, 0, 100);
+  statistics->RecordLevelTick(kLevelBytesWritten, 2, 200);
+  // Levels past the last one are counted with it.
+  statistics->RecordLevelTick(kLevelBytesWritten, Statistics::kMaxLevel, 1);
+  statistics->RecordLevelTick(kLevelBytesWritten, Statistics::kMaxLevel + 3,
+                              2);
+  ASSERT_EQ(100, statistics->GetLevelTickerCount(kLevelBytesWritten, 0));
+  ASSERT_EQ(0, statistics->GetLevelTickerCount(kLevelBytesWritten, 1));
+  ASSERT_EQ(200, statistics->GetLevelTickerCount(kLevelBytesWritten, 2));
+  ASSERT_EQ(3, statistics->GetLevelTickerCount(kLevelBytesWritten,
+                                               Statistics::kMaxLevel));
+  ASSERT_EQ(0, statistics->GetLevelTickerCount(kLevelBytesRead, 0));
+  delete statistics;
+}
+
+TEST(StatisticsTest, Histograms) {
+  Statistics* statistics = NewStatistics();
+  HistogramData data;
+  statistics->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+  ASSERT_EQ(0, data.max);
+
+  for (int i = 1; i <= 100; i++) {
+    statistics->MeasureTime(kDBGetMicros, i);
+  }
+  statistics->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(100, data.count);
+  ASSERT_EQ(5050, data.sum);
+  ASSERT_EQ(1, data.min);
+  ASSERT_EQ(100, data.max);
+  ASSERT_DOUBLE_EQ(50.5, data.average);
+  ASSERT_GE(data.percentile99, data.percentile95);
+  ASSERT_GE(data.percentile95, data.median);
+
+  statistics->GetHistogramData(kDBWriteMicros, &data);
+  ASSERT_EQ(0, data.count);
+  delete statistics;
+}
+
+TEST(StatisticsTest, Concurrent) {
+  Statistics* statistics = NewStatistics();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([statistics]() {
+      for (int i = 0; i < 10000; i++) {
+        statistics->RecordTick(kNumberKeysRead, 1);
+        statistics->MeasureTime(kDBGetMicros, i);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(40000, statistics->GetTickerCount(kNumberKeysRead));
+  HistogramData data;
+  statistics->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(40000, data.count);
+  delete statistics;
+}
+
+TEST(StatisticsTest, Reports) {
+  Statistics* statistics = NewStatistics();
+  statistics->RecordTick(kBloomFilterUseful, 12);
+  statistics->RecordLevelTick(kLevelBytesRead, 1, 34);
+  statistics->MeasureTime(kCompactionMicros, 56);
+
+  const std::string text = statistics->ToString();
+  ASSERT_NE(std::string::npos, text.find("bloom.filter.useful: 12\n"));
+  ASSERT_NE(std::string::npos, text.find("level.bytes.read: 0 34 0"));
+  ASSERT_NE(std::string::npos, text.find("compaction.micros:\n"));
+
+  const std::string values = statistics->ToValues();
+  ASSERT_NE(std::string::npos, values.find("\nbloom.filter.useful 12\n"));
+  ASSERT_NE(std::string::npos, values.find("\nlevel1.bytes.read 34\n"));
+  ASSERT_NE(std::string::npos, values.find("\ncompaction.micros.count 1"));
+  ASSERT_NE(std::string::npos, values.find("\ncompaction.micros.max 56"));
+  delete statistics;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_STOP_WATCH_H_
+#define STORAGE_LEVELDB_UTIL_STOP_WATCH_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/statistics.h"
+
+namespace leveldb {
+
+// Add "count" to a ticker of "statistics", which may be null.
+inline void RecordTick(Statistics* statistics, Ticker ticker,
+                       uint64_t count = 1) {
+  if (statistics != nullptr) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
+// Helper class that records the time from its construction to the end of
+// its scope in a histogram of "statistics", which may be null.  Does not
+// read the clock if "statistics" is null.
+class StopWatch {
+ public:
+  StopWatch(Env* env, Statistics* statistics, HistogramType histogram)
+      : env_(env),
+        statistics_(statistics),
+        histogram_(histogram),
+        start_micros_(statistics != nullptr ? env->NowMicros() : 0) {}
+
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+
+  ~StopWatch() {
+    if (statistics_ != nullptr) {
+      statistics_->MeasureTime(histogram_, ElapsedMicros());
+    }
+  }
+
+  // REQUIRES: The statistics passed to the constructor are not null.
+  uint64_t ElapsedMicros() const { return env_->NowMicros() - start_micros_; }
+
+ private:
+  Env* const env_;
+  Statistics* const statistics_;
+  const HistogramType histogram_;
+  const uint64_t start_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_STOP_WATCH_H_